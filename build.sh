@@ -154,3 +154,13 @@ if [ "$?" = 0 ]; then
 	echo "CFLAGS += -DNEW_MAC" >> build_config.mk
 fi
 
+g++ -x c++ - -o $TMPDIR/ssdb_build_test.$$ 2>/dev/null <<EOF
+	#include <sys/syscall.h>
+	#include <linux/io_uring.h>
+	int main() { return __NR_io_uring_setup + IORING_ENTER_EXT_ARG; }
+EOF
+if [ "$?" = 0 ]; then
+	echo "CFLAGS += -DHAVE_IO_URING" >> build_config.mk
+fi
+rm -f $TMPDIR/ssdb_build_test.$$
+
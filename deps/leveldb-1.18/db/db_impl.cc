@@ -20,6 +20,7 @@
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -922,6 +923,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    // the pair is filtered out, but older versions must stay hidden
+    bool to_deletion = false;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -951,6 +954,21 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (ikey.type == kTypeValue &&
+                 last_sequence_for_key == kMaxSequenceNumber &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 options_.compaction_filter != NULL &&
+                 options_.compaction_filter->Filter(
+                     compact->compaction->level(), ikey.user_key,
+                     input->value())) {
+        // The older versions are dropped by rule (A), those in the
+        // levels below are shadowed by a deletion marker, added in
+        // place of this pair, as a deletion would be.
+        if (compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+          drop = true;
+        } else {
+          to_deletion = true;
+        }
       }
 
       last_sequence_for_key = ikey.sequence;
@@ -973,11 +991,20 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
           break;
         }
       }
+      std::string deletion;
+      Slice value = input->value();
+      if (to_deletion) {
+        AppendInternalKey(&deletion, ParsedInternalKey(ikey.user_key,
+                                                       ikey.sequence,
+                                                       kTypeDeletion));
+        key = deletion;
+        value = Slice();
+      }
       if (compact->builder->NumEntries() == 0) {
         compact->current_output()->smallest.DecodeFrom(key);
       }
       compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      compact->builder->Add(key, value);
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
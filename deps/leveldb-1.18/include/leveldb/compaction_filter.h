@@ -0,0 +1,40 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom CompactionFilter object,
+// which is shown every key,value pair a compaction is about to write
+// out, and may filter it out, so that data which is known to be dead
+// (e.g. expired by the application) is removed without being deleted
+// explicitly.
+//
+// Added by the SSDB authors.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+namespace leveldb {
+
+class Slice;
+
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter, used in the info log.
+  virtual const char* Name() const = 0;
+
+  // Return true if the pair should be removed.  Only the newest
+  // version of a key, not needed by any snapshot, is passed in.  A
+  // removed pair is dropped, or replaced by a deletion marker when
+  // older versions of the key may exist in the levels below "level".
+  //
+  // Called from the compaction thread without holding any lock, so it
+  // must be thread-safe, and must not call back into the DB.
+  virtual bool Filter(int level, const Slice& key,
+                      const Slice& value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -10,6 +10,7 @@
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
@@ -142,6 +143,12 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-NULL, consulted for the pairs written out by compactions,
+  // see compaction_filter.h.
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
   // Create an Options object with default values for all fields.
   Options();
 };
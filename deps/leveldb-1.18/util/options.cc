@@ -4,6 +4,7 @@
 
 #include "leveldb/options.h"
 
+#include "leveldb/compaction_filter.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 
@@ -23,8 +24,11 @@ Options::Options()
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      compaction_filter(NULL) {
 }
 
+CompactionFilter::~CompactionFilter() { }
+
 
 }  // namespace leveldb
@@ -77,6 +77,16 @@ void* BackendSync::_run_thread(void *arg){
 	SSDBImpl *ssdb = (SSDBImpl *)backend->ssdb;
 	BinlogQueue *logs = ssdb->binlogs;
 
+	// an older slave would store the kv values with the expire header
+	const std::vector<Bytes> *req = link->last_recv();
+	int version = req->size() > 4? req->at(4).Int() : 1;
+	if(version < SSDB_SYNC_VERSION){
+		log_error("%s:%d fd: %d, slave sync version %d < %d, upgrade the slave!",
+			link->remote_ip, link->remote_port, link->fd(), version, SSDB_SYNC_VERSION);
+		delete link;
+		return NULL;
+	}
+
 	Client client(backend);
 	client.link = link;
 	client.init();
@@ -136,6 +146,13 @@ void* BackendSync::_run_thread(void *arg){
 			idle = 0;
 		}
 
+		if(link->output_over_hard()){
+			log_info("%s:%d fd: %d, output %d bytes over the hard limit, delete link",
+				link->remote_ip, link->remote_port, link->fd(), link->output->size());
+			__sync_add_and_fetch(&link->output_limit->closed, 1);
+			break;
+		}
+
 		float data_size_mb = link->output->size() / 1024.0 / 1024.0;
 		if(link->flush() == -1){
 			log_info("%s:%d fd: %d, send error: %s", link->remote_ip, link->remote_port, link->fd(), strerror(errno));
@@ -324,6 +341,10 @@ int BackendSync::Client::copy(){
 		}else{
 			continue;
 		}
+		// items of cleared containers, not swept yet
+		if(cmd != BinlogCommand::KSET && backend->ssdb->is_garbage(key)){
+			continue;
+		}
 		ret++;
 		
 		Binlog log(this->last_seq, BinlogType::COPY, cmd, slice(key));
@@ -363,11 +384,6 @@ int BackendSync::Client::sync(BinlogQueue *logs){
 			return 0;
 		}
 		if(this->status == Client::COPY && log.key() > this->last_key){
-			log_debug("fd: %d, last_key: '%s', drop: %s",
-				link->fd(),
-				hexmem(this->last_key.data(), this->last_key.size()).c_str(),
-				log.dumps().c_str());
-			this->last_seq = log.seq();
 			// WARN: When there are writes behind last_key, we MUST create
 			// a new iterator, because iterator will not know this key.
 			// Because iterator ONLY iterates throught keys written before
@@ -376,7 +392,19 @@ int BackendSync::Client::sync(BinlogQueue *logs){
 				delete this->iter;
 				this->iter = NULL;
 			}
-			continue;
+			// the key of a clear is the bare name, not the key of the items,
+			// the items copied already must be cleared on the slave too, the
+			// rest of them are skipped by copy() as garbage
+			char cmd = log.cmd();
+			if(cmd != BinlogCommand::HCLEAR && cmd != BinlogCommand::ZCLEAR
+					&& cmd != BinlogCommand::QCLEAR){
+				log_debug("fd: %d, last_key: '%s', drop: %s",
+					link->fd(),
+					hexmem(this->last_key.data(), this->last_key.size()).c_str(),
+					log.dumps().c_str());
+				this->last_seq = log.seq();
+				continue;
+			}
 		}
 		if(this->last_seq != 0 && log.seq() != expect_seq){
 			log_warn("%s:%d fd: %d, OUT_OF_SYNC! log.seq: %" PRIu64 ", expect_seq: %" PRIu64 "",
@@ -430,6 +458,11 @@ int BackendSync::Client::sync(BinlogQueue *logs){
 		case BinlogCommand::ZDEL:
 		case BinlogCommand::QPOP_BACK:
 		case BinlogCommand::QPOP_FRONT:
+		case BinlogCommand::HCLEAR:
+		case BinlogCommand::ZCLEAR:
+		case BinlogCommand::QCLEAR:
+		case BinlogCommand::ZDEL_RANGE:
+		case BinlogCommand::KDEL_EXPIRED:
 			log_trace("fd: %d, %s", link->fd(), log.dumps().c_str());
 			link->send(log.repr());
 			break;
@@ -12,6 +12,11 @@ struct Fdevent* Fdevents::get_fde(int fd){
 		fde->s_flags = FDEVENT_NONE;
 		fde->data.num = 0;
 		fde->data.ptr = NULL;
+#ifdef HAVE_IO_URING
+		fde->u_flags = 0;
+		fde->u_gen = 0;
+		fde->u_dirty = false;
+#endif
 		events.push_back(fde);
 	}
 	return events[fd];
@@ -20,6 +25,9 @@ struct Fdevent* Fdevents::get_fde(int fd){
 
 #ifdef HAVE_EPOLL
 #include "fde_epoll.cpp"
+#ifdef HAVE_IO_URING
+#include "fde_uring.cpp"
+#endif
 #else
 #include "fde_select.cpp"
 #endif
@@ -11,6 +11,11 @@ found in the LICENSE file.
 #ifdef __linux__
 	#define HAVE_EPOLL 1
 #endif
+// HAVE_IO_URING is defined by build.sh if the headers support io_uring,
+// it is used instead of epoll only if asked for and the kernel supports it
+#if defined(HAVE_IO_URING) && !defined(HAVE_EPOLL)
+	#undef HAVE_IO_URING
+#endif
 
 #define FDEVENT_NONE	(0)
 #define FDEVENT_IN		(1<<0)
@@ -27,6 +32,11 @@ struct Fdevent{
 		int num;
 		void *ptr;
 	}data;
+#ifdef HAVE_IO_URING
+	int u_flags;  // events of the poll request in flight
+	uint32_t u_gen; // to tell completions of cancelled polls
+	bool u_dirty; // in the list of changes to be submitted
+#endif
 };
 
 #include <vector>
@@ -45,6 +55,20 @@ class Fdevents{
 		static const int MAX_FDS = 8 * 1024;
 		int ep_fd;
 		struct epoll_event ep_events[MAX_FDS];
+#ifdef HAVE_IO_URING
+		struct Uring *uring; // NULL if epoll is used
+		// fds whose subscription changed since the last wait
+		events_t uring_changes;
+		static struct Uring* uring_create();
+		static void uring_free(struct Uring *uring);
+		void uring_change(struct Fdevent *fde);
+		struct io_uring_sqe* uring_sqe();
+		int uring_submit(int wait_ms);
+		int uring_set(int fd, int flags, int data_num, void *data_ptr);
+		int uring_del(int fd);
+		int uring_clr(int fd, int flags);
+		const events_t* uring_wait(int timeout_ms);
+#endif
 #else
 		int maxfd;
 		fd_set readset;
@@ -55,8 +79,11 @@ class Fdevents{
 
 		struct Fdevent *get_fde(int fd);
 	public:
-		Fdevents();
+		// use_uring: use io_uring if supported, otherwise the default
+		Fdevents(bool use_uring=false);
 		~Fdevents();
+		// "epoll", "io_uring" or "select"
+		const char* backend() const;
 
 		bool isset(int fd, int flag);
 		int set(int fd, int flags, int data_num, void *data_ptr);
@@ -6,7 +6,17 @@ found in the LICENSE file.
 #ifndef UTIL_FDE_EPOLL_H
 #define UTIL_FDE_EPOLL_H
 
-Fdevents::Fdevents(){
+Fdevents::Fdevents(bool use_uring){
+	ep_fd = -1;
+#ifdef HAVE_IO_URING
+	uring = NULL;
+	if(use_uring){
+		uring = uring_create();
+	}
+	if(uring){
+		return;
+	}
+#endif
 	ep_fd = epoll_create(1024);
 }
 
@@ -14,19 +24,36 @@ Fdevents::~Fdevents(){
 	for(int i=0; i<(int)events.size(); i++){
 		delete events[i];
 	}
-	if(ep_fd){
+	if(ep_fd != -1){
 		::close(ep_fd);
 	}
+#ifdef HAVE_IO_URING
+	uring_free(uring);
+#endif
 	events.clear();
 	ready_events.clear();
 }
 
+const char* Fdevents::backend() const{
+#ifdef HAVE_IO_URING
+	if(uring){
+		return "io_uring";
+	}
+#endif
+	return "epoll";
+}
+
 bool Fdevents::isset(int fd, int flag){
 	struct Fdevent *fde = get_fde(fd);
 	return (bool)(fde->s_flags & flag);
 }
 
 int Fdevents::set(int fd, int flags, int data_num, void *data_ptr){
+#ifdef HAVE_IO_URING
+	if(uring){
+		return uring_set(fd, flags, data_num, data_ptr);
+	}
+#endif
 	struct Fdevent *fde = get_fde(fd);
 	if(fde->s_flags & flags){
 		return 0;
@@ -51,6 +78,11 @@ int Fdevents::set(int fd, int flags, int data_num, void *data_ptr){
 }
 
 int Fdevents::del(int fd){
+#ifdef HAVE_IO_URING
+	if(uring){
+		return uring_del(fd);
+	}
+#endif
 	struct epoll_event epe;
 	int ret = epoll_ctl(ep_fd, EPOLL_CTL_DEL, fd, &epe);
 	if(ret == -1){
@@ -63,6 +95,11 @@ int Fdevents::del(int fd){
 }
 
 int Fdevents::clr(int fd, int flags){
+#ifdef HAVE_IO_URING
+	if(uring){
+		return uring_clr(fd, flags);
+	}
+#endif
 	struct Fdevent *fde = get_fde(fd);
 	if(!(fde->s_flags & flags)){
 		return 0;
@@ -85,6 +122,11 @@ int Fdevents::clr(int fd, int flags){
 }
 
 const Fdevents::events_t* Fdevents::wait(int timeout_ms){
+#ifdef HAVE_IO_URING
+	if(uring){
+		return uring_wait(timeout_ms);
+	}
+#endif
 	struct Fdevent *fde;
 	struct epoll_event *epe;
 	ready_events.clear();
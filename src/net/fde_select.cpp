@@ -6,12 +6,16 @@ found in the LICENSE file.
 #ifndef UTIL_FDE_SELECT_H
 #define UTIL_FDE_SELECT_H
 
-Fdevents::Fdevents(){
+Fdevents::Fdevents(bool use_uring){
 	maxfd = -1;
 	FD_ZERO(&readset);
 	FD_ZERO(&writeset);
 }
 
+const char* Fdevents::backend() const{
+	return "select";
+}
+
 Fdevents::~Fdevents(){
 	for(size_t i=0; i<events.size(); i++){
 		delete events[i];
@@ -0,0 +1,350 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_FDE_URING_H
+#define UTIL_FDE_URING_H
+
+/*
+io_uring is used as a batched poller: subscriptions are turned into
+one-shot poll requests, which are queued in the submission ring and
+submitted by the same io_uring_enter() that waits for completions. So
+a loop iteration costs one syscall however many fds are set, cleared
+or deleted, instead of one epoll_ctl() for each of them. A poll is
+re-armed after it fires, so events are level triggered as with epoll.
+*/
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct Uring{
+	int fd;
+	unsigned entries;
+
+	void *sq_ptr;
+	size_t sq_size;
+	volatile unsigned *sq_head;
+	volatile unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	// tail of the sqes queued but not yet published to the kernel
+	unsigned sq_local_tail;
+
+	void *cq_ptr;
+	size_t cq_size;
+	volatile unsigned *cq_head;
+	volatile unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static const int URING_ENTRIES = 4096;
+// user_data of requests whose completions are ignored
+static const uint64_t URING_NO_DATA = ~(uint64_t)0;
+
+static inline uint64_t uring_data(const struct Fdevent *fde){
+	return ((uint64_t)fde->u_gen << 32) | (uint32_t)fde->fd;
+}
+
+static inline uint32_t uring_poll_mask(int flags){
+	uint32_t mask = 0;
+	if(flags & FDEVENT_IN)  mask |= POLLIN;
+	if(flags & FDEVENT_OUT) mask |= POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	// poll32_events is read as two swapped halves
+	mask = (mask << 16) | (mask >> 16);
+#endif
+	return mask;
+}
+
+struct Uring* Fdevents::uring_create(){
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if(fd == -1){
+		return NULL;
+	}
+	// waiting with a timeout and not losing completions are required
+	if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)){
+		::close(fd);
+		return NULL;
+	}
+
+	struct Uring *u = new Uring();
+	u->fd = fd;
+	u->entries = p.sq_entries;
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		if(u->cq_size > u->sq_size){
+			u->sq_size = u->cq_size;
+		}
+		u->cq_size = u->sq_size;
+	}
+
+	u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		fd, IORING_OFF_SQ_RING);
+	if(u->sq_ptr == MAP_FAILED){
+		::close(fd);
+		delete u;
+		return NULL;
+	}
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		u->cq_ptr = u->sq_ptr;
+	}else{
+		u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			fd, IORING_OFF_CQ_RING);
+		if(u->cq_ptr == MAP_FAILED){
+			munmap(u->sq_ptr, u->sq_size);
+			::close(fd);
+			delete u;
+			return NULL;
+		}
+	}
+	u->sqes = (struct io_uring_sqe *)mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(u->sqes == MAP_FAILED){
+		if(u->cq_ptr != u->sq_ptr){
+			munmap(u->cq_ptr, u->cq_size);
+		}
+		munmap(u->sq_ptr, u->sq_size);
+		::close(fd);
+		delete u;
+		return NULL;
+	}
+
+	char *sq = (char *)u->sq_ptr;
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	u->sq_local_tail = *u->sq_tail;
+
+	char *cq = (char *)u->cq_ptr;
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return u;
+}
+
+void Fdevents::uring_free(struct Uring *u){
+	if(u == NULL){
+		return;
+	}
+	munmap(u->sqes, u->sqes_size);
+	if(u->cq_ptr != u->sq_ptr){
+		munmap(u->cq_ptr, u->cq_size);
+	}
+	munmap(u->sq_ptr, u->sq_size);
+	::close(u->fd);
+	delete u;
+}
+
+struct io_uring_sqe* Fdevents::uring_sqe(){
+	struct Uring *u = uring;
+	if(u->sq_local_tail - *u->sq_head >= u->entries){
+		// the ring is full, hand the queued requests over first
+		if(uring_submit(0) == -1 || u->sq_local_tail - *u->sq_head >= u->entries){
+			return NULL;
+		}
+	}
+	unsigned index = u->sq_local_tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[index] = index;
+	u->sq_local_tail ++;
+	return sqe;
+}
+
+// publish the queued sqes, and wait for at least one completion if
+// wait_ms is not 0(-1: no timeout)
+int Fdevents::uring_submit(int wait_ms){
+	struct Uring *u = uring;
+	unsigned to_submit = u->sq_local_tail - *u->sq_head;
+	__sync_synchronize();
+	*u->sq_tail = u->sq_local_tail;
+	__sync_synchronize();
+
+	unsigned min_complete = 0;
+	unsigned flags = 0;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	void *argp = NULL;
+	size_t argsz = 0;
+	if(wait_ms != 0){
+		min_complete = 1;
+		flags |= IORING_ENTER_GETEVENTS;
+		if(wait_ms > 0){
+			ts.tv_sec = wait_ms / 1000;
+			ts.tv_nsec = (long long)(wait_ms % 1000) * 1000 * 1000;
+			memset(&arg, 0, sizeof(arg));
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			argp = &arg;
+			argsz = sizeof(arg);
+		}
+	}
+	if(to_submit == 0 && min_complete == 0){
+		return 0;
+	}
+	int ret = syscall(__NR_io_uring_enter, u->fd, to_submit, min_complete, flags, argp, argsz);
+	if(ret == -1){
+		// timed out, interrupted, or the completion queue is to be reaped
+		if(errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN){
+			return 0;
+		}
+		return -1;
+	}
+	return ret;
+}
+
+void Fdevents::uring_change(struct Fdevent *fde){
+	if(!fde->u_dirty){
+		fde->u_dirty = true;
+		uring_changes.push_back(fde);
+	}
+}
+
+int Fdevents::uring_set(int fd, int flags, int data_num, void *data_ptr){
+	struct Fdevent *fde = get_fde(fd);
+	if(fde->s_flags & flags){
+		return 0;
+	}
+	fde->s_flags |= flags;
+	fde->data.num = data_num;
+	fde->data.ptr = data_ptr;
+	uring_change(fde);
+	return 0;
+}
+
+int Fdevents::uring_del(int fd){
+	struct Fdevent *fde = get_fde(fd);
+	fde->s_flags = FDEVENT_NONE;
+	// the poll holds a reference to the file, it is cancelled right now,
+	// not at the next wait, or a close() following would not release
+	// the socket(and send the FIN) until then; the gen bump makes the
+	// completion of the cancelled poll ignored, even if the fd is reused
+	if(fde->u_flags){
+		struct io_uring_sqe *sqe = uring_sqe();
+		if(sqe == NULL){
+			return -1;
+		}
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = uring_data(fde);
+		sqe->user_data = URING_NO_DATA;
+		fde->u_gen ++;
+		fde->u_flags = 0;
+		if(uring_submit(0) == -1){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int Fdevents::uring_clr(int fd, int flags){
+	struct Fdevent *fde = get_fde(fd);
+	if(!(fde->s_flags & flags)){
+		return 0;
+	}
+	fde->s_flags &= ~flags;
+	uring_change(fde);
+	return 0;
+}
+
+const Fdevents::events_t* Fdevents::uring_wait(int timeout_ms){
+	struct Uring *u = uring;
+	ready_events.clear();
+
+	for(int i=0; i<(int)uring_changes.size(); i++){
+		struct Fdevent *fde = uring_changes[i];
+		fde->u_dirty = false;
+		int want = fde->s_flags & (FDEVENT_IN | FDEVENT_OUT);
+		if(want == fde->u_flags){
+			continue;
+		}
+		struct io_uring_sqe *sqe;
+		if(fde->u_flags){
+			if((sqe = uring_sqe()) == NULL){
+				return NULL;
+			}
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = uring_data(fde);
+			sqe->user_data = URING_NO_DATA;
+			fde->u_gen ++;
+			fde->u_flags = 0;
+		}
+		if(want){
+			if((sqe = uring_sqe()) == NULL){
+				return NULL;
+			}
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = fde->fd;
+			sqe->poll32_events = uring_poll_mask(want);
+			sqe->user_data = uring_data(fde);
+			fde->u_flags = want;
+		}
+	}
+	uring_changes.clear();
+
+	// don't block if there are completions not reaped yet
+	if(*u->cq_head != *u->cq_tail){
+		timeout_ms = 0;
+	}
+	if(uring_submit(timeout_ms) == -1){
+		return NULL;
+	}
+
+	unsigned head = *u->cq_head;
+	__sync_synchronize();
+	unsigned tail = *u->cq_tail;
+	__sync_synchronize();
+	for(; head != tail; head++){
+		const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+		if(cqe->user_data == URING_NO_DATA){
+			continue;
+		}
+		int fd = (int)(uint32_t)cqe->user_data;
+		uint32_t gen = (uint32_t)(cqe->user_data >> 32);
+		if(fd >= (int)events.size()){
+			continue;
+		}
+		struct Fdevent *fde = events[fd];
+		// completion of a cancelled poll
+		if(fde->u_gen != gen || !fde->u_flags){
+			continue;
+		}
+		fde->u_flags = 0;
+		if(fde->s_flags){
+			// re-arm with the next wait
+			uring_change(fde);
+		}
+
+		int res = cqe->res;
+		fde->events = FDEVENT_NONE;
+		if(res < 0){
+			// let the owner find out the error by reading
+			fde->events |= FDEVENT_IN | FDEVENT_ERR;
+		}else{
+			if(res & POLLIN)  fde->events |= FDEVENT_IN;
+			if(res & POLLPRI) fde->events |= FDEVENT_IN;
+			if(res & POLLOUT) fde->events |= FDEVENT_OUT;
+			if(res & POLLHUP) fde->events |= FDEVENT_ERR;
+			if(res & POLLERR) fde->events |= FDEVENT_ERR;
+		}
+		ready_events.push_back(fde);
+	}
+	__sync_synchronize();
+	*u->cq_head = head;
+	return &ready_events;
+}
+
+#endif
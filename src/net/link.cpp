@@ -8,20 +8,41 @@ found in the LICENSE file.
 #include <string.h>
 #include <stdarg.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <netdb.h>
+#include <algorithm>
 
 #include "link.h"
 
 #include "link_redis.cpp"
 
 #define INIT_BUFFER_SIZE	8
+// packets larger than this are written with writev when possible
+#define WRITEV_PACKET_SIZE	(32 * 1024)
+// fields larger than this are not copied when writing with writev
+#define WRITEV_FIELD_SIZE	(4 * 1024)
+#ifndef IOV_MAX
+	#define IOV_MAX	1024
+#endif
 
 int Link::min_recv_buf = 8 * 1024;
 int Link::min_send_buf = 8 * 1024;
 
 
+std::string OutputLimit::stats() const{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "soft: %" PRId64 "\thard: %" PRId64 "\tpaused: %" PRIu64 "\tclosed: %" PRIu64,
+		soft, hard, (uint64_t)paused, (uint64_t)closed);
+	return buf;
+}
+
 Link::Link(bool is_server){
 	redis = NULL;
+	recv_again = false;
+	recv_parsed = 0;
+	recv_head_len = -1;
+	recv_body_len = -1;
 
 	sock = -1;
 	noblock_ = false;
@@ -30,6 +51,11 @@ Link::Link(bool is_server){
 	remote_port = -1;
 	auth = false;
 	ignore_key_range = false;
+	output_limit = NULL;
+	paused = false;
+	block_timeout = 0;
+	block_epoch = 0;
+	blocked = NULL;
 	
 	if(is_server){
 		input = output = NULL;
@@ -144,7 +170,7 @@ sock_err:
 	return NULL;
 }
 
-Link* Link::listen(const char *ip, int port){
+Link* Link::listen(const char *ip, int port, bool reuseport){
 	Link *link;
 	int sock = -1;
 
@@ -161,6 +187,11 @@ Link* Link::listen(const char *ip, int port){
 	if(::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1){
 		goto sock_err;
 	}
+#ifdef SO_REUSEPORT
+	if(reuseport && ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1){
+		goto sock_err;
+	}
+#endif
 	if(::bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1){
 		goto sock_err;
 	}
@@ -292,93 +323,123 @@ int Link::flush(){
 }
 
 const std::vector<Bytes>* Link::recv(){
+	if(this->recv_again){
+		this->recv_again = false;
+		return &this->recv_data;
+	}
 	this->recv_data.clear();
 
 	if(input->empty()){
 		return &this->recv_data;
 	}
 
-	// TODO: 记住上回的解析状态
-	int parsed = 0;
-	int size = input->size();
-	char *head = input->data();
+	int parsed = this->recv_parsed;
+	int size = input->size() - parsed;
+	char *head = input->data() + parsed;
 
-	// ignore leading empty lines
-	while(size > 0 && (head[0] == '\n' || head[0] == '\r')){
-		head ++;
-		size --;
-		parsed ++;
-	}
-	
-	// Redis protocol supports
-	if(head[0] == '*'){
-		if(redis == NULL){
-			redis = new RedisLink();
+	if(parsed == 0){
+		// ignore leading empty lines
+		while(size > 0 && (head[0] == '\n' || head[0] == '\r')){
+			head ++;
+			size --;
+			parsed ++;
 		}
-		const std::vector<Bytes> *ret = redis->recv_req(input);
-		if(ret){
-			this->recv_data = *ret;
-			return &this->recv_data;
-		}else{
-			return NULL;
+		
+		// Redis protocol supports
+		if(size > 0 && head[0] == '*'){
+			if(redis == NULL){
+				redis = new RedisLink();
+			}
+			const std::vector<Bytes> *ret = redis->recv_req(input);
+			if(ret){
+				this->recv_data = *ret;
+				return &this->recv_data;
+			}else{
+				return NULL;
+			}
 		}
 	}
 
 	while(size > 0){
-		char *body = (char *)memchr(head, '\n', size);
-		if(body == NULL){
-			break;
-		}
-		body ++;
-
-		int head_len = body - head;
-		if(head_len == 1 || (head_len == 2 && head[0] == '\r')){
-			// packet end
-			parsed += head_len;
-			input->decr(parsed);
-			return &this->recv_data;;
-		}
-		if(head[0] < '0' || head[0] > '9'){
-			//log_warn("bad format");
-			return NULL;
-		}
+		int head_len, body_len;
+		char *body;
+		if(this->recv_body_len >= 0){
+			// the bulk header has been parsed last time
+			head_len = this->recv_head_len;
+			body_len = this->recv_body_len;
+			body = head + head_len;
+		}else{
+			body = (char *)memchr(head, '\n', size);
+			if(body == NULL){
+				break;
+			}
+			body ++;
+
+			head_len = body - head;
+			if(head_len == 1 || (head_len == 2 && head[0] == '\r')){
+				// packet end
+				parsed += head_len;
+				for(int i=0; i<(int)recv_fields.size(); i++){
+					const char *p = input->data() + recv_fields[i].first;
+					this->recv_data.push_back(Bytes(p, recv_fields[i].second));
+				}
+				input->decr(parsed);
+				this->recv_parsed = 0;
+				this->recv_fields.clear();
+				return &this->recv_data;;
+			}
+			if(head[0] < '0' || head[0] > '9'){
+				//log_warn("bad format");
+				return NULL;
+			}
 
-		char head_str[20];
-		if(head_len > (int)sizeof(head_str) - 1){
-			return NULL;
-		}
-		memcpy(head_str, head, head_len - 1); // no '\n'
-		head_str[head_len - 1] = '\0';
+			char head_str[20];
+			if(head_len > (int)sizeof(head_str) - 1){
+				return NULL;
+			}
+			memcpy(head_str, head, head_len - 1); // no '\n'
+			head_str[head_len - 1] = '\0';
 
-		int body_len = atoi(head_str);
-		if(body_len < 0){
-			//log_warn("bad format");
-			return NULL;
+			body_len = atoi(head_str);
+			if(body_len < 0){
+				//log_warn("bad format");
+				return NULL;
+			}
+			if(parsed + head_len + body_len > MAX_PACKET_SIZE){
+				 //log_warn("fd: %d, exceed max packet size, parsed: %d", this->sock, parsed);
+				 return NULL;
+			}
 		}
 		//log_debug("size: %d, head_len: %d, body_len: %d", size, head_len, body_len);
-		size -= head_len + body_len;
-		if(size < 0){
+		// wait for the body and the trailing new line
+		if(size < head_len + body_len + 1){
+			this->recv_head_len = head_len;
+			this->recv_body_len = body_len;
 			break;
 		}
-
-		this->recv_data.push_back(Bytes(body, body_len));
-
-		head += head_len + body_len;
-		parsed += head_len + body_len;
-		if(size >= 1 && head[0] == '\n'){
-			head += 1;
-			size -= 1;
-			parsed += 1;
-		}else if(size >= 2 && head[0] == '\r' && head[1] == '\n'){
-			head += 2;
-			size -= 2;
-			parsed += 2;
-		}else if(size >= 2){
+		char *p = body + body_len;
+		int end_len;
+		if(p[0] == '\n'){
+			end_len = 1;
+		}else if(size >= head_len + body_len + 2 && p[0] == '\r' && p[1] == '\n'){
+			end_len = 2;
+		}else if(size >= head_len + body_len + 2){
 			// bad format
 			return NULL;
 		}else{
+			this->recv_head_len = head_len;
+			this->recv_body_len = body_len;
 			break;
 		}
+		this->recv_head_len = -1;
+		this->recv_body_len = -1;
+
+		this->recv_fields.push_back(std::make_pair(parsed + head_len, body_len));
+
+		head += head_len + body_len + end_len;
+		size -= head_len + body_len + end_len;
+		parsed += head_len + body_len + end_len;
+		this->recv_parsed = parsed;
 		if(parsed > MAX_PACKET_SIZE){
 			 //log_warn("fd: %d, exceed max packet size, parsed: %d", this->sock, parsed);
 			 return NULL;
@@ -397,10 +458,23 @@ const std::vector<Bytes>* Link::recv(){
 	}
 
 	// not ready
-	this->recv_data.clear();
 	return &this->recv_data;
 }
 
+int Link::send(const Response &resp){
+	// reply encoded in the Redis protocol by the handler
+	if(this->redis && resp.redis_native()){
+		if(resp.redis_array >= 0){
+			char buf[32];
+			snprintf(buf, sizeof(buf), "*%d\r\n", resp.redis_array);
+			output->append(buf);
+		}
+		output->append(resp.redis_out.data(), resp.redis_out.size());
+		return 0;
+	}
+	return this->send(resp.resp);
+}
+
 int Link::send(const std::vector<std::string> &resp){
 	if(resp.empty()){
 		return 0;
@@ -409,6 +483,18 @@ int Link::send(const std::vector<std::string> &resp){
 	if(this->redis){
 		return this->redis->send_resp(this->output, resp);
 	}
+
+	// nothing is waiting to be written, so a large packet could go to
+	// the network directly from resp, without being copied into output
+	if(noblock_ && output->empty()){
+		int size = 1;
+		for(int i=0; i<resp.size(); i++){
+			size += resp[i].size() + 12;
+		}
+		if(size >= WRITEV_PACKET_SIZE){
+			return this->writev_packet(resp);
+		}
+	}
 	
 	for(int i=0; i<resp.size(); i++){
 		output->append_record(resp[i]);
@@ -417,6 +503,94 @@ int Link::send(const std::vector<std::string> &resp){
 	return 0;
 }
 
+int Link::writev_packet(const std::vector<std::string> &packet){
+	// small fields and all the headers are copied into buf, so that
+	// they do not cost an iovec each
+	std::string buf;
+	{
+		int size = 1;
+		for(int i=0; i<packet.size(); i++){
+			size += 12;
+			if(packet[i].size() < WRITEV_FIELD_SIZE){
+				size += packet[i].size();
+			}
+		}
+		buf.reserve(size);
+	}
+	// iovecs pointing into buf are stored as offsets, and fixed up
+	// after buf is completed
+	std::vector<struct iovec> iov;
+	std::vector<bool> in_buf;
+	int seg_start = 0;
+	for(int i=0; i<packet.size(); i++){
+		const std::string &field = packet[i];
+		char len[16];
+		int num = snprintf(len, sizeof(len), "%d\n", (int)field.size());
+		buf.append(len, num);
+		if(field.size() < WRITEV_FIELD_SIZE){
+			buf.append(field);
+			buf.push_back('\n');
+			continue;
+		}
+		struct iovec v;
+		v.iov_base = (void *)(intptr_t)seg_start;
+		v.iov_len = buf.size() - seg_start;
+		iov.push_back(v);
+		in_buf.push_back(true);
+		v.iov_base = (void *)field.data();
+		v.iov_len = field.size();
+		iov.push_back(v);
+		in_buf.push_back(false);
+		seg_start = buf.size();
+		buf.push_back('\n');
+	}
+	buf.push_back('\n');
+	{
+		struct iovec v;
+		v.iov_base = (void *)(intptr_t)seg_start;
+		v.iov_len = buf.size() - seg_start;
+		iov.push_back(v);
+		in_buf.push_back(true);
+	}
+	for(int i=0; i<(int)iov.size(); i++){
+		if(in_buf[i]){
+			iov[i].iov_base = (char *)buf.data() + (intptr_t)iov[i].iov_base;
+		}
+	}
+
+	int idx = 0;
+	while(idx < (int)iov.size()){
+		int cnt = std::min((int)iov.size() - idx, (int)IOV_MAX);
+		ssize_t len = ::writev(sock, &iov[idx], cnt);
+		if(len == -1){
+			if(errno == EINTR){
+				continue;
+			}else if(errno == EWOULDBLOCK){
+				break;
+			}else{
+				return -1;
+			}
+		}
+		while(len > 0){
+			if(len >= (ssize_t)iov[idx].iov_len){
+				len -= iov[idx].iov_len;
+				idx ++;
+			}else{
+				iov[idx].iov_base = (char *)iov[idx].iov_base + len;
+				iov[idx].iov_len -= len;
+				len = 0;
+			}
+		}
+	}
+	// the rest is buffered, to be written when the socket is writable
+	for(; idx < (int)iov.size(); idx++){
+		if(output->append(iov[idx].iov_base, iov[idx].iov_len) == -1){
+			return -1;
+		}
+	}
+	return 0;
+}
+
 int Link::send(const std::vector<Bytes> &resp){
 	for(int i=0; i<resp.size(); i++){
 		output->append_record(resp[i]);
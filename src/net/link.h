@@ -7,6 +7,7 @@ found in the LICENSE file.
 #define NET_LINK_H_
 
 #include <vector>
+#include <utility>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -15,6 +16,29 @@ found in the LICENSE file.
 #include "../util/bytes.h"
 
 #include "link_redis.h"
+#include "resp.h"
+#include "timer.h"
+
+struct ProcJob;
+
+// output buffer limits of a class of links
+struct OutputLimit{
+	const char *name;
+	// in bytes, 0 means no limit
+	int64_t soft;
+	int64_t hard;
+	// times reading from a link was paused for being over the soft limit
+	volatile uint64_t paused;
+	// links closed for being over the hard limit
+	volatile uint64_t closed;
+
+	OutputLimit(){
+		name = "";
+		soft = hard = 0;
+		paused = closed = 0;
+	}
+	std::string stats() const;
+};
 
 class Link{
 	private:
@@ -22,11 +46,27 @@ class Link{
 		bool noblock_;
 		bool error_;
 		std::vector<Bytes> recv_data;
+		// recv_data has been put back by unrecv()
+		bool recv_again;
+
+		// parsing state of the packet being received, so that parsing
+		// resumes where it stopped last time. Offsets are relative to
+		// input->data(), which keeps pointing at the packet head until
+		// the packet is completed, though the buffer may be moved.
+		int recv_parsed;
+		// offset and length of the fields parsed
+		std::vector<std::pair<int, int> > recv_fields;
+		// length of the bulk header and body being waited for, -1 if none
+		int recv_head_len;
+		int recv_body_len;
 
 		RedisLink *redis;
 
 		static int min_recv_buf;
 		static int min_send_buf;
+
+		// write a large packet with writev, large fields are not copied
+		int writev_packet(const std::vector<std::string> &packet);
 	public:
 		const static int MAX_PACKET_SIZE = 128 * 1024 * 1024;
 
@@ -41,6 +81,20 @@ class Link{
 		
 		double create_time;
 		double active_time;
+		// idle timeout, armed by the event loop while waiting for requests
+		Timer timer;
+		// NULL if the output buffer is not limited
+		OutputLimit *output_limit;
+		// reading is paused until the output drains below the soft limit
+		bool paused;
+		// set by a proc returning PROC_BLOCK, the key waited for, the
+		// timeout in ms(0 means forever), and NetworkServer::wake_epoch()
+		// of the key, read before the key was found not ready
+		std::string block_key;
+		int64_t block_timeout;
+		uint64_t block_epoch;
+		// the job waiting for block_key, NULL if not blocked
+		ProcJob *blocked;
 
 		Link(bool is_server=false);
 		~Link();
@@ -57,12 +111,38 @@ class Link{
 		bool error() const{
 			return error_;
 		}
+		// whether the client speaks the Redis protocol
+		bool is_redis() const{
+			return redis != NULL;
+		}
+		// whether the last request is a Redis command, as opposed to an
+		// SSDB command sent in RESP, whose reply is that of SSDB
+		bool redis_converted() const{
+			return redis && redis->converted();
+		}
+		// the command which the last Redis request is converted to, as
+		// remembered by set_command(), NULL if not known yet
+		Command* command() const{
+			return redis? redis->command() : NULL;
+		}
+		void set_command(Command *cmd){
+			if(redis){
+				redis->set_command(cmd);
+			}
+		}
 		void mark_error(){
 			error_ = true;
 		}
+		bool output_over_soft() const{
+			return output_limit && output_limit->soft > 0 && output->size() > output_limit->soft;
+		}
+		bool output_over_hard() const{
+			return output_limit && output_limit->hard > 0 && output->size() > output_limit->hard;
+		}
 
 		static Link* connect(const char *ip, int port);
-		static Link* listen(const char *ip, int port);
+		// reuseport: set SO_REUSEPORT, so that several sockets can listen on the same port
+		static Link* listen(const char *ip, int port, bool reuseport=false);
 		Link* accept();
 
 		// read network data info buffer
@@ -79,10 +159,19 @@ class Link{
 		 * vector<Bytes>: recv ready
 		 */
 		const std::vector<Bytes>* recv();
+		// put the request just received back, the next recv() returns it again
+		void unrecv(){
+			recv_again = true;
+		}
+		// there is data to be parsed or a request put back
+		bool recv_pending() const{
+			return recv_again || !input->empty();
+		}
 		// wait until a response received.
 		const std::vector<Bytes>* response();
 
 		// need to call flush to ensure all data has flush into network
+		int send(const Response &resp);
 		int send(const std::vector<std::string> &packet);
 		int send(const std::vector<Bytes> &packet);
 		int send(const Bytes &s1);
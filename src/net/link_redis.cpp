@@ -4,7 +4,7 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include "link_redis.h"
-#include <map>
+#include "../util/phash.h"
 
 enum REPLY{
 	REPLY_BULK = 0,
@@ -38,9 +38,6 @@ enum STRATEGY{
 	STRATEGY_NULL
 };
 
-static bool inited = false;
-static std::map<std::string, RedisRequestDesc> cmd_table;
-
 struct RedisCommand_raw
 {
 	int strategy;
@@ -133,34 +130,50 @@ static RedisCommand_raw cmds_raw[] = {
 	{STRATEGY_AUTO, 	NULL,			NULL,			0}
 };
 
-int RedisLink::convert_req(){
-	if(!inited){
-		inited = true;
-		
+// built before main(), when there are no other threads
+class RedisCommandTable
+{
+private:
+	PerfectHash<RedisRequestDesc *> table;
+	std::vector<RedisRequestDesc *> descs;
+public:
+	RedisCommandTable(){
 		RedisCommand_raw *def = &cmds_raw[0];
 		while(def->redis_cmd != NULL){
-			RedisRequestDesc desc;
-			desc.strategy = def->strategy;
-			desc.redis_cmd = def->redis_cmd;
-			desc.ssdb_cmd = def->ssdb_cmd;
-			desc.reply_type = def->reply_type;
-			cmd_table[desc.redis_cmd] = desc;
+			RedisRequestDesc *desc = new RedisRequestDesc();
+			desc->strategy = def->strategy;
+			desc->redis_cmd = def->redis_cmd;
+			desc->ssdb_cmd = def->ssdb_cmd;
+			desc->reply_type = def->reply_type;
+			desc->cmd = NULL;
+			table.set(desc->redis_cmd, desc);
+			descs.push_back(desc);
 			def += 1;
 		}
 	}
-	
-	this->req_desc = NULL;
-	
-	std::map<std::string, RedisRequestDesc>::iterator it;
-	it = cmd_table.find(cmd);
-	if(it == cmd_table.end()){
+	~RedisCommandTable(){
+		for(int i=0; i<(int)descs.size(); i++){
+			delete descs[i];
+		}
+	}
+	RedisRequestDesc* get(const Bytes &cmd) const{
+		return table.get(cmd.data(), cmd.size());
+	}
+};
+
+static RedisCommandTable cmd_table;
+
+int RedisLink::convert_req(){
+	this->req_desc = cmd_table.get(recv_bytes[0]);
+	if(this->req_desc == NULL){
+		std::string cmd = recv_bytes[0].String();
+		strtolower(&cmd);
 		recv_string.push_back(cmd);
 		for(int i=1; i<recv_bytes.size(); i++){
 			recv_string.push_back(recv_bytes[i].String());
 		}
 		return 0;
 	}
-	this->req_desc = &(it->second);
 
 	if(this->req_desc->strategy == STRATEGY_HKEYS
 			||  this->req_desc->strategy == STRATEGY_HVALS
@@ -352,9 +365,6 @@ const std::vector<Bytes>* RedisLink::recv_req(Buffer *input){
 		return &recv_bytes;
 	}
 
-	cmd = recv_bytes[0].String();
-	strtolower(&cmd);
-	
 	recv_string.clear();
 	
 	this->convert_req();
@@ -526,53 +536,65 @@ int RedisLink::send_resp(Buffer *output, const std::vector<std::string> &resp){
 int RedisLink::parse_req(Buffer *input){
 	recv_bytes.clear();
 
-	int parsed = 0;
-	int size = input->size();
-	char *ptr = input->data();
+	int parsed = this->parsed;
+	int size = input->size() - parsed;
+	char *ptr = input->data() + parsed;
 	
-	// ignore leading empty lines
-	while(size > 0 && (ptr[0] == '\n' || ptr[0] == '\r')){
-		ptr ++;
-		size --;
-		parsed ++;
-	}
-	//dump(ptr, size);
-	
-	if(ptr[0] != '*'){
-		return -1;
-	}
-
-	int num_args = 0;	
-	while(size > 0){
-		char *lf = (char *)memchr(ptr, '\n', size);
-		if(lf == NULL){
-			break;
-		}
-		lf += 1;
-		size -= (lf - ptr);
-		parsed += (lf - ptr);
+	if(parsed == 0){
+		// ignore leading empty lines
+		while(size > 0 && (ptr[0] == '\n' || ptr[0] == '\r')){
+			ptr ++;
+			size --;
+			parsed ++;
+		}
+		//dump(ptr, size);
 		
-		int len = (int)strtol(ptr + 1, NULL, 10); // ptr + 1: skip '$' or '*'
-		if(errno == EINVAL){
+		if(size > 0 && ptr[0] != '*'){
 			return -1;
 		}
-		ptr = lf;
-		if(len < 0){
-			return -1;
-		}
-		if(num_args == 0){
-			if(len <= 0){
+	}
+
+	while(size > 0){
+		int len;
+		if(this->bulk_len >= 0){
+			len = this->bulk_len;
+		}else{
+			char *lf = (char *)memchr(ptr, '\n', size);
+			if(lf == NULL){
+				break;
+			}
+			lf += 1;
+			
+			len = (int)strtol(ptr + 1, NULL, 10); // ptr + 1: skip '$' or '*'
+			if(errno == EINVAL){
 				return -1;
 			}
-			num_args = len;
-			continue;
+			if(len < 0){
+				return -1;
+			}
+			size -= (lf - ptr);
+			parsed += (lf - ptr);
+			ptr = lf;
+			this->parsed = parsed;
+			if(this->num_args == 0){
+				if(len <= 0){
+					return -1;
+				}
+				this->num_args = len;
+				continue;
+			}
+			this->bulk_len = len;
 		}
 		
 		if(len > size - 1){
 			break;
 		}
+		// wait for the LF of CRLF
+		if(ptr[len] == '\r' && len > size - 2){
+			break;
+		}
 		
-		recv_bytes.push_back(Bytes(ptr, len));
+		this->fields.push_back(std::make_pair(parsed, len));
 		
 		ptr += len + 1;
 		size -= len + 1;
@@ -583,14 +605,20 @@ int RedisLink::parse_req(Buffer *input){
 			size -= 1;
 			parsed += 1;
 		}
+		this->parsed = parsed;
+		this->bulk_len = -1;
 
-		num_args --;
-		if(num_args == 0){
+		this->num_args --;
+		if(this->num_args == 0){
+			for(int i=0; i<(int)fields.size(); i++){
+				recv_bytes.push_back(Bytes(input->data() + fields[i].first, fields[i].second));
+			}
 			input->decr(parsed);
+			this->parsed = 0;
+			this->fields.clear();
 			return 1;
 		}
 	}
 	
-	recv_bytes.clear();
 	return 0;
 }
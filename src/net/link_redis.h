@@ -8,34 +8,65 @@ found in the LICENSE file.
 
 #include <vector>
 #include <string>
+#include <utility>
 #include "../util/bytes.h"
 
+struct Command;
+
 struct RedisRequestDesc
 {
 	int strategy;
 	std::string redis_cmd;
 	std::string ssdb_cmd;
 	int reply_type;
+	// ssdb_cmd resolved by the server, shared by all links, every
+	// thread stores the same value
+	Command *cmd;
 };
 
 class RedisLink
 {
 private:
-	std::string cmd;
 	RedisRequestDesc *req_desc;
 
 	std::vector<Bytes> recv_bytes;
 	std::vector<std::string> recv_string;
+
+	// parsing state of the request being received, offsets are
+	// relative to input->data()
+	int parsed;
+	int num_args;
+	// length of the bulk being waited for(its header has been parsed), -1 if none
+	int bulk_len;
+	std::vector<std::pair<int, int> > fields;
+
 	int parse_req(Buffer *input);
 	int convert_req();
 	
 public:
 	RedisLink(){
 		req_desc = NULL;
+		parsed = 0;
+		num_args = 0;
+		bulk_len = -1;
 	}
 	
 	const std::vector<Bytes>* recv_req(Buffer *input);
 	int send_resp(Buffer *output, const std::vector<std::string> &resp);
+
+	Command* command() const{
+		return req_desc? req_desc->cmd : NULL;
+	}
+	// whether the last request is a Redis command converted to an SSDB
+	// one, not an SSDB command sent in RESP
+	bool converted() const{
+		return req_desc != NULL;
+	}
+	void set_command(Command *cmd){
+		if(req_desc){
+			req_desc->cmd = cmd;
+		}
+	}
 };
 
 #endif
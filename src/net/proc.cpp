@@ -25,9 +25,14 @@ void ProcMap::set_proc(const std::string &c, proc_t proc){
 void ProcMap::set_proc(const std::string &c, const char *sflags, proc_t proc){
 	Command *cmd = this->get_proc(c);
 	if(!cmd){
+		if(c.size() > PerfectHash<Command *>::MAX_KEY_LEN){
+			log_error("command name too long: %s", c.c_str());
+			return;
+		}
 		cmd = new Command();
 		cmd->name = c;
 		proc_map[cmd->name] = cmd;
+		table.set(cmd->name, cmd);
 	}
 	cmd->proc = proc;
 	cmd->flags = 0;
@@ -36,7 +41,7 @@ void ProcMap::set_proc(const std::string &c, const char *sflags, proc_t proc){
 			case 'r':
 				cmd->flags |= Command::FLAG_READ;
 				break;
-			case 'w': // w 必须和 t 同时出现, 因为某些写操作依赖单线程
+			case 'w': // w 必须和 t 同时出现, 写操作由 writer 线程处理
 				cmd->flags |= Command::FLAG_WRITE;
 				cmd->flags |= Command::FLAG_THREAD;
 				break;
@@ -46,14 +51,13 @@ void ProcMap::set_proc(const std::string &c, const char *sflags, proc_t proc){
 			case 't':
 				cmd->flags |= Command::FLAG_THREAD;
 				break;
+			case 's':
+				cmd->flags |= Command::FLAG_SLOW;
+				break;
 		}
 	}
 }
 
 Command* ProcMap::get_proc(const Bytes &str){
-	proc_map_t::iterator it = proc_map.find(str);
-	if(it != proc_map.end()){
-		return it->second;
-	}
-	return NULL;
+	return table.get(str.data(), str.size());
 }
@@ -9,6 +9,9 @@ found in the LICENSE file.
 #include <vector>
 #include "resp.h"
 #include "../util/bytes.h"
+#include "../util/histogram.h"
+#include "../util/phash.h"
+#include "timer.h"
 
 class Link;
 class NetworkServer;
@@ -16,6 +19,10 @@ class NetworkServer;
 #define PROC_OK			0
 #define PROC_ERROR		-1
 #define PROC_THREAD     1
+// the request waits for Link::block_key to be woken up by
+// NetworkServer::wake(), and is then processed again, if it times out
+// first it is answered not_found. Only for commands with FLAG_THREAD.
+#define PROC_BLOCK		2
 #define PROC_BACKEND	100
 
 #define DEF_PROC(f) int proc_##f(NetworkServer *net, Link *link, const Request &req, Response *resp)
@@ -28,20 +35,22 @@ struct Command{
 	static const int FLAG_WRITE		= (1 << 1);
 	static const int FLAG_BACKEND	= (1 << 2);
 	static const int FLAG_THREAD	= (1 << 3);
+	// expensive reads(scans, ranges...), processed by the slow pool
+	static const int FLAG_SLOW		= (1 << 4);
 
 	std::string name;
 	int flags;
 	proc_t proc;
 	uint64_t calls;
-	double time_wait;
-	double time_proc;
+	// in us
+	Histogram time_wait;
+	Histogram time_proc;
+	Histogram time_total;
 	
 	Command(){
 		flags = 0;
 		proc = NULL;
 		calls = 0;
-		time_wait = 0;
-		time_proc = 0;
 	}
 };
 
@@ -56,6 +65,14 @@ struct ProcJob{
 	
 	const Request *req;
 	Response resp;
+
+	// set by the event loop when the request waited in the worker
+	// queue longer than request_timeout, it is then not processed
+	volatile bool timeout;
+	Timer timer;
+	// absolute time in ms when the blocked request times out,
+	// -1 means never, 0 if the request has not been blocked
+	int64_t block_expire;
 	
 	ProcJob(){
 		result = 0;
@@ -65,6 +82,8 @@ struct ProcJob{
 		stime = 0;
 		time_wait = 0;
 		time_proc = 0;
+		timeout = false;
+		block_expire = 0;
 	}
 	~ProcJob(){
 	}
@@ -102,10 +121,13 @@ struct BytesHash{
 #endif
 
 
+// Commands are looked up case insensitively, proc_map owns them and is
+// used for listing.
 class ProcMap
 {
 private:
 	proc_map_t proc_map;
+	PerfectHash<Command *> table;
 
 public:
 	ProcMap();
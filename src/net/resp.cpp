@@ -6,6 +6,11 @@ found in the LICENSE file.
 #include "resp.h"
 #include <stdio.h>
 
+Response::Response(){
+	redis = false;
+	redis_array = -1;
+}
+
 int Response::size() const{
 	return (int)resp.size();
 }
@@ -14,6 +19,11 @@ void Response::push_back(const std::string &s){
 	resp.push_back(s);
 }
 
+void Response::push_back_swap(std::string *s){
+	resp.push_back(std::string());
+	resp.back().swap(*s);
+}
+
 void Response::add(int s){
 	add((int64_t)s);
 }
@@ -75,7 +85,7 @@ void Response::reply_int(int status, int64_t val){
 	}
 }
 
-void Response::reply_get(int status, const std::string *val, const char *errmsg){
+void Response::reply_get(int status, std::string *val, const char *errmsg){
 	if(status == -1){
 		resp.push_back("error");
 	}else if(status == 0){
@@ -83,7 +93,7 @@ void Response::reply_get(int status, const std::string *val, const char *errmsg)
 	}else{
 		resp.push_back("ok");
 		if(val){
-			resp.push_back(*val);
+			this->push_back_swap(val);
 		}
 		return;
 	}
@@ -103,3 +113,28 @@ void Response::reply_list(int status, const std::vector<std::string> &list){
 	}
 }
 
+void Response::redis_begin_array(){
+	redis_array = 0;
+}
+
+void Response::redis_bulk(const std::string &s){
+	this->redis_bulk(s.data(), (int)s.size());
+}
+
+void Response::redis_bulk(const char *p, int size){
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "$%d\r\n", size);
+	redis_out.append(buf, len);
+	redis_out.append(p, size);
+	redis_out.append("\r\n", 2);
+	if(redis_array >= 0){
+		redis_array ++;
+	}
+}
+
+void Response::redis_nil(){
+	redis_out.append("$-1\r\n", 5);
+	if(redis_array >= 0){
+		redis_array ++;
+	}
+}
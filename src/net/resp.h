@@ -16,8 +16,20 @@ class Response
 public:
 	std::vector<std::string> resp;
 
+	// Set if the request is a Redis command converted by RedisLink. A
+	// handler may then encode its reply with the redis_* methods, which is
+	// sent as is, instead of filling resp to be translated by RedisLink.
+	bool redis;
+	// number of elements if the reply is an array, otherwise -1
+	int redis_array;
+	std::string redis_out;
+
+	Response();
+
 	int size() const;
 	void push_back(const std::string &s);
+	// s is swapped into the response and left empty, saves a copy of large values
+	void push_back_swap(std::string *s);
 	void add(int s);
 	void add(int64_t s);
 	void add(uint64_t s);
@@ -27,9 +39,18 @@ public:
 	void reply_status(int status, const char *errmsg=NULL);
 	void reply_bool(int status, const char *errmsg=NULL);
 	void reply_int(int status, int64_t val);
-	// the same as Redis.REPLY_BULK
-	void reply_get(int status, const std::string *val=NULL, const char *errmsg=NULL);
+	// the same as Redis.REPLY_BULK, val is swapped into the response
+	void reply_get(int status, std::string *val=NULL, const char *errmsg=NULL);
 	void reply_list(int status, const std::vector<std::string> &list);
+
+	bool redis_native() const{
+		return redis_array >= 0 || !redis_out.empty();
+	}
+	// the following bulks and nils are elements of an array
+	void redis_begin_array();
+	void redis_bulk(const std::string &s);
+	void redis_bulk(const char *p, int size);
+	void redis_nil();
 };
 
 #endif
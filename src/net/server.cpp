@@ -15,6 +15,8 @@ found in the LICENSE file.
 static DEF_PROC(ping);
 static DEF_PROC(info);
 static DEF_PROC(auth);
+static DEF_PROC(latency);
+static DEF_PROC(slowlog);
 static DEF_PROC(list_allow_ip);
 static DEF_PROC(add_allow_ip);
 static DEF_PROC(del_allow_ip);
@@ -22,13 +24,24 @@ static DEF_PROC(list_deny_ip);
 static DEF_PROC(add_deny_ip);
 static DEF_PROC(del_deny_ip);
 
-#define TICK_INTERVAL          100 // ms
-#define STATUS_REPORT_TICKS    (300 * 1000/TICK_INTERVAL) // second
+#define STATUS_REPORT_INTERVAL (300 * 1000) // ms
+#define DEFAULT_OUTPUT_SOFT_LIMIT (32 * 1024 * 1024)
+// the event loop wakes up at least this often to check quit
+#define MAX_WAIT_INTERVAL      50 // ms
 static const int READER_THREADS = 10;
-static const int WRITER_THREADS = 1;  // 必须为1, 因为某些写操作依赖单线程
+// one by default, with server.writer_threads > 1 writes on different
+// keys run in parallel, and are committed in groups
+static const int WRITER_THREADS = 1;
+static const int SLOW_THREADS = 2;
 
 volatile bool quit = false;
-volatile uint32_t g_ticks = 0;
+
+enum{
+	TIMER_STATUS_REPORT = 1,
+	TIMER_LINK_IDLE,
+	TIMER_JOB_DEADLINE,
+	TIMER_BLOCK_TIMEOUT
+};
 
 void signal_handler(int sig){
 	switch(sig){
@@ -37,31 +50,38 @@ void signal_handler(int sig){
 			quit = true;
 			break;
 		}
-		case SIGALRM:{
-			g_ticks ++;
-			break;
-		}
 	}
 }
 
 NetworkServer::NetworkServer(){
 	num_readers = READER_THREADS;
 	num_writers = WRITER_THREADS;
+	num_slows = SLOW_THREADS;
+	num_loops = 1;
+	reuseport = false;
+	io_uring = false;
+	next_loop = 0;
 	
-	tick_interval = TICK_INTERVAL;
-	status_report_ticks = STATUS_REPORT_TICKS;
+	idle_timeout = 0;
+	request_timeout = 0;
 
 	//conf = NULL;
-	serv_link = NULL;
 	link_count = 0;
 
-	fdes = new Fdevents();
+	writer = NULL;
+	reader = NULL;
+	slow = NULL;
 	ip_filter = new IpFilter();
+	slowlog = NULL;
+	num_blocked = 0;
+	memset(wake_epochs, 0, sizeof(wake_epochs));
 
 	// add built-in procs, can be overridden
 	proc_map.set_proc("ping", "r", proc_ping);
 	proc_map.set_proc("info", "r", proc_info);
 	proc_map.set_proc("auth", "r", proc_auth);
+	proc_map.set_proc("latency", "r", proc_latency);
+	proc_map.set_proc("slowlog", "r", proc_slowlog);
 	proc_map.set_proc("list_allow_ip", "r", proc_list_allow_ip);
 	proc_map.set_proc("add_allow_ip",  "r", proc_add_allow_ip);
 	proc_map.set_proc("del_allow_ip",  "r", proc_del_allow_ip);
@@ -72,29 +92,37 @@ NetworkServer::NetworkServer(){
 	signal(SIGPIPE, SIG_IGN);
 	signal(SIGINT, signal_handler);
 	signal(SIGTERM, signal_handler);
-#ifndef __CYGWIN__
-	signal(SIGALRM, signal_handler);
-	{
-		struct itimerval tv;
-		tv.it_interval.tv_sec = (TICK_INTERVAL / 1000);
-		tv.it_interval.tv_usec = (TICK_INTERVAL % 1000) * 1000;
-		tv.it_value.tv_sec = 1;
-		tv.it_value.tv_usec = 0;
-		setitimer(ITIMER_REAL, &tv, NULL);
-	}
-#endif
 }
 	
 NetworkServer::~NetworkServer(){
 	//delete conf;
-	delete serv_link;
-	delete fdes;
+	for(int i=0; i<(int)loops.size(); i++){
+		delete loops[i];
+	}
 	delete ip_filter;
+	delete slowlog;
+	for(int i=0; i<(int)reader_latency.size(); i++){
+		delete reader_latency[i];
+	}
+	for(int i=0; i<(int)writer_latency.size(); i++){
+		delete writer_latency[i];
+	}
+	for(int i=0; i<(int)slow_latency.size(); i++){
+		delete slow_latency[i];
+	}
 
-	writer->stop();
-	delete writer;
-	reader->stop();
-	delete reader;
+	if(writer){
+		writer->stop();
+		delete writer;
+	}
+	if(reader){
+		reader->stop();
+		delete reader;
+	}
+	if(slow){
+		slow->stop();
+		delete slow;
+	}
 }
 
 NetworkServer* NetworkServer::init(const char *conf_file, int num_readers, int num_writers){
@@ -155,6 +183,98 @@ NetworkServer* NetworkServer::init(const Config &conf, int num_readers, int num_
 		}
 	}
 	
+	{ // event loops
+		int num = conf.get_num("server.io_threads");
+		if(num > 0){
+			serv->num_loops = num;
+		}
+		std::string s = conf.get_str("server.reuseport");
+		strtolower(&s);
+		serv->reuseport = (s == "yes");
+#ifndef SO_REUSEPORT
+		if(serv->reuseport){
+			log_warn("SO_REUSEPORT is not supported, links will be handed over by one loop");
+			serv->reuseport = false;
+		}
+#endif
+		if(serv->num_loops == 1){
+			serv->reuseport = false;
+		}
+		log_info("io_threads: %d, reuseport: %s", serv->num_loops, serv->reuseport? "yes" : "no");
+		s = conf.get_str("server.io_uring");
+		strtolower(&s);
+		serv->io_uring = (s == "yes");
+		for(int i=0; i<serv->num_loops; i++){
+			serv->loops.push_back(new NetworkLoop(serv, i));
+		}
+		const char *backend = serv->loops[0]->fdes->backend();
+		if(serv->io_uring && strcmp(backend, "io_uring") != 0){
+			log_warn("io_uring is not supported, fall back to %s", backend);
+		}
+		log_info("event backend: %s", backend);
+	}
+	
+	{ // output buffer limits
+		const char *names[NetworkServer::CLIENT_CLASSES] = {"normal", "replication", "migration"};
+		for(int i=0; i<NetworkServer::CLIENT_CLASSES; i++){
+			OutputLimit *limit = &serv->output_limits[i];
+			limit->name = names[i];
+			limit->soft = DEFAULT_OUTPUT_SOFT_LIMIT;
+			limit->hard = 0;
+			// soft hard, in MB
+			std::string key = std::string("server.output_limit_") + names[i];
+			std::string val = conf.get_str(key.c_str());
+			double soft, hard;
+			if(sscanf(val.c_str(), "%lf %lf", &soft, &hard) == 2){
+				limit->soft = (int64_t)(soft * 1024 * 1024);
+				limit->hard = (int64_t)(hard * 1024 * 1024);
+			}
+			log_info("output_limit_%s: soft %" PRId64 ", hard %" PRId64, names[i], limit->soft, limit->hard);
+		}
+	}
+	
+	{ // writers
+		if(num_writers < 0){
+			int num = conf.get_num("server.writer_threads");
+			if(num > 0){
+				serv->num_writers = num;
+			}
+		}
+		log_info("writer_threads: %d", serv->num_writers);
+	}
+	
+	{ // slow commands
+		std::string s = conf.get_str("server.slow_threads");
+		if(!s.empty()){
+			serv->num_slows = atoi(s.c_str());
+		}
+		if(serv->num_slows < 0){
+			serv->num_slows = 0;
+		}
+		log_info("slow_threads: %d", serv->num_slows);
+	}
+	
+	{ // timeouts
+		serv->idle_timeout = conf.get_num("server.idle_timeout");
+		if(serv->idle_timeout < 0){
+			serv->idle_timeout = 0;
+		}
+		serv->request_timeout = conf.get_num("server.request_timeout");
+		if(serv->request_timeout < 0){
+			serv->request_timeout = 0;
+		}
+		log_info("idle_timeout: %d s, request_timeout: %d ms", serv->idle_timeout, serv->request_timeout);
+	}
+	
+	{ // slowlog
+		serv->slowlog = new Slowlog(conf.get_num("server.slowlog_max_len"));
+		std::string s = conf.get_str("server.slowlog_threshold");
+		if(!s.empty()){
+			serv->slowlog->set_threshold(atof(s.c_str()));
+		}
+		log_info("slowlog_threshold: %.3f ms", serv->slowlog->threshold());
+	}
+	
 	{ // server
 		const char *ip = conf.get_str("server.ip");
 		int port = conf.get_num("server.port");
@@ -162,11 +282,18 @@ NetworkServer* NetworkServer::init(const Config &conf, int num_readers, int num_
 			ip = "127.0.0.1";
 		}
 		
-		serv->serv_link = Link::listen(ip, port);
-		if(serv->serv_link == NULL){
-			log_fatal("error opening server socket! %s", strerror(errno));
-			fprintf(stderr, "error opening server socket! %s\n", strerror(errno));
-			exit(1);
+		for(int i=0; i<serv->num_loops; i++){
+			// without reuseport, only the first loop accepts
+			if(i > 0 && !serv->reuseport){
+				break;
+			}
+			Link *serv_link = Link::listen(ip, port, serv->reuseport);
+			if(serv_link == NULL){
+				log_fatal("error opening server socket! %s", strerror(errno));
+				fprintf(stderr, "error opening server socket! %s\n", strerror(errno));
+				exit(1);
+			}
+			serv->loops[i]->serv_link = serv_link;
 		}
 		log_info("server listen on %s:%d", ip, port);
 
@@ -192,28 +319,82 @@ NetworkServer* NetworkServer::init(const Config &conf, int num_readers, int num_
 }
 
 void NetworkServer::serve(){
+	for(int i=0; i<num_writers; i++){
+		writer_latency.push_back(new Histogram());
+	}
+	for(int i=0; i<num_readers; i++){
+		reader_latency.push_back(new Histogram());
+	}
 	writer = new ProcWorkerPool("writer");
 	writer->start(num_writers);
 	reader = new ProcWorkerPool("reader");
+	if(num_slows > 0){
+		for(int i=0; i<num_slows; i++){
+			slow_latency.push_back(new Histogram());
+		}
+		// a heavy scan never holds up the readers, while the slow
+		// workers help the readers out when they are idle
+		slow = new ProcWorkerPool("slow");
+		slow->steal_from(reader);
+		slow->start(num_slows);
+	}
 	reader->start(num_readers);
 
+	// the first loop runs in the calling thread
+	for(int i=1; i<(int)loops.size(); i++){
+		NetworkLoop *loop = loops[i];
+		int err = pthread_create(&loop->tid, NULL, &NetworkLoop::_run_thread, loop);
+		if(err != 0){
+			log_fatal("can't create loop thread: %s", strerror(err));
+			exit(1);
+		}
+	}
+	loops[0]->run();
+	for(int i=1; i<(int)loops.size(); i++){
+		pthread_join(loops[i]->tid, NULL);
+	}
+}
+
+
+NetworkLoop::NetworkLoop(NetworkServer *serv, int id){
+	this->id = id;
+	this->serv = serv;
+	this->serv_link = NULL;
+	this->fdes = new Fdevents(serv->io_uring);
+}
+
+NetworkLoop::~NetworkLoop(){
+	delete serv_link;
+	delete fdes;
+}
+
+void* NetworkLoop::_run_thread(void *arg){
+	NetworkLoop *loop = (NetworkLoop *)arg;
+	loop->run();
+	return (void *)NULL;
+}
+
+void NetworkLoop::run(){
 	ready_list_t ready_list;
 	ready_list_t ready_list_2;
 	ready_list_t::iterator it;
 	const Fdevents::events_t *events;
 
-	fdes->set(serv_link->fd(), FDEVENT_IN, 0, serv_link);
-	fdes->set(this->reader->fd(), FDEVENT_IN, 0, this->reader);
-	fdes->set(this->writer->fd(), FDEVENT_IN, 0, this->writer);
+	if(serv_link){
+		fdes->set(serv_link->fd(), FDEVENT_IN, 0, serv_link);
+	}
+	fdes->set(this->results.fd(), FDEVENT_IN, 0, &this->results);
+	fdes->set(this->accepted.fd(), FDEVENT_IN, 0, &this->accepted);
 	
-	uint32_t last_ticks = g_ticks;
+	if(this->id == 0){
+		status_timer.type = TIMER_STATUS_REPORT;
+		timers.add(&status_timer, (int64_t)(millitime() * 1000) + STATUS_REPORT_INTERVAL);
+	}
 	
 	while(!quit){
-		// status report
-		if((uint32_t)(g_ticks - last_ticks) >= STATUS_REPORT_TICKS){
-			last_ticks = g_ticks;
-			log_info("server running, links: %d", this->link_count);
-		}
+		// links with expired timers are in none of the ready lists,
+		// nor in the events of the last wait
+		this->proc_timers(&ready_list_2);
 		
 		ready_list.swap(ready_list_2);
 		ready_list_2.clear();
@@ -222,7 +403,11 @@ void NetworkServer::serve(){
 			// ready_list not empty, so we should return immediately
 			events = fdes->wait(0);
 		}else{
-			events = fdes->wait(50);
+			int timeout = timers.next_timeout((int64_t)(millitime() * 1000));
+			if(timeout == -1 || timeout > MAX_WAIT_INTERVAL){
+				timeout = MAX_WAIT_INTERVAL;
+			}
+			events = fdes->wait(timeout);
 		}
 		if(events == NULL){
 			log_fatal("events.wait error: %s", strerror(errno));
@@ -231,23 +416,45 @@ void NetworkServer::serve(){
 		
 		for(int i=0; i<(int)events->size(); i++){
 			const Fdevent *fde = events->at(i);
-			if(fde->data.ptr == serv_link){
+			if(serv_link && fde->data.ptr == serv_link){
 				Link *link = accept_link();
 				if(link){
-					this->link_count ++;				
+					__sync_add_and_fetch(&serv->link_count, 1);
 					log_debug("new link from %s:%d, fd: %d, links: %d",
-						link->remote_ip, link->remote_port, link->fd(), this->link_count);
-					fdes->set(link->fd(), FDEVENT_IN, 1, link);
+						link->remote_ip, link->remote_port, link->fd(), serv->link_count);
+					if(serv->reuseport){
+						this->add_link(link);
+					}else{
+						// hand over links round-robin
+						NetworkLoop *loop = serv->loops[serv->next_loop];
+						serv->next_loop = (serv->next_loop + 1) % serv->loops.size();
+						if(loop == this){
+							this->add_link(link);
+						}else{
+							loop->accepted.push(link);
+						}
+					}
 				}
-			}else if(fde->data.ptr == this->reader || fde->data.ptr == this->writer){
-				ProcWorkerPool *worker = (ProcWorkerPool *)fde->data.ptr;
+			}else if(fde->data.ptr == &this->accepted){
+				Link *link;
+				if(this->accepted.rearm() == -1){
+					log_fatal("reading accepted links error!");
+					exit(0);
+				}
+				while(this->accepted.pop(&link)){
+					this->add_link(link);
+				}
+			}else if(fde->data.ptr == &this->results){
+				// drain all finished jobs on one wakeup
 				ProcJob *job;
-				if(worker->pop(&job) == 0){
+				if(this->results.rearm() == -1){
 					log_fatal("reading result from workers error!");
 					exit(0);
 				}
-				if(proc_result(job, &ready_list) == PROC_ERROR){
-					//
+				while(this->results.pop(&job)){
+					if(proc_result(job, &ready_list) == PROC_ERROR){
+						//
+					}
 				}
 			}else{
 				proc_client_event(fde, &ready_list);
@@ -257,22 +464,18 @@ void NetworkServer::serve(){
 		for(it = ready_list.begin(); it != ready_list.end(); it ++){
 			Link *link = *it;
 			if(link->error()){
-				this->link_count --;
-				fdes->del(link->fd());
-				delete link;
+				this->del_link(link);
 				continue;
 			}
 
 			const Request *req = link->recv();
 			if(req == NULL){
 				log_warn("fd: %d, link parse error, delete link", link->fd());
-				this->link_count --;
-				fdes->del(link->fd());
-				delete link;
+				this->del_link(link);
 				continue;
 			}
 			if(req->empty()){
-				fdes->set(link->fd(), FDEVENT_IN, 1, link);
+				this->wait_link(link);
 				continue;
 			}
 			
@@ -281,14 +484,20 @@ void NetworkServer::serve(){
 			ProcJob *job = new ProcJob();
 			job->link = link;
 			job->req = link->last_recv();
+			job->resp.redis = link->redis_converted();
 			int result = this->proc(job);
 			if(result == PROC_THREAD){
 				fdes->del(link->fd());
+				if(serv->request_timeout > 0){
+					job->timer.type = TIMER_JOB_DEADLINE;
+					job->timer.data = job;
+					timers.add(&job->timer, (int64_t)(job->stime * 1000) + serv->request_timeout);
+				}
 				continue;
 			}
 			if(result == PROC_BACKEND){
 				fdes->del(link->fd());
-				this->link_count --;
+				__sync_sub_and_fetch(&serv->link_count, 1);
 				continue;
 			}
 			
@@ -299,13 +508,18 @@ void NetworkServer::serve(){
 	}
 }
 
-Link* NetworkServer::accept_link(){
+Link* NetworkLoop::accept_link(){
 	Link *link = serv_link->accept();
 	if(link == NULL){
 		log_error("accept failed! %s", strerror(errno));
 		return NULL;
 	}
-	if(!ip_filter->check_pass(link->remote_ip)){
+	bool pass;
+	{
+		Locking l(&serv->ip_filter_mutex);
+		pass = serv->ip_filter->check_pass(link->remote_ip);
+	}
+	if(!pass){
 		log_debug("ip_filter deny link from %s:%d", link->remote_ip, link->remote_port);
 		delete link;
 		return NULL;
@@ -313,15 +527,120 @@ Link* NetworkServer::accept_link(){
 				
 	link->nodelay();
 	link->noblock();
+	serv->set_client_class(link, NetworkServer::CLIENT_NORMAL);
 	link->create_time = millitime();
 	link->active_time = link->create_time;
 	return link;
 }
 
-int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
-	Link *link = job->link;
-	int result = job->result;
-			
+void NetworkLoop::add_link(Link *link){
+	link->timer.type = TIMER_LINK_IDLE;
+	link->timer.data = link;
+	this->wait_link(link);
+}
+
+void NetworkLoop::del_link(Link *link){
+	__sync_sub_and_fetch(&serv->link_count, 1);
+	timers.del(&link->timer);
+	fdes->del(link->fd());
+	delete link;
+}
+
+void NetworkLoop::wait_link(Link *link){
+	// an idle link holds no more than the initial buffers
+	if(link->input->empty()){
+		link->input->shrink();
+	}
+	if(link->output->empty()){
+		link->output->shrink();
+	}
+	fdes->set(link->fd(), FDEVENT_IN, 1, link);
+	this->watch_idle(link);
+}
+
+void NetworkLoop::watch_idle(Link *link){
+	if(serv->idle_timeout > 0){
+		int64_t expire = (int64_t)(link->active_time * 1000) + serv->idle_timeout * 1000;
+		timers.add(&link->timer, expire);
+	}
+}
+
+void NetworkLoop::pause_link(Link *link){
+	link->paused = true;
+	__sync_add_and_fetch(&link->output_limit->paused, 1);
+	log_debug("fd: %d, output %d bytes, pause reading", link->fd(), link->output->size());
+	fdes->clr(link->fd(), FDEVENT_IN);
+	// a client not reading its responses is idle as well
+	this->watch_idle(link);
+}
+
+void NetworkLoop::resume_link(Link *link, ready_list_t *ready_list){
+	link->paused = false;
+	log_debug("fd: %d, output %d bytes, resume reading", link->fd(), link->output->size());
+	if(link->recv_pending()){
+		timers.del(&link->timer);
+		ready_list->push_back(link);
+	}else{
+		this->wait_link(link);
+	}
+}
+
+void NetworkLoop::proc_timers(ready_list_t *ready_list){
+	if(timers.size() == 0){
+		return;
+	}
+	int64_t now = (int64_t)(millitime() * 1000);
+	std::vector<Timer *> expired;
+	timers.expire(now, &expired);
+	for(int i=0; i<(int)expired.size(); i++){
+		Timer *timer = expired[i];
+		switch(timer->type){
+			case TIMER_STATUS_REPORT:{
+				log_info("server running, links: %d", serv->link_count);
+				timers.add(timer, now + STATUS_REPORT_INTERVAL);
+				break;
+			}
+			case TIMER_LINK_IDLE:{
+				Link *link = (Link *)timer->data;
+				// active_time may have been updated by writing
+				int64_t expire = (int64_t)(link->active_time * 1000) + serv->idle_timeout * 1000;
+				if(expire > now){
+					this->watch_idle(link);
+					break;
+				}
+				log_info("fd: %d, %s:%d idle for %d s, delete link",
+					link->fd(), link->remote_ip, link->remote_port, serv->idle_timeout);
+				this->del_link(link);
+				break;
+			}
+			case TIMER_JOB_DEADLINE:{
+				// the job is still owned by a worker, which checks this flag
+				ProcJob *job = (ProcJob *)timer->data;
+				job->timeout = true;
+				break;
+			}
+			case TIMER_BLOCK_TIMEOUT:{
+				ProcJob *job = (ProcJob *)timer->data;
+				// or it has been woken up, and is in the results queue
+				if(!serv->unblock(job)){
+					break;
+				}
+				Link *link = job->link;
+				link->blocked = NULL;
+				fdes->del(link->fd());
+				// still PROC_BLOCK, answered as timed out
+				this->proc_result(job, ready_list);
+				break;
+			}
+		}
+	}
+}
+
+void NetworkServer::set_client_class(Link *link, int client_class){
+	link->output_limit = &output_limits[client_class];
+}
+
+void NetworkServer::stat_job(const ProcJob *job){
 	if(log_level() >= Logger::LEVEL_DEBUG){
 		log_debug("w:%.3f,p:%.3f, req: %s, resp: %s",
 			job->time_wait, job->time_proc,
@@ -329,9 +648,47 @@ int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
 			serialize_req(job->resp.resp).c_str());
 	}
 	if(job->cmd){
-		job->cmd->calls += 1;
-		job->cmd->time_wait += job->time_wait;
-		job->cmd->time_proc += job->time_proc;
+		uint64_t wait = (uint64_t)(job->time_wait * 1000);
+		uint64_t proc = (uint64_t)(job->time_proc * 1000);
+		__sync_add_and_fetch(&job->cmd->calls, 1);
+		job->cmd->time_wait.add(wait);
+		job->cmd->time_proc.add(proc);
+		job->cmd->time_total.add(wait + proc);
+	}
+	if(slowlog && slowlog->slow(job)){
+		slowlog->add(job);
+	}
+}
+
+int NetworkLoop::proc_result(ProcJob *job, ready_list_t *ready_list){
+	Link *link = job->link;
+	int result = job->result;
+	
+	timers.del(&job->timer);
+	if(link->blocked == job){
+		// woken up
+		link->blocked = NULL;
+		fdes->del(link->fd());
+		if(!link->error()){
+			this->redo_job(job);
+			return PROC_OK;
+		}
+		result = PROC_ERROR;
+	}else if(result == PROC_BLOCK){
+		int ret = this->block_job(job);
+		if(ret == 1){
+			return PROC_OK;
+		}
+		if(ret == -1){
+			this->redo_job(job);
+			return PROC_OK;
+		}
+		job->resp.reply_get(0);
+		result = PROC_OK;
+		if(link->send(job->resp) == -1){
+			result = PROC_ERROR;
+		}
+		serv->stat_job(job);
 	}
 	delete job;
 	
@@ -349,11 +706,20 @@ int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
 		}
 	}
 
+	if(link->output_over_hard()){
+		log_info("fd: %d, %s:%d output %d bytes over the hard limit, delete link",
+			link->fd(), link->remote_ip, link->remote_port, link->output->size());
+		__sync_add_and_fetch(&link->output_limit->closed, 1);
+		goto proc_err;
+	}
+
 	if(!link->output->empty()){
 		fdes->set(link->fd(), FDEVENT_OUT, 1, link);
 	}
-	if(link->input->empty()){
-		fdes->set(link->fd(), FDEVENT_IN, 1, link);
+	if(link->output_over_soft()){
+		this->pause_link(link);
+	}else if(!link->recv_pending()){
+		this->wait_link(link);
 	}else{
 		fdes->clr(link->fd(), FDEVENT_IN);
 		ready_list->push_back(link);
@@ -361,9 +727,7 @@ int NetworkServer::proc_result(ProcJob *job, ready_list_t *ready_list){
 	return PROC_OK;
 
 proc_err:
-	this->link_count --;
-	fdes->del(link->fd());
-	delete link;
+	this->del_link(link);
 	return PROC_ERROR;
 }
 
@@ -390,9 +754,21 @@ A link is in either one of these places:
 	2. async worker queue
 So it safe to delete link when processing ready list and async worker result.
 */
-int NetworkServer::proc_client_event(const Fdevent *fde, ready_list_t *ready_list){
+int NetworkLoop::proc_client_event(const Fdevent *fde, ready_list_t *ready_list){
+	// no longer watched, deleted by handling a woken up blocked job,
+	// earlier in the same wakeup
+	if(fde->s_flags == FDEVENT_NONE){
+		return 0;
+	}
 	Link *link = (Link *)fde->data.ptr;
+	if(link->blocked){
+		return this->proc_blocked_event(fde, link);
+	}
 	if(fde->events & FDEVENT_IN){
+		// links in the ready_list are never timed out
+		timers.del(&link->timer);
+		// only on errors while paused, the link is read to find out
+		link->paused = false;
 		ready_list->push_back(link);
 		if(link->error()){
 			return 0;
@@ -413,31 +789,202 @@ int NetworkServer::proc_client_event(const Fdevent *fde, ready_list_t *ready_lis
 		if(len <= 0){
 			log_debug("fd: %d, write: %d, delete link", link->fd(), len);
 			link->mark_error();
+			if(link->paused){
+				// not waiting for reading, deleted through the ready_list
+				link->paused = false;
+				timers.del(&link->timer);
+				ready_list->push_back(link);
+			}
 			return 0;
 		}
+		// a client receiving a large response is not idle
+		link->active_time = millitime();
 		if(link->output->empty()){
 			fdes->clr(link->fd(), FDEVENT_OUT);
+			link->output->shrink();
+		}
+		if(link->paused && !link->output_over_soft()){
+			this->resume_link(link, ready_list);
 		}
 	}
 	return 0;
 }
 
-int NetworkServer::proc(ProcJob *job){
-	job->serv = this;
+/*
+A blocked link is watched only for being closed, and for flushing the
+responses of the requests pipelined before the blocked one. Requests
+received while blocked are left in the input buffer.
+*/
+int NetworkLoop::proc_blocked_event(const Fdevent *fde, Link *link){
+	ProcJob *job = link->blocked;
+	int len = 1;
+	if(fde->events & FDEVENT_OUT){
+		len = link->write();
+		if(len > 0 && link->output->empty()){
+			fdes->clr(link->fd(), FDEVENT_OUT);
+		}
+	}
+	if(len > 0 && (fde->events & FDEVENT_IN)){
+		len = link->read();
+		if(len > 0){
+			fdes->clr(link->fd(), FDEVENT_IN);
+		}
+	}
+	if(len > 0){
+		return 0;
+	}
+	log_debug("fd: %d, blocked link closed", link->fd());
+	link->mark_error();
+	fdes->del(link->fd());
+	// or it has been woken up, and is deleted with the link once back
+	// from the results queue
+	if(serv->unblock(job)){
+		link->blocked = NULL;
+		timers.del(&job->timer);
+		delete job;
+		this->del_link(link);
+	}
+	return 0;
+}
+
+int NetworkLoop::block_job(ProcJob *job){
+	Link *link = job->link;
+	bool front = true;
+	if(job->block_expire == 0){
+		front = false;
+		job->block_expire = -1;
+		if(link->block_timeout > 0){
+			job->block_expire = (int64_t)(job->stime * 1000) + link->block_timeout;
+		}
+	}
+	if(job->block_expire > 0 && job->block_expire <= (int64_t)(millitime() * 1000)){
+		return 0;
+	}
+	// a job taken by a key which is not ready again keeps its turn
+	if(serv->block(job, &this->results, front) == -1){
+		return -1;
+	}
+	link->blocked = job;
+	if(job->block_expire > 0){
+		job->timer.type = TIMER_BLOCK_TIMEOUT;
+		job->timer.data = job;
+		timers.add(&job->timer, job->block_expire);
+	}
+	// responses to the requests pipelined before
+	if(!link->output->empty() && link->write() < 0){
+		link->mark_error();
+	}
+	fdes->set(link->fd(), FDEVENT_IN, 1, link);
+	if(!link->output->empty()){
+		fdes->set(link->fd(), FDEVENT_OUT, 1, link);
+	}
+	return 1;
+}
+
+void NetworkLoop::redo_job(ProcJob *job){
+	// the link may have parsed the requests pipelined after it
+	bool redis = job->resp.redis;
+	job->resp = Response();
+	job->resp.redis = redis;
+	job->result = PROC_OK;
+	job->timeout = false;
+	job->stime = millitime();
+	serv->worker_pool(job->cmd)->push(job, &this->results);
+}
+
+int NetworkServer::block(ProcJob *job, SelectableQueue<ProcJob *> *results, bool front){
+	Link *link = job->link;
+	Locking l(&waiters_mutex);
+	int bucket = BytesHash()(link->block_key) % WAKE_BUCKETS;
+	if(wake_epochs[bucket] != link->block_epoch){
+		return -1;
+	}
+	Waiter w;
+	w.job = job;
+	w.results = results;
+	std::deque<Waiter> &list = waiters[link->block_key];
+	if(front){
+		list.push_front(w);
+	}else{
+		list.push_back(w);
+	}
+	num_blocked ++;
+	return 0;
+}
+
+bool NetworkServer::unblock(ProcJob *job){
+	Link *link = job->link;
+	Locking l(&waiters_mutex);
+	std::map<std::string, std::deque<Waiter> >::iterator it;
+	it = waiters.find(link->block_key);
+	if(it == waiters.end()){
+		return false;
+	}
+	std::deque<Waiter> &list = it->second;
+	for(std::deque<Waiter>::iterator w = list.begin(); w != list.end(); w++){
+		if(w->job == job){
+			list.erase(w);
+			if(list.empty()){
+				waiters.erase(it);
+			}
+			num_blocked --;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t NetworkServer::wake_epoch(const Bytes &key){
+	Locking l(&waiters_mutex);
+	return wake_epochs[BytesHash()(key) % WAKE_BUCKETS];
+}
+
+void NetworkServer::wake(const Bytes &key, int num){
+	std::vector<Waiter> woken;
+	{
+		Locking l(&waiters_mutex);
+		wake_epochs[BytesHash()(key) % WAKE_BUCKETS] ++;
+		std::map<std::string, std::deque<Waiter> >::iterator it;
+		it = waiters.find(key.String());
+		if(it == waiters.end()){
+			return;
+		}
+		std::deque<Waiter> &list = it->second;
+		while(num-- > 0 && !list.empty()){
+			woken.push_back(list.front());
+			list.pop_front();
+			num_blocked --;
+		}
+		if(list.empty()){
+			waiters.erase(it);
+		}
+	}
+	// the loop owning the link processes the job again, pushed without
+	// the lock, which the loop may be waiting for
+	for(int i=0; i<(int)woken.size(); i++){
+		if(woken[i].results->push(woken[i].job) == -1){
+			log_fatal("wake blocked link error!");
+			exit(0);
+		}
+	}
+}
+
+int NetworkLoop::proc(ProcJob *job){
+	job->serv = serv;
 	job->result = PROC_OK;
 	job->stime = millitime();
 
 	const Request *req = job->req;
 
 	do{
+		Command *cmd = serv->get_command(job->link, *req);
 		// AUTH
-		if(this->need_auth && job->link->auth == false && req->at(0) != "auth"){
+		if(serv->need_auth && job->link->auth == false && (!cmd || cmd->proc != proc_auth)){
 			job->resp.push_back("noauth");
 			job->resp.push_back("authentication required");
 			break;
 		}
 		
-		Command *cmd = proc_map.get_proc(req->at(0));
 		if(!cmd){
 			job->resp.push_back("client_error");
 			job->resp.push_back("Unknown Command: " + req->at(0).String());
@@ -446,23 +993,21 @@ int NetworkServer::proc(ProcJob *job){
 		job->cmd = cmd;
 		
 		if(cmd->flags & Command::FLAG_THREAD){
-			if(cmd->flags & Command::FLAG_WRITE){
-				writer->push(job);
-			}else{
-				reader->push(job);
-			}
+			// results are sent back to this loop
+			serv->worker_pool(cmd)->push(job, &this->results);
 			return PROC_THREAD;
 		}
 
 		proc_t p = cmd->proc;
 		job->time_wait = 1000 * (millitime() - job->stime);
-		job->result = (*p)(this, job->link, *req, &job->resp);
+		job->result = (*p)(serv, job->link, *req, &job->resp);
 		job->time_proc = 1000 * (millitime() - job->stime) - job->time_wait;
 	}while(0);
 	
-	if(job->link->send(job->resp.resp) == -1){
+	if(job->link->send(job->resp) == -1){
 		job->result = PROC_ERROR;
 	}
+	serv->stat_job(job);
 	return job->result;
 }
 
@@ -481,6 +1026,13 @@ static int proc_info(NetworkServer *net, Link *link, const Request &req, Respons
 	resp->push_back("1.0");
 	resp->push_back("links");
 	resp->add(net->link_count);
+	resp->push_back("blocked");
+	resp->add(net->num_blocked);
+	for(int i=0; i<NetworkServer::CLIENT_CLASSES; i++){
+		const OutputLimit *limit = &net->output_limits[i];
+		resp->push_back(std::string("output_limit.") + limit->name);
+		resp->push_back(limit->stats());
+	}
 	{
 		int64_t calls = 0;
 		proc_map_t::iterator it;
@@ -510,6 +1062,117 @@ static int proc_auth(NetworkServer *net, Link *link, const Request &req, Respons
 	return 0;
 }
 
+// latency [cmd]
+// latency reset [cmd]
+static int proc_latency(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	bool reset = req.size() > 1 && req[1] == "reset";
+	Command *only = NULL;
+	int name_idx = reset? 2 : 1;
+	if(req.size() > name_idx){
+		only = net->proc_map.get_proc(req[name_idx]);
+		if(!only){
+			resp->push_back("client_error");
+			resp->push_back("Unknown Command: " + req[name_idx].String());
+			return 0;
+		}
+	}
+
+	resp->push_back("ok");
+	proc_map_t::iterator it;
+	for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
+		Command *cmd = it->second;
+		if(only && cmd != only){
+			continue;
+		}
+		if(reset){
+			cmd->time_wait.reset();
+			cmd->time_proc.reset();
+			cmd->time_total.reset();
+			continue;
+		}
+		if(!only && cmd->time_total.count() == 0){
+			continue;
+		}
+		resp->push_back("cmd." + cmd->name + ".total");
+		resp->push_back(cmd->time_total.stats());
+		resp->push_back("cmd." + cmd->name + ".wait");
+		resp->push_back(cmd->time_wait.stats());
+		resp->push_back("cmd." + cmd->name + ".proc");
+		resp->push_back(cmd->time_proc.stats());
+	}
+	if(only){
+		return 0;
+	}
+	for(int i=0; i<(int)net->writer_latency.size(); i++){
+		if(reset){
+			net->writer_latency[i]->reset();
+			continue;
+		}
+		resp->push_back("worker.writer." + str(i));
+		resp->push_back(net->writer_latency[i]->stats());
+	}
+	for(int i=0; i<(int)net->reader_latency.size(); i++){
+		if(reset){
+			net->reader_latency[i]->reset();
+			continue;
+		}
+		resp->push_back("worker.reader." + str(i));
+		resp->push_back(net->reader_latency[i]->stats());
+	}
+	for(int i=0; i<(int)net->slow_latency.size(); i++){
+		if(reset){
+			net->slow_latency[i]->reset();
+			continue;
+		}
+		resp->push_back("worker.slow." + str(i));
+		resp->push_back(net->slow_latency[i]->stats());
+	}
+	return 0;
+}
+
+// slowlog get [num]
+// slowlog len
+// slowlog reset
+// slowlog threshold [ms]
+static int proc_slowlog(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	if(req.size() < 2){
+		resp->push_back("client_error");
+		return 0;
+	}
+	Slowlog *slowlog = net->slowlog;
+	std::string action = req[1].String();
+	strtolower(&action);
+	if(action == "get"){
+		int num = -1;
+		if(req.size() > 2){
+			num = req[2].Int();
+		}
+		std::vector<SlowlogEntry> list;
+		slowlog->get(&list, num);
+		resp->push_back("ok");
+		for(int i=0; i<(int)list.size(); i++){
+			resp->push_back(list[i].str());
+		}
+	}else if(action == "len"){
+		resp->push_back("ok");
+		resp->add(slowlog->len());
+	}else if(action == "reset"){
+		slowlog->reset();
+		resp->push_back("ok");
+	}else if(action == "threshold"){
+		if(req.size() > 2){
+			slowlog->set_threshold(req[2].Double());
+			log_info("slowlog_threshold: %.3f ms", slowlog->threshold());
+		}
+		resp->push_back("ok");
+		resp->add(slowlog->threshold());
+	}else{
+		resp->push_back("client_error");
+		resp->push_back("Unknown slowlog action: " + action);
+	}
+	return 0;
+}
+
 #define ENSURE_LOCALHOST() do{ \
 		if(strcmp(link->remote_ip, "127.0.0.1") != 0){ \
 			resp->push_back("noauth"); \
@@ -522,6 +1185,7 @@ static int proc_list_allow_ip(NetworkServer *net, Link *link, const Request &req
 	ENSURE_LOCALHOST();
 
 	resp->push_back("ok");
+	Locking l(&net->ip_filter_mutex);
 	IpFilter *ip_filter = net->ip_filter;
 	if(ip_filter->allow_all){
 		resp->push_back("all");
@@ -541,6 +1205,7 @@ static int proc_add_allow_ip(NetworkServer *net, Link *link, const Request &req,
 	if(req.size() != 2){
 		resp->push_back("client_error");
 	}else{
+		Locking l(&net->ip_filter_mutex);
 		IpFilter *ip_filter = net->ip_filter;
 		ip_filter->add_allow(req[1].String());
 		resp->push_back("ok");
@@ -553,6 +1218,7 @@ static int proc_del_allow_ip(NetworkServer *net, Link *link, const Request &req,
 	if(req.size() != 2){
 		resp->push_back("client_error");
 	}else{
+		Locking l(&net->ip_filter_mutex);
 		IpFilter *ip_filter = net->ip_filter;
 		ip_filter->del_allow(req[1].String());
 		resp->push_back("ok");
@@ -564,6 +1230,7 @@ static int proc_list_deny_ip(NetworkServer *net, Link *link, const Request &req,
 	ENSURE_LOCALHOST();
 
 	resp->push_back("ok");
+	Locking l(&net->ip_filter_mutex);
 	IpFilter *ip_filter = net->ip_filter;
 	if(!ip_filter->allow_all){
 		resp->push_back("all");
@@ -583,6 +1250,7 @@ static int proc_add_deny_ip(NetworkServer *net, Link *link, const Request &req,
 	if(req.size() != 2){
 		resp->push_back("client_error");
 	}else{
+		Locking l(&net->ip_filter_mutex);
 		IpFilter *ip_filter = net->ip_filter;
 		ip_filter->add_deny(req[1].String());
 		resp->push_back("ok");
@@ -595,6 +1263,7 @@ static int proc_del_deny_ip(NetworkServer *net, Link *link, const Request &req,
 	if(req.size() != 2){
 		resp->push_back("client_error");
 	}else{
+		Locking l(&net->ip_filter_mutex);
 		IpFilter *ip_filter = net->ip_filter;
 		ip_filter->del_deny(req[1].String());
 		resp->push_back("ok");
@@ -9,53 +9,178 @@ found in the LICENSE file.
 #include "../include.h"
 #include <string>
 #include <vector>
+#include <map>
+#include <deque>
 
 #include "fde.h"
+#include "link.h"
 #include "proc.h"
 #include "worker.h"
+#include "slowlog.h"
 
 class Link;
 class Config;
 class IpFilter;
 class Fdevents;
+class NetworkServer;
 
 typedef std::vector<Link *> ready_list_t;
 
-class NetworkServer
+// An event loop, runs in its own thread, owns the links it accepted
+// (or was handed over), and receives the results of the jobs it pushed
+// into the shared worker pools.
+class NetworkLoop
 {
 private:
-	int tick_interval;
-	int status_report_ticks;
+	friend class NetworkServer;
 
-	//Config *conf;
+	int id;
+	NetworkServer *serv;
+	// NULL if links are handed over by the accepting loop
 	Link *serv_link;
 	Fdevents *fdes;
+	SelectableQueue<ProcJob *> results;
+	SelectableQueue<Link *> accepted;
+	pthread_t tid;
+	// idle links, request deadlines and the status report
+	TimerWheel timers;
+	Timer status_timer;
+
+	NetworkLoop(NetworkServer *serv, int id);
+	~NetworkLoop();
+
+	void run();
+	static void* _run_thread(void *arg);
 
 	Link* accept_link();
+	void add_link(Link *link);
+	void del_link(Link *link);
+	// wait for the next request, the idle timer is armed
+	void wait_link(Link *link);
+	void watch_idle(Link *link);
+	// stop reading while the output buffer is over the soft limit
+	void pause_link(Link *link);
+	void resume_link(Link *link, ready_list_t *ready_list);
+	// @return 1: parked, 0: timed out, -1: woken up already
+	int block_job(ProcJob *job);
+	// a woken up job is processed again
+	void redo_job(ProcJob *job);
+	void proc_timers(ready_list_t *ready_list);
 	int proc_result(ProcJob *job, ready_list_t *ready_list);
+	int proc_blocked_event(const Fdevent *fde, Link *link);
 	int proc_client_event(const Fdevent *fde, ready_list_t *ready_list);
 
 	int proc(ProcJob *job);
+};
+
+class NetworkServer
+{
+private:
+	friend class NetworkLoop;
+
+	// in seconds, 0 means links are never closed for being idle
+	int idle_timeout;
+	// in ms, 0 means no deadline for requests waiting for workers
+	int request_timeout;
+
+	//Config *conf;
+	int num_loops;
+	bool reuseport;
+	// poll with io_uring instead of epoll, if supported
+	bool io_uring;
+	std::vector<NetworkLoop *> loops;
+	// round-robin index for handing over accepted links
+	int next_loop;
 
 	int num_readers;
 	int num_writers;
+	// 0: slow commands are processed by the readers
+	int num_slows;
 	ProcWorkerPool *writer;
 	ProcWorkerPool *reader;
+	ProcWorkerPool *slow;
+
+	// blocked requests, by the key they wait for, in FIFO order
+	struct Waiter{
+		ProcJob *job;
+		// of the loop owning the link
+		SelectableQueue<ProcJob *> *results;
+	};
+	static const int WAKE_BUCKETS = 1024;
+	Mutex waiters_mutex;
+	std::map<std::string, std::deque<Waiter> > waiters;
+	// times the keys of each bucket were woken up
+	uint64_t wake_epochs[WAKE_BUCKETS];
 
 	NetworkServer();
+	// @return 0: parked, -1: the key was woken up after the job checked it
+	int block(ProcJob *job, SelectableQueue<ProcJob *> *results, bool front);
+	// @return false if the job is not parked(woken up already)
+	bool unblock(ProcJob *job);
 
 protected:
 	void usage(int argc, char **argv);
 
 public:
 	IpFilter *ip_filter;
+	// ip_filter is shared by all loops
+	Mutex ip_filter_mutex;
 	void *data;
 	ProcMap proc_map;
 	int link_count;
+	// requests parked in the waiters
+	int num_blocked;
 	bool need_auth;
 	std::string password;
 
 	~NetworkServer();
+
+	// classes of links, each has its own output buffer limits
+	enum{
+		CLIENT_NORMAL = 0,
+		CLIENT_REPLICATION,
+		CLIENT_MIGRATION,
+		CLIENT_CLASSES
+	};
+	OutputLimit output_limits[CLIENT_CLASSES];
+	void set_client_class(Link *link, int client_class);
+
+	// time_proc of the requests processed by each worker thread, in us
+	std::vector<Histogram *> reader_latency;
+	std::vector<Histogram *> writer_latency;
+	std::vector<Histogram *> slow_latency;
+	Slowlog *slowlog;
+
+	// the command of req received from link, NULL if unknown
+	Command* get_command(Link *link, const Request &req){
+		// resolved only once for each kind of Redis request
+		Command *cmd = link->command();
+		if(!cmd){
+			cmd = proc_map.get_proc(req[0]);
+			link->set_command(cmd);
+		}
+		return cmd;
+	}
+	// the pool which processes cmd, cmd must have FLAG_THREAD
+	ProcWorkerPool* worker_pool(const Command *cmd){
+		if(cmd->flags & Command::FLAG_WRITE){
+			return writer;
+		}
+		if((cmd->flags & Command::FLAG_SLOW) && slow){
+			return slow;
+		}
+		return reader;
+	}
+
+	// log and count a processed request, could be called by any thread
+	void stat_job(const ProcJob *job);
+
+	// read by a proc before checking whether key is ready, and saved in
+	// Link::block_epoch, so that a wake up in between is not missed
+	uint64_t wake_epoch(const Bytes &key);
+	// the first num requests blocked on key are processed again, could
+	// be called by any thread
+	void wake(const Bytes &key, int num);
 	
 	// could be called only once
 	static NetworkServer* init(const char *conf_file, int num_readers=-1, int num_writers=-1);
@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "slowlog.h"
+#include "link.h"
+
+std::string SlowlogEntry::str() const{
+	char buf[512];
+	snprintf(buf, sizeof(buf), "id: %" PRIu64 "\ttime: %.3f\tclient: %s\tcmd: %s"
+		"\twait: %.3f\tproc: %.3f\tresp_size: %" PRId64 "\treq: %s",
+		id, time, client, cmd, time_wait, time_proc, resp_size, req);
+	return buf;
+}
+
+Slowlog::Slowlog(int max_len){
+	if(max_len <= 0){
+		max_len = DEFAULT_MAX_LEN;
+	}
+	this->max_len = max_len;
+	this->threshold_ = 10;
+	this->seq = 0;
+	this->reset_seq = 0;
+	slots = new Slot[max_len];
+	for(int i=0; i<max_len; i++){
+		slots[i].version = 0;
+		slots[i].entry.id = 0;
+	}
+}
+
+Slowlog::~Slowlog(){
+	delete[] slots;
+}
+
+void Slowlog::add(const ProcJob *job){
+	uint64_t id = __sync_fetch_and_add(&seq, 1);
+	Slot *slot = &slots[id % max_len];
+	uint64_t version = slot->version;
+	// another writer owns the slot, drop this entry
+	if((version & 1) || !__sync_bool_compare_and_swap(&slot->version, version, version + 1)){
+		return;
+	}
+	SlowlogEntry *e = &slot->entry;
+	// a newer entry was written in the meantime
+	if(version > 0 && e->id > id){
+		__sync_synchronize();
+		slot->version = version;
+		return;
+	}
+
+	e->id = id;
+	e->time = millitime();
+	e->time_wait = job->time_wait;
+	e->time_proc = job->time_proc;
+	e->resp_size = job->resp.redis_out.size();
+	for(int i=0; i<(int)job->resp.resp.size(); i++){
+		e->resp_size += job->resp.resp[i].size();
+	}
+	if(job->link){
+		snprintf(e->client, sizeof(e->client), "%s:%d", job->link->remote_ip, job->link->remote_port);
+	}else{
+		e->client[0] = '\0';
+	}
+	if(job->cmd){
+		snprintf(e->cmd, sizeof(e->cmd), "%s", job->cmd->name.c_str());
+	}else{
+		e->cmd[0] = '\0';
+	}
+	if(job->req){
+		snprintf(e->req, sizeof(e->req), "%s", serialize_req(*job->req).c_str());
+	}else{
+		e->req[0] = '\0';
+	}
+
+	__sync_synchronize();
+	slot->version = version + 2;
+}
+
+void Slowlog::get(std::vector<SlowlogEntry> *ret, int num) const{
+	uint64_t end = seq;
+	uint64_t begin = reset_seq;
+	if(end - begin > (uint64_t)max_len){
+		begin = end - max_len;
+	}
+	for(uint64_t id=end; id>begin; id--){
+		if(num >= 0 && (int)ret->size() >= num){
+			break;
+		}
+		const Slot *slot = &slots[(id - 1) % max_len];
+		uint64_t version = slot->version;
+		if(version == 0 || (version & 1)){
+			continue;
+		}
+		__sync_synchronize();
+		SlowlogEntry e = slot->entry;
+		__sync_synchronize();
+		// overwritten while copying, or not written yet
+		if(slot->version != version || e.id != id - 1){
+			continue;
+		}
+		ret->push_back(e);
+	}
+}
+
+int Slowlog::len() const{
+	uint64_t num = seq - reset_seq;
+	if(num > (uint64_t)max_len){
+		return max_len;
+	}
+	return (int)num;
+}
+
+void Slowlog::reset(){
+	reset_seq = seq;
+}
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef NET_SLOWLOG_H_
+#define NET_SLOWLOG_H_
+
+#include "../include.h"
+#include <string>
+#include <vector>
+#include "proc.h"
+
+struct SlowlogEntry
+{
+	uint64_t id;
+	double time;      // unix timestamp, in seconds
+	double time_wait; // ms
+	double time_proc; // ms
+	int64_t resp_size;
+	char client[64];
+	char cmd[32];
+	// serialize_req() of the request, truncated
+	char req[256];
+
+	std::string str() const;
+};
+
+// A bounded ring of the most recent slow requests, lock free on both sides.
+// Writers claim a slot by incrementing the sequence, the slot is
+// guarded by its own version number so that a reader never sees a
+// half written entry; entries overwritten while being read are skipped.
+class Slowlog
+{
+public:
+	static const int DEFAULT_MAX_LEN = 128;
+
+	Slowlog(int max_len=DEFAULT_MAX_LEN);
+	~Slowlog();
+
+	// requests whose time_proc is not less than threshold(ms) are
+	// logged, negative to disable
+	double threshold() const{
+		return threshold_;
+	}
+	void set_threshold(double ms){
+		threshold_ = ms;
+	}
+	bool slow(const ProcJob *job) const{
+		return threshold_ >= 0 && job->time_proc >= threshold_;
+	}
+
+	// could be called by any thread
+	void add(const ProcJob *job);
+	// newest first, at most num entries(-1: all)
+	void get(std::vector<SlowlogEntry> *ret, int num=-1) const;
+	int len() const;
+	void reset();
+
+private:
+	struct Slot
+	{
+		// odd while being written
+		volatile uint64_t version;
+		SlowlogEntry entry;
+	};
+
+	int max_len;
+	Slot *slots;
+	volatile double threshold_;
+	// number of entries ever added
+	volatile uint64_t seq;
+	// entries with id below this are dropped by reset()
+	volatile uint64_t reset_seq;
+};
+
+#endif
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "timer.h"
+
+TimerWheel::TimerWheel(int resolution){
+	if(resolution <= 0){
+		resolution = 1;
+	}
+	this->resolution = resolution;
+	this->tick = (int64_t)(millitime() * 1000) / resolution;
+	this->count = 0;
+	for(int i=0; i<LEVELS; i++){
+		for(int j=0; j<SLOTS; j++){
+			Timer *head = &slots[i][j];
+			head->prev = head->next = head;
+		}
+	}
+}
+
+TimerWheel::~TimerWheel(){
+	for(int i=0; i<LEVELS; i++){
+		for(int j=0; j<SLOTS; j++){
+			Timer *head = &slots[i][j];
+			while(head->next != head){
+				unlink(head->next);
+			}
+		}
+	}
+}
+
+void TimerWheel::unlink(Timer *timer){
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->prev = timer->next = NULL;
+}
+
+void TimerWheel::add(Timer *timer, int64_t expire){
+	if(timer->pending()){
+		unlink(timer);
+	}else{
+		count ++;
+	}
+	timer->expire = expire;
+	place(timer);
+}
+
+void TimerWheel::del(Timer *timer){
+	if(timer->pending()){
+		unlink(timer);
+		count --;
+	}
+}
+
+void TimerWheel::place(Timer *timer){
+	// round up, a timer never fires early
+	int64_t t = (timer->expire + resolution - 1) / resolution;
+	int64_t delta = t - this->tick;
+	Timer *head;
+	if(delta < 0){
+		head = &slots[0][this->tick & SLOT_MASK];
+	}else{
+		int level = 0;
+		while(level < LEVELS - 1 && delta >= ((int64_t)1 << (SLOT_BITS * (level + 1)))){
+			level ++;
+		}
+		if(level == LEVELS - 1){
+			// beyond the top wheel, will be cascaded again
+			int64_t max = ((int64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+			if(delta > max){
+				t = this->tick + max;
+			}
+		}
+		head = &slots[level][(t >> (SLOT_BITS * level)) & SLOT_MASK];
+	}
+	timer->prev = head->prev;
+	timer->next = head;
+	head->prev->next = timer;
+	head->prev = timer;
+}
+
+void TimerWheel::cascade(int level, int index){
+	Timer list;
+	Timer *head = &slots[level][index];
+	if(head->next == head){
+		return;
+	}
+	// detach the whole slot first, timers may be placed back into it
+	list.next = head->next;
+	list.prev = head->prev;
+	list.next->prev = &list;
+	list.prev->next = &list;
+	head->prev = head->next = head;
+
+	while(list.next != &list){
+		Timer *timer = list.next;
+		unlink(timer);
+		place(timer);
+	}
+}
+
+int TimerWheel::expire(int64_t now, std::vector<Timer *> *list){
+	int num = 0;
+	int64_t now_tick = now / resolution;
+	while(this->tick <= now_tick){
+		int index = this->tick & SLOT_MASK;
+		if(index == 0){
+			for(int level=1; level<LEVELS; level++){
+				int i = (this->tick >> (SLOT_BITS * level)) & SLOT_MASK;
+				cascade(level, i);
+				if(i != 0){
+					break;
+				}
+			}
+		}
+		Timer *head = &slots[0][index];
+		while(head->next != head){
+			Timer *timer = head->next;
+			unlink(timer);
+			count --;
+			list->push_back(timer);
+			num ++;
+		}
+		this->tick ++;
+	}
+	return num;
+}
+
+int TimerWheel::next_timeout(int64_t now) const{
+	if(count == 0){
+		return -1;
+	}
+	int64_t t = this->tick;
+	for(int i=0; i<SLOTS; i++, t++){
+		// the lower wheel wraps, timers may be cascaded down
+		if((t & SLOT_MASK) == 0){
+			break;
+		}
+		const Timer *head = &slots[0][t & SLOT_MASK];
+		if(head->next != head){
+			break;
+		}
+	}
+	int64_t ms = t * resolution - now;
+	if(ms < 0){
+		return 0;
+	}
+	return (int)ms;
+}
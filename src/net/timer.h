@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef NET_TIMER_H_
+#define NET_TIMER_H_
+
+#include "../include.h"
+#include <vector>
+
+// Embedded into the object it times, so that add and del cost O(1)
+// without any allocation.
+struct Timer
+{
+	Timer *prev;
+	Timer *next;
+	// absolute time in ms
+	int64_t expire;
+	int type;
+	void *data;
+
+	Timer(){
+		prev = next = NULL;
+		expire = 0;
+		type = 0;
+		data = NULL;
+	}
+	bool pending() const{
+		return next != NULL;
+	}
+};
+
+// Hierarchical timing wheel, with LEVELS wheels of SLOTS slots, each
+// slot of level n spans SLOTS^n ticks. Timers of a higher level are
+// cascaded down when the lower wheel wraps. Not thread safe, every
+// event loop owns its own wheel.
+class TimerWheel
+{
+public:
+	// resolution: ms per tick
+	TimerWheel(int resolution=10);
+	~TimerWheel();
+
+	// expire: absolute time in ms, a pending timer is rescheduled
+	void add(Timer *timer, int64_t expire);
+	// no-op if the timer is not pending
+	void del(Timer *timer);
+	// removes the timers expired by now(ms) and appends them to list
+	int expire(int64_t now, std::vector<Timer *> *list);
+	// ms until expire() has work to do, -1 if there are no timers
+	int next_timeout(int64_t now) const;
+	int size() const{
+		return count;
+	}
+
+private:
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 6;
+	static const int SLOTS = 1 << SLOT_BITS;
+	static const int SLOT_MASK = SLOTS - 1;
+
+	int resolution;
+	// the next tick to be processed
+	int64_t tick;
+	int count;
+	// list heads, circular
+	Timer slots[LEVELS][SLOTS];
+
+	void place(Timer *timer);
+	void cascade(int level, int index);
+	static void unlink(Timer *timer);
+};
+
+#endif
@@ -6,11 +6,16 @@ found in the LICENSE file.
 #include "worker.h"
 #include "link.h"
 #include "proc.h"
+#include "server.h"
 #include "../util/log.h"
 #include "../include.h"
 
+// max number of pipelined requests processed in one job
+#define MAX_BATCH_SIZE	128
+
 ProcWorker::ProcWorker(const std::string &name){
 	this->name = name;
+	this->latency = NULL;
 }
 
 void ProcWorker::init(){
@@ -18,21 +23,91 @@ void ProcWorker::init(){
 }
 
 int ProcWorker::proc(ProcJob *job){
-	const Request *req = job->req;
-	
-	proc_t p = job->cmd->proc;
-	job->time_wait = 1000 * (millitime() - job->stime);
-	job->result = (*p)(job->serv, job->link, *req, &job->resp);
-	job->time_proc = 1000 * (millitime() - job->stime) - job->time_wait;
-
-	if(job->link->send(job->resp.resp) == -1){
-		job->result = PROC_ERROR;
-	}else{
-		if(job->cmd->flags & Command::FLAG_READ){
-			int len = job->link->write();
-			if(len < 0){
-				job->result = PROC_ERROR;
-			}
+	NetworkServer *serv = job->serv;
+	Link *link = job->link;
+	int flags = job->cmd->flags;
+	ProcWorkerPool *pool = serv->worker_pool(job->cmd);
+	int num = 0;
+
+	if(this->latency == NULL){
+		std::vector<Histogram *> *hists = &serv->reader_latency;
+		if(this->name == "writer"){
+			hists = &serv->writer_latency;
+		}else if(this->name == "slow"){
+			hists = &serv->slow_latency;
+		}
+		if(this->id < (int)hists->size()){
+			this->latency = hists->at(this->id);
+		}
+	}
+
+	while(1){
+		const Request *req = job->req;
+		
+		proc_t p = job->cmd->proc;
+		job->time_wait = 1000 * (millitime() - job->stime);
+		if(num == 0 && job->timeout){
+			// the deadline is only set on the request dispatched by the loop
+			job->resp.push_back("error");
+			job->resp.push_back("request timeout");
+		}else{
+			job->result = (*p)(serv, link, *req, &job->resp);
+		}
+		if(job->result == PROC_BLOCK){
+			// answered by the event loop once woken up or timed out
+			break;
+		}
+		job->time_proc = 1000 * (millitime() - job->stime) - job->time_wait;
+
+		if(link->send(job->resp) == -1){
+			job->result = PROC_ERROR;
+		}
+		serv->stat_job(job);
+		if(this->latency){
+			this->latency->add((uint64_t)(job->time_proc * 1000));
+		}
+		if(job->result == PROC_ERROR || ++num >= MAX_BATCH_SIZE){
+			break;
+		}
+		// the loop pauses reading until the client catches up
+		if(link->output_over_soft()){
+			break;
+		}
+
+		// Pipelined requests already received are processed in this
+		// job, as long as they are meant to go to the same pool, the
+		// responses are written at once. The first request not
+		// processed here is put back and dispatched by the event loop.
+		req = link->recv();
+		if(req == NULL){
+			job->result = PROC_ERROR;
+			break;
+		}
+		if(req->empty()){
+			break;
+		}
+		if(serv->need_auth && link->auth == false){
+			link->unrecv();
+			break;
+		}
+		Command *cmd = serv->get_command(link, *req);
+		if(!cmd || !(cmd->flags & Command::FLAG_THREAD) || serv->worker_pool(cmd) != pool){
+			link->unrecv();
+			break;
+		}
+
+		link->active_time = millitime();
+		job->cmd = cmd;
+		job->req = req;
+		job->stime = link->active_time;
+		job->resp = Response();
+		job->resp.redis = link->redis_converted();
+	}
+
+	if(flags & Command::FLAG_READ){
+		int len = link->write();
+		if(len < 0){
+			job->result = PROC_ERROR;
 		}
 	}
 	return 0;
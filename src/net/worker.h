@@ -10,8 +10,10 @@ found in the LICENSE file.
 #include "../util/thread.h"
 #include "proc.h"
 
-// WARN: pipe latency is about 20 us, it is really slow!
 class ProcWorker : public WorkerPool<ProcWorker, ProcJob *>::Worker{
+private:
+	// this worker's entry in NetworkServer's reader/writer/slow_latency
+	Histogram *latency;
 public:
 	ProcWorker(const std::string &name);
 	~ProcWorker(){}
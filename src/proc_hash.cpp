@@ -107,6 +107,21 @@ int proc_multi_hget(NetworkServer *net, Link *link, const Request &req, Response
 	CHECK_NUM_PARAMS(3);
 	SSDBServer *serv = (SSDBServer *)net->data;
 
+	if(resp->redis){
+		// one bulk or nil for each field
+		resp->redis_begin_array();
+		for(int i=2; i<req.size(); i++){
+			std::string val;
+			int ret = serv->ssdb->hget(req[1], req[i], &val);
+			if(ret == 1){
+				resp->redis_bulk(val);
+			}else{
+				resp->redis_nil();
+			}
+		}
+		return 0;
+	}
+
 	resp->push_back("ok");
 	Request::const_iterator it=req.begin() + 1;
 	const Bytes name = *it;
@@ -117,7 +132,7 @@ int proc_multi_hget(NetworkServer *net, Link *link, const Request &req, Response
 		int ret = serv->ssdb->hget(name, key, &val);
 		if(ret == 1){
 			resp->push_back(key.String());
-			resp->push_back(val);
+			resp->push_back_swap(&val);
 		}
 	}
 	return 0;
@@ -166,7 +181,7 @@ int proc_hclear(NetworkServer *net, Link *link, const Request &req, Response *re
 	
 	const Bytes &name = req[1];
 	int64_t count = serv->ssdb->hclear(name);
-	resp->reply_int(0, count);
+	resp->reply_int(count == -1? -1 : 0, count);
 
 	return 0;
 }
@@ -176,10 +191,19 @@ int proc_hgetall(NetworkServer *net, Link *link, const Request &req, Response *r
 	SSDBServer *serv = (SSDBServer *)net->data;
 
 	HIterator *it = serv->ssdb->hscan(req[1], "", "", 2000000000);
+	if(resp->redis){
+		resp->redis_begin_array();
+		while(it->next()){
+			resp->redis_bulk(it->key);
+			resp->redis_bulk(it->val);
+		}
+		delete it;
+		return 0;
+	}
 	resp->push_back("ok");
 	while(it->next()){
-		resp->push_back(it->key);
-		resp->push_back(it->val);
+		resp->push_back_swap(&it->key);
+		resp->push_back_swap(&it->val);
 	}
 	delete it;
 	return 0;
@@ -61,13 +61,7 @@ int proc_setx(NetworkServer *net, Link *link, const Request &req, Response *resp
 	CHECK_KV_KEY_RANGE(1);
 
 	Locking l(&serv->expiration->mutex);
-	int ret;
-	ret = serv->ssdb->set(req[1], req[2]);
-	if(ret == -1){
-		resp->push_back("error");
-		return 0;
-	}
-	ret = serv->expiration->set_ttl(req[1], req[3].Int());
+	int ret = serv->expiration->setx(req[1], req[2], req[3].Int());
 	if(ret == -1){
 		resp->push_back("error");
 	}else{
@@ -94,18 +88,13 @@ int proc_expire(NetworkServer *net, Link *link, const Request &req, Response *re
 	CHECK_KV_KEY_RANGE(1);
 
 	Locking l(&serv->expiration->mutex);
-	std::string val;
-	int ret = serv->ssdb->get(req[1], &val);
-	if(ret == 1){
-		ret = serv->expiration->set_ttl(req[1], req[2].Int());
-		if(ret != -1){
-			resp->push_back("ok");
-			resp->push_back("1");
-			return 0;
-		}
+	int ret = serv->expiration->set_ttl(req[1], req[2].Int());
+	if(ret == -1){
+		resp->push_back("error");
+	}else{
+		resp->push_back("ok");
+		resp->push_back(str(ret));
 	}
-	resp->push_back("ok");
-	resp->push_back("0");
 	return 0;
 }
 
@@ -158,14 +147,10 @@ int proc_multi_del(NetworkServer *net, Link *link, const Request &req, Response
 	CHECK_NUM_PARAMS(2);
 
 	Locking l(&serv->expiration->mutex);
-	int ret = serv->ssdb->multi_del(req, 1);
+	int ret = serv->expiration->multi_del(req, 1);
 	if(ret == -1){
 		resp->push_back("error");
 	}else{
-		for(Request::const_iterator it=req.begin()+1; it!=req.end(); it++){
-			const Bytes key = *it;
-			serv->expiration->del_ttl(key);
-		}
 		resp->reply_int(0, ret);
 	}
 	return 0;
@@ -175,13 +160,28 @@ int proc_multi_get(NetworkServer *net, Link *link, const Request &req, Response
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(2);
 
+	if(resp->redis){
+		// one bulk or nil for each key
+		resp->redis_begin_array();
+		for(int i=1; i<req.size(); i++){
+			std::string val;
+			int ret = serv->ssdb->get(req[i], &val);
+			if(ret == 1){
+				resp->redis_bulk(val);
+			}else{
+				resp->redis_nil();
+			}
+		}
+		return 0;
+	}
+
 	resp->push_back("ok");
 	for(int i=1; i<req.size(); i++){
 		std::string val;
 		int ret = serv->ssdb->get(req[i], &val);
 		if(ret == 1){
 			resp->push_back(req[i].String());
-			resp->push_back(val);
+			resp->push_back_swap(&val);
 		}
 	}
 	return 0;
@@ -193,12 +193,10 @@ int proc_del(NetworkServer *net, Link *link, const Request &req, Response *resp)
 	CHECK_KV_KEY_RANGE(1);
 
 	Locking l(&serv->expiration->mutex);
-	int ret = serv->ssdb->del(req[1]);
+	int ret = serv->expiration->del(req[1]);
 	if(ret == -1){
 		resp->push_back("error");
 	}else{
-		serv->expiration->del_ttl(req[1]);
-			
 		resp->push_back("ok");
 		resp->push_back("1");
 	}
@@ -45,22 +45,17 @@ int proc_qpush_func(NetworkServer *net, Link *link, const Request &req, Response
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(3);
 
-	int64_t size = 0;
-	std::vector<Bytes>::const_iterator it;
-	it = req.begin() + 2;
-	for(; it != req.end(); it += 1){
-		const Bytes &item = *it;
-		if(front_or_back == QFRONT){
-			size = serv->ssdb->qpush_front(req[1], item);
-		}else{
-			size = serv->ssdb->qpush_back(req[1], item);
-		}
-		if(size == -1){
-			resp->push_back("error");
-			return 0;
-		}
+	int64_t size;
+	std::vector<Bytes> items(req.begin() + 2, req.end());
+	if(front_or_back == QFRONT){
+		size = serv->ssdb->qpush_front(req[1], items);
+	}else{
+		size = serv->ssdb->qpush_back(req[1], items);
 	}
-	resp->reply_int(0, size);
+	if(size != -1){
+		net->wake(req[1], (int)items.size());
+	}
+	resp->reply_int(size, size);
 	return 0;
 }
 
@@ -98,19 +93,14 @@ int proc_qpop_func(NetworkServer *net, Link *link, const Request &req, Response
 		}
 		resp->reply_get(ret, &item);
 	}else{
-		resp->push_back("ok");
-		while(size-- > 0){
-			if(front_or_back == QFRONT){
-				ret = serv->ssdb->qpop_front(req[1], &item);
-			}else{
-				ret = serv->ssdb->qpop_back(req[1], &item);
-			}
-			if(ret <= 0){
-				break;
-			}else{
-				resp->push_back(item);
-			}
+		std::vector<std::string> items;
+		int64_t count;
+		if(front_or_back == QFRONT){
+			count = serv->ssdb->qpop_front(req[1], size, &items);
+		}else{
+			count = serv->ssdb->qpop_back(req[1], size, &items);
 		}
+		resp->reply_list(count == -1? -1 : 0, items);
 	}
 
 	return 0;
@@ -128,6 +118,48 @@ int proc_qpop(NetworkServer *net, Link *link, const Request &req, Response *resp
 	return proc_qpop_func(net, link, req, resp, QFRONT);
 }
 
+// bqpop_front name timeout, timeout in seconds, 0 means forever
+static inline
+int proc_bqpop_func(NetworkServer *net, Link *link, const Request &req, Response *resp, int front_or_back){
+	SSDBServer *serv = (SSDBServer *)net->data;
+	CHECK_NUM_PARAMS(3);
+
+	double timeout = req[2].Double();
+	if(timeout < 0){
+		resp->push_back("client_error");
+		resp->push_back("invalid timeout");
+		return 0;
+	}
+	uint64_t epoch = net->wake_epoch(req[1]);
+	int ret;
+	std::string item;
+	if(front_or_back == QFRONT){
+		ret = serv->ssdb->qpop_front(req[1], &item);
+	}else{
+		ret = serv->ssdb->qpop_back(req[1], &item);
+	}
+	if(ret != 0){
+		resp->reply_get(ret, &item);
+		return 0;
+	}
+	// processed again when items are pushed
+	link->block_key = req[1].String();
+	link->block_timeout = (int64_t)(timeout * 1000);
+	if(timeout > 0 && link->block_timeout == 0){
+		link->block_timeout = 1;
+	}
+	link->block_epoch = epoch;
+	return PROC_BLOCK;
+}
+
+int proc_bqpop_front(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	return proc_bqpop_func(net, link, req, resp, QFRONT);
+}
+
+int proc_bqpop_back(NetworkServer *net, Link *link, const Request &req, Response *resp){
+	return proc_bqpop_func(net, link, req, resp, QBACK);
+}
+
 static inline
 int proc_qtrim_func(NetworkServer *net, Link *link, const Request &req, Response *resp, int front_or_back){
 	SSDBServer *serv = (SSDBServer *)net->data;
@@ -138,20 +170,14 @@ int proc_qtrim_func(NetworkServer *net, Link *link, const Request &req, Response
 		size = req[2].Uint64();
 	}
 		
-	int count = 0;
-	for(; count<size; count++){
-		int ret;
-		std::string item;
-		if(front_or_back == QFRONT){
-			ret = serv->ssdb->qpop_front(req[1], &item);
-		}else{
-			ret = serv->ssdb->qpop_back(req[1], &item);
-		}
-		if(ret <= 0){
-			break;
-		}
+	std::vector<std::string> items;
+	int64_t count;
+	if(front_or_back == QFRONT){
+		count = serv->ssdb->qpop_front(req[1], size, &items);
+	}else{
+		count = serv->ssdb->qpop_back(req[1], size, &items);
 	}
-	resp->reply_int(0, count);
+	resp->reply_int(count == -1? -1 : 0, count);
 
 	return 0;
 }
@@ -203,19 +229,8 @@ int proc_qclear(NetworkServer *net, Link *link, const Request &req, Response *re
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(2);
 
-	int64_t count = 0;
-	while(1){
-		std::string item;
-		int ret = serv->ssdb->qpop_front(req[1], &item);
-		if(ret == 0){
-			break;
-		}
-		if(ret == -1){
-			return -1;
-		}
-		count += 1;
-	}
-	resp->reply_int(0, count);
+	int64_t count = serv->ssdb->qclear(req[1]);
+	resp->reply_int(count == -1? -1 : 0, count);
 	return 0;
 }
 
@@ -193,6 +193,19 @@ int proc_zrange(NetworkServer *net, Link *link, const Request &req, Response *re
 	uint64_t offset = req[2].Uint64();
 	uint64_t limit = req[3].Uint64();
 	ZIterator *it = serv->ssdb->zrange(req[1], offset, limit);
+	if(resp->redis){
+		// scores are returned only if asked
+		bool withscores = req.size() > 4 && req[4] == "withscores";
+		resp->redis_begin_array();
+		while(it->next()){
+			resp->redis_bulk(it->key);
+			if(withscores){
+				resp->redis_bulk(it->score);
+			}
+		}
+		delete it;
+		return 0;
+	}
 	resp->push_back("ok");
 	while(it->next()){
 		resp->push_back(it->key);
@@ -209,6 +222,19 @@ int proc_zrrange(NetworkServer *net, Link *link, const Request &req, Response *r
 	uint64_t offset = req[2].Uint64();
 	uint64_t limit = req[3].Uint64();
 	ZIterator *it = serv->ssdb->zrrange(req[1], offset, limit);
+	if(resp->redis){
+		// scores are returned only if asked
+		bool withscores = req.size() > 4 && req[4] == "withscores";
+		resp->redis_begin_array();
+		while(it->next()){
+			resp->redis_bulk(it->key);
+			if(withscores){
+				resp->redis_bulk(it->score);
+			}
+		}
+		delete it;
+		return 0;
+	}
 	resp->push_back("ok");
 	while(it->next()){
 		resp->push_back(it->key);
@@ -223,30 +249,8 @@ int proc_zclear(NetworkServer *net, Link *link, const Request &req, Response *re
 	CHECK_NUM_PARAMS(2);
 	
 	const Bytes &name = req[1];
-	int64_t count = 0;
-	std::string key_start, score_start;
-	while(1){
-		ZIterator *it = serv->ssdb->zscan(name, key_start, score_start, "", 1000);
-		int num = 0;
-		while(it->next()){
-			key_start = it->key;
-			score_start = it->score;
-			int ret = serv->ssdb->zdel(name, key_start);
-			if(ret == -1){
-				resp->push_back("error");
-				delete it;
-				return 0;
-			}
-			num ++;
-		};
-		delete it;
-		
-		if(num == 0){
-			break;
-		}
-		count += num;
-	}
-	resp->reply_int(0, count);
+	int64_t count = serv->ssdb->zclear(name);
+	resp->reply_int(count == -1? -1 : 0, count);
 
 	return 0;
 }
@@ -361,14 +365,9 @@ int proc_zcount(NetworkServer *net, Link *link, const Request &req, Response *re
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(4);
 
-	int64_t count = 0;
-	ZIterator *it = serv->ssdb->zscan(req[1], "", req[2], req[3], -1);
-	while(it->next()){
-		count ++;
-	}
-	delete it;
-	
-	resp->reply_int(0, count);
+	int64_t count, sum;
+	int ret = serv->ssdb->zaggregate(req[1], req[2], req[3], &count, &sum);
+	resp->reply_int(ret, count);
 	return 0;
 }
 
@@ -376,14 +375,9 @@ int proc_zsum(NetworkServer *net, Link *link, const Request &req, Response *resp
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(4);
 
-	int64_t sum = 0;
-	ZIterator *it = serv->ssdb->zscan(req[1], "", req[2], req[3], -1);
-	while(it->next()){
-		sum += str_to_int64(it->score);
-	}
-	delete it;
-	
-	resp->reply_int(0, sum);
+	int64_t count, sum;
+	int ret = serv->ssdb->zaggregate(req[1], req[2], req[3], &count, &sum);
+	resp->reply_int(ret, sum);
 	return 0;
 }
 
@@ -391,14 +385,12 @@ int proc_zavg(NetworkServer *net, Link *link, const Request &req, Response *resp
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(4);
 
-	int64_t sum = 0;
-	int64_t count = 0;
-	ZIterator *it = serv->ssdb->zscan(req[1], "", req[2], req[3], -1);
-	while(it->next()){
-		sum += str_to_int64(it->score);
-		count ++;
+	int64_t count, sum;
+	int ret = serv->ssdb->zaggregate(req[1], req[2], req[3], &count, &sum);
+	if(ret == -1){
+		resp->push_back("error");
+		return 0;
 	}
-	delete it;
 	double avg = (double)sum/count;
 	
 	resp->push_back("ok");
@@ -410,20 +402,8 @@ int proc_zremrangebyscore(NetworkServer *net, Link *link, const Request &req, Re
 	SSDBServer *serv = (SSDBServer *)net->data;
 	CHECK_NUM_PARAMS(4);
 
-	ZIterator *it = serv->ssdb->zscan(req[1], "", req[2], req[3], -1);
-	int64_t count = 0;
-	while(it->next()){
-		count ++;
-		int ret = serv->ssdb->zdel(req[1], it->key);
-		if(ret == -1){
-			delete it;
-			resp->push_back("error");
-			return 0;
-		}
-	}
-	delete it;
-	
-	resp->reply_int(0, count);
+	int64_t count = serv->ssdb->zdel_range(req[1], req[2], "", req[3], "", UINT64_MAX);
+	resp->reply_int(count == -1? -1 : 0, count);
 	return 0;
 }
 
@@ -433,20 +413,19 @@ int proc_zremrangebyrank(NetworkServer *net, Link *link, const Request &req, Res
 
 	uint64_t start = req[2].Uint64();
 	uint64_t end = req[3].Uint64();
-	ZIterator *it = serv->ssdb->zrange(req[1], start, end - start + 1);
-	int64_t count = 0;
-	while(it->next()){
-		count ++;
-		int ret = serv->ssdb->zdel(req[1], it->key);
-		if(ret == -1){
-			resp->push_back("error");
-			delete it;
-			return 0;
-		}
+	// the range starts at the item of rank start
+	ZIterator *it = serv->ssdb->zrange(req[1], start, 1);
+	if(!it->next()){
+		delete it;
+		resp->reply_int(0, 0);
+		return 0;
 	}
+	std::string key = it->key;
+	std::string score = it->score;
 	delete it;
-	
-	resp->reply_int(0, count);
+
+	int64_t count = serv->ssdb->zdel_range(req[1], score, key, "", "", end - start + 1);
+	resp->reply_int(count == -1? -1 : 0, count);
 	return 0;
 }
 
@@ -98,6 +98,8 @@ DEF_PROC(qpush_back);
 DEF_PROC(qpop);
 DEF_PROC(qpop_front);
 DEF_PROC(qpop_back);
+DEF_PROC(bqpop_front);
+DEF_PROC(bqpop_back);
 DEF_PROC(qtrim_front);
 DEF_PROC(qtrim_back);
 DEF_PROC(qfix);
@@ -160,10 +162,10 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(bitcount, "rt");
 	REG_PROC(incr, "wt");
 	REG_PROC(decr, "wt");
-	REG_PROC(scan, "rt");
-	REG_PROC(rscan, "rt");
-	REG_PROC(keys, "rt");
-	REG_PROC(rkeys, "rt");
+	REG_PROC(scan, "rts");
+	REG_PROC(rscan, "rts");
+	REG_PROC(keys, "rts");
+	REG_PROC(rkeys, "rts");
 	REG_PROC(exists, "rt");
 	REG_PROC(multi_exists, "rt");
 	REG_PROC(multi_get, "rt");
@@ -179,13 +181,13 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(hincr, "wt");
 	REG_PROC(hdecr, "wt");
 	REG_PROC(hclear, "wt");
-	REG_PROC(hgetall, "rt");
-	REG_PROC(hscan, "rt");
-	REG_PROC(hrscan, "rt");
-	REG_PROC(hkeys, "rt");
-	REG_PROC(hvals, "rt");
-	REG_PROC(hlist, "rt");
-	REG_PROC(hrlist, "rt");
+	REG_PROC(hgetall, "rts");
+	REG_PROC(hscan, "rts");
+	REG_PROC(hrscan, "rts");
+	REG_PROC(hkeys, "rts");
+	REG_PROC(hvals, "rts");
+	REG_PROC(hlist, "rts");
+	REG_PROC(hrlist, "rts");
 	REG_PROC(hexists, "rt");
 	REG_PROC(multi_hexists, "rt");
 	REG_PROC(multi_hsize, "rt");
@@ -194,10 +196,10 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(multi_hdel, "wt");
 
 	// because zrank may be extremly slow, execute in a seperate thread
-	REG_PROC(zrank, "rt");
-	REG_PROC(zrrank, "rt");
-	REG_PROC(zrange, "rt");
-	REG_PROC(zrrange, "rt");
+	REG_PROC(zrank, "rts");
+	REG_PROC(zrrank, "rts");
+	REG_PROC(zrange, "rts");
+	REG_PROC(zrrange, "rts");
 	REG_PROC(zsize, "rt");
 	REG_PROC(zget, "rt");
 	REG_PROC(zset, "wt");
@@ -206,14 +208,14 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(zdecr, "wt");
 	REG_PROC(zclear, "wt");
 	REG_PROC(zfix, "wt");
-	REG_PROC(zscan, "rt");
-	REG_PROC(zrscan, "rt");
-	REG_PROC(zkeys, "rt");
-	REG_PROC(zlist, "rt");
-	REG_PROC(zrlist, "rt");
-	REG_PROC(zcount, "rt");
-	REG_PROC(zsum, "rt");
-	REG_PROC(zavg, "rt");
+	REG_PROC(zscan, "rts");
+	REG_PROC(zrscan, "rts");
+	REG_PROC(zkeys, "rts");
+	REG_PROC(zlist, "rts");
+	REG_PROC(zrlist, "rts");
+	REG_PROC(zcount, "rts");
+	REG_PROC(zsum, "rts");
+	REG_PROC(zavg, "rts");
 	REG_PROC(zremrangebyrank, "wt");
 	REG_PROC(zremrangebyscore, "wt");
 	REG_PROC(zexists, "rt");
@@ -234,14 +236,16 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(qpop, "wt");
 	REG_PROC(qpop_front, "wt");
 	REG_PROC(qpop_back, "wt");
+	REG_PROC(bqpop_front, "wt");
+	REG_PROC(bqpop_back, "wt");
 	REG_PROC(qtrim_front, "wt");
 	REG_PROC(qtrim_back, "wt");
 	REG_PROC(qfix, "wt");
 	REG_PROC(qclear, "wt");
-	REG_PROC(qlist, "rt");
-	REG_PROC(qrlist, "rt");
-	REG_PROC(qslice, "rt");
-	REG_PROC(qrange, "rt");
+	REG_PROC(qlist, "rts");
+	REG_PROC(qrlist, "rts");
+	REG_PROC(qslice, "rts");
+	REG_PROC(qrange, "rts");
 	REG_PROC(qget, "rt");
 	REG_PROC(qset, "wt");
 
@@ -252,10 +256,10 @@ void SSDBServer::reg_procs(NetworkServer *net){
 	REG_PROC(sync140, "b");
 	REG_PROC(info, "r");
 	REG_PROC(version, "r");
-	REG_PROC(dbsize, "rt");
+	REG_PROC(dbsize, "rts");
 	// doing compaction in a reader thread, because we have only one
 	// writer thread(for performance reason); we don't want to block writes
-	REG_PROC(compact, "rt");
+	REG_PROC(compact, "rts");
 
 	REG_PROC(ignore_key_range, "r");
 	REG_PROC(get_key_range, "r");
@@ -384,6 +388,7 @@ int SSDBServer::set_kv_range(const std::string &start, const std::string &end){
 		return -1;
 	}
 
+	Locking l(&kv_range_mutex);
 	kv_range_s = start;
 	kv_range_e = end;
 	return 0;
@@ -400,6 +405,7 @@ int SSDBServer::get_kv_range(std::string *start, std::string *end){
 }
 
 bool SSDBServer::in_kv_range(const Bytes &key){
+	Locking l(&kv_range_mutex);
 	if((this->kv_range_s.size() && this->kv_range_s >= key)
 		|| (this->kv_range_e.size() && this->kv_range_e < key))
 	{
@@ -409,6 +415,7 @@ bool SSDBServer::in_kv_range(const Bytes &key){
 }
 
 bool SSDBServer::in_kv_range(const std::string &key){
+	Locking l(&kv_range_mutex);
 	if((this->kv_range_s.size() && this->kv_range_s >= key)
 		|| (this->kv_range_e.size() && this->kv_range_e < key))
 	{
@@ -440,12 +447,14 @@ int proc_flushdb(NetworkServer *net, Link *link, const Request &req, Response *r
 
 int proc_dump(NetworkServer *net, Link *link, const Request &req, Response *resp){
 	SSDBServer *serv = (SSDBServer *)net->data;
+	net->set_client_class(link, NetworkServer::CLIENT_REPLICATION);
 	serv->backend_dump->proc(link);
 	return PROC_BACKEND;
 }
 
 int proc_sync140(NetworkServer *net, Link *link, const Request &req, Response *resp){
 	SSDBServer *serv = (SSDBServer *)net->data;
+	net->set_client_class(link, NetworkServer::CLIENT_REPLICATION);
 	serv->backend_sync->proc(link);
 	return PROC_BACKEND;
 }
@@ -459,6 +468,8 @@ int proc_compact(NetworkServer *net, Link *link, const Request &req, Response *r
 
 int proc_ignore_key_range(NetworkServer *net, Link *link, const Request &req, Response *resp){
 	link->ignore_key_range = true;
+	// only used by data migration
+	net->set_client_class(link, NetworkServer::CLIENT_MIGRATION);
 	resp->push_back("ok");
 	return 0;
 }
@@ -528,6 +539,15 @@ int proc_info(NetworkServer *net, Link *link, const Request &req, Response *resp
 		resp->push_back("links");
 		resp->add(net->link_count);
 	}
+	{
+		resp->push_back("blocked");
+		resp->add(net->num_blocked);
+	}
+	for(int i=0; i<NetworkServer::CLIENT_CLASSES; i++){
+		const OutputLimit *limit = &net->output_limits[i];
+		resp->push_back(std::string("output_limit.") + limit->name);
+		resp->push_back(limit->stats());
+	}
 	{
 		int64_t calls = 0;
 		proc_map_t::iterator it;
@@ -550,6 +570,11 @@ int proc_info(NetworkServer *net, Link *link, const Request &req, Response *resp
 		resp->push_back("binlogs");
 		resp->push_back(s);
 	}
+	{
+		std::string s = serv->expiration->stats();
+		resp->push_back("expiration");
+		resp->push_back(s);
+	}
 	{
 		std::vector<std::string> syncs = serv->backend_sync->stats();
 		std::vector<std::string>::iterator it;
@@ -644,9 +669,12 @@ int proc_info(NetworkServer *net, Link *link, const Request &req, Response *resp
 		for(it=net->proc_map.begin(); it!=net->proc_map.end(); it++){
 			Command *cmd = it->second;
 			resp->push_back("cmd." + cmd->name);
-			char buf[128];
-			snprintf(buf, sizeof(buf), "calls: %" PRIu64 "\ttime_wait: %.0f\ttime_proc: %.0f",
-				cmd->calls, cmd->time_wait, cmd->time_proc);
+			char buf[256];
+			snprintf(buf, sizeof(buf), "calls: %" PRIu64 "\ttime_wait: %.0f\ttime_proc: %.0f"
+				"\tp50: %" PRIu64 "\tp99: %" PRIu64 "\tmax: %" PRIu64,
+				cmd->calls, cmd->time_wait.sum()/1000.0, cmd->time_proc.sum()/1000.0,
+				cmd->time_total.percentile(50), cmd->time_total.percentile(99),
+				cmd->time_total.max());
 			resp->push_back(buf);
 		}
 	}
@@ -24,6 +24,9 @@ class SSDBServer
 private:
 	void reg_procs(NetworkServer *net);
 	
+	// set_kv_range may run in any network loop, while the requests of
+	// the other loops check their keys against the range
+	Mutex kv_range_mutex;
 	std::string kv_range_s;
 	std::string kv_range_e;
 	
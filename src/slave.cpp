@@ -183,7 +183,7 @@ int Slave::connect(){
 				}
 			}
 			
-			link->send("sync140", str(this->last_seq), this->last_key, type);
+			link->send("sync140", str(this->last_seq), this->last_key, type, str(SSDB_SYNC_VERSION));
 			if(link->flush() == -1){
 				log_error("[%s] network error", this->id_.c_str());
 				delete link;
@@ -378,8 +378,18 @@ int Slave::proc_sync(const Binlog &log, const std::vector<Bytes> &req){
 						break;
 					}
 				}
+				// the value is sent with the expiration header, if any
+				int64_t expire;
+				int n = decode_kv_header(req[1], &expire);
+				Bytes val(req[1].data() + n, req[1].size() - n);
 				log_trace("set %s", hexmem(key.data(), key.size()).c_str());
-				if(ssdb->set(key, req[1], log_type) == -1){
+				int ret;
+				if(expire > 0){
+					ret = ssdb->setx(key, val, expire, log_type);
+				}else{
+					ret = ssdb->set(key, val, log_type);
+				}
+				if(ret == -1){
 					return -1;
 				}
 			}
@@ -403,6 +413,18 @@ int Slave::proc_sync(const Binlog &log, const std::vector<Bytes> &req){
 				}
 			}
 			break;
+		case BinlogCommand::KDEL_EXPIRED:
+			{
+				std::vector<std::string> keys;
+				if(decode_expired_log(log.key(), &keys) == -1){
+					break;
+				}
+				log_trace("del_expired %d keys", (int)keys.size());
+				if(ssdb->del_expired(keys, std::vector<int64_t>(), INT64_MAX, log_type) == -1){
+					return -1;
+				}
+			}
+			break;
 		case BinlogCommand::HSET:
 			{
 				if(req.size() != 2){
@@ -465,6 +487,22 @@ int Slave::proc_sync(const Binlog &log, const std::vector<Bytes> &req){
 				}
 			}
 			break;
+		case BinlogCommand::ZDEL_RANGE:
+			{
+				std::string name, score_start, key_start, score_end, key_end;
+				if(decode_zdel_range_log(log.key(), &name,
+						&score_start, &key_start, &score_end, &key_end) == -1){
+					break;
+				}
+				log_trace("zdel_range %s %s %s",
+					hexmem(name.data(), name.size()).c_str(),
+					score_start.c_str(), score_end.c_str());
+				if(ssdb->zdel_range(name, score_start, key_start,
+						score_end, key_end, UINT64_MAX, log_type) == -1){
+					return -1;
+				}
+			}
+			break;
 		case BinlogCommand::QSET:
 		case BinlogCommand::QPUSH_BACK:
 		case BinlogCommand::QPUSH_FRONT:
@@ -514,6 +552,27 @@ int Slave::proc_sync(const Binlog &log, const std::vector<Bytes> &req){
 				}
 			}
 			break;
+		case BinlogCommand::HCLEAR:
+		case BinlogCommand::ZCLEAR:
+		case BinlogCommand::QCLEAR:
+			{
+				int64_t ret;
+				const Bytes name = log.key();
+				if(log.cmd() == BinlogCommand::HCLEAR){
+					log_trace("hclear %s", hexmem(name.data(), name.size()).c_str());
+					ret = ssdb->hclear(name, log_type);
+				}else if(log.cmd() == BinlogCommand::ZCLEAR){
+					log_trace("zclear %s", hexmem(name.data(), name.size()).c_str());
+					ret = ssdb->zclear(name, log_type);
+				}else{
+					log_trace("qclear %s", hexmem(name.data(), name.size()).c_str());
+					ret = ssdb->qclear(name, log_type);
+				}
+				if(ret == -1){
+					return -1;
+				}
+			}
+			break;
 		default:
 			log_error("unknown binlog, type=%d, cmd=%d", log.type(), log.cmd());
 			break;
@@ -9,6 +9,7 @@ found in the LICENSE file.
 #include "../util/log.h"
 #include "../util/strings.h"
 #include <map>
+#include <algorithm>
 
 /* Binlog */
 
@@ -125,6 +126,21 @@ std::string Binlog::dumps() const{
 		case BinlogCommand::QSET:
 			str.append("qset ");
 			break;
+		case BinlogCommand::HCLEAR:
+			str.append("hclear ");
+			break;
+		case BinlogCommand::ZCLEAR:
+			str.append("zclear ");
+			break;
+		case BinlogCommand::QCLEAR:
+			str.append("qclear ");
+			break;
+		case BinlogCommand::ZDEL_RANGE:
+			str.append("zdel_range ");
+			break;
+		case BinlogCommand::KDEL_EXPIRED:
+			str.append("del_expired ");
+			break;
 	}
 	Bytes b = this->key();
 	str.append(hexmem(b.data(), b.size()));
@@ -155,9 +171,25 @@ BinlogQueue::BinlogQueue(leveldb::DB *db, bool enabled, int capacity){
 	this->db = db;
 	this->min_seq = 0;
 	this->last_seq = 0;
-	this->tran_seq = 0;
 	this->capacity = capacity;
 	this->enabled = enabled;
+	this->commit_writes = 0;
+	this->commit_trans = 0;
+	this->fsync_interval = -1;
+	this->synced_writes = 0;
+	this->fsyncs = 0;
+	this->fsync_quit = false;
+	pthread_key_create(&tran_key, free_tran);
+	// the keyed transactions keep taking the read side, with the default
+	// reader preference, a flushdb could wait for the write side forever
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+#ifdef __linux__
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&tran_lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+	pthread_mutex_init(&commit_mutex, NULL);
 	
 	Binlog log;
 	if(this->find_last(&log) == 1){
@@ -196,6 +228,12 @@ BinlogQueue::BinlogQueue(leveldb::DB *db, bool enabled, int capacity){
 }
 
 BinlogQueue::~BinlogQueue(){
+	if(this->fsync_interval > 0){
+		fsync_quit = true;
+		pthread_join(fsync_tid, NULL);
+		// the last commits
+		this->sync_log();
+	}
 	if(this->enabled){
 		thread_quit = true;
 		for(int i=0; i<100; i++){
@@ -206,32 +244,197 @@ BinlogQueue::~BinlogQueue(){
 		}
 	}
 	db = NULL;
+	// Tran of the calling thread only, the others are leaked
+	free_tran(pthread_getspecific(tran_key));
+	pthread_key_delete(tran_key);
+	pthread_rwlock_destroy(&tran_lock);
+	pthread_mutex_destroy(&commit_mutex);
 }
 
 std::string BinlogQueue::stats() const{
 	std::string s;
 	s.append("    capacity : " + str(capacity) + "\n");
 	s.append("    min_seq  : " + str(min_seq) + "\n");
-	s.append("    max_seq  : " + str(last_seq) + "");
+	s.append("    max_seq  : " + str(last_seq) + "\n");
+	s.append("    commits  : " + str(commit_trans) + " in " + str(commit_writes) + " writes\n");
+	s.append("    ack_latency : " + ack_latency.stats() + "\n");
+	if(fsync_interval < 0){
+		s.append("    fsync    : no");
+	}else{
+		if(fsync_interval == 0){
+			s.append("    fsync    : always, ");
+		}else{
+			s.append("    fsync    : every " + str(fsync_interval) + " ms, ");
+		}
+		s.append(str(fsyncs) + " fsyncs\n");
+		s.append("    fsync_latency : " + fsync_latency.stats());
+	}
 	return s;
 }
 
+void BinlogQueue::set_fsync(int interval){
+	if(this->fsync_interval > 0){
+		return;
+	}
+	this->fsync_interval = interval;
+	if(interval > 0){
+		int err = pthread_create(&fsync_tid, NULL, &BinlogQueue::fsync_thread_func, this);
+		if(err != 0){
+			log_fatal("can't create thread: %s", strerror(err));
+			exit(0);
+		}
+	}
+	log_info("fsync: %s", interval < 0? "no" : interval == 0? "always" : (str(interval) + " ms").c_str());
+}
+
+// An empty batch written with sync=true fsyncs the leveldb log, and
+// makes durable all the writes made before it.
+int BinlogQueue::sync_log(){
+	uint64_t writes = commit_writes;
+	if(writes == synced_writes){
+		return 0;
+	}
+	double stime = millitime();
+	leveldb::WriteOptions write_opts;
+	write_opts.sync = true;
+	leveldb::WriteBatch batch;
+	leveldb::Status s = db->Write(write_opts, &batch);
+	if(!s.ok()){
+		log_error("fsync error: %s", s.ToString().c_str());
+		return -1;
+	}
+	fsync_latency.add((uint64_t)((millitime() - stime) * 1000000));
+	synced_writes = writes;
+	fsyncs ++;
+	return 1;
+}
+
+void* BinlogQueue::fsync_thread_func(void *arg){
+	BinlogQueue *logs = (BinlogQueue *)arg;
+	int slept = 0;
+	while(!logs->fsync_quit){
+		// wake up often enough to quit quickly
+		int ms = std::min(logs->fsync_interval - slept, 50);
+		usleep(ms * 1000);
+		slept += ms;
+		if(slept >= logs->fsync_interval){
+			slept = 0;
+			logs->sync_log();
+		}
+	}
+	log_debug("binlog fsync_thread quit");
+	return (void *)NULL;
+}
+
+BinlogQueue::Tran* BinlogQueue::tran(){
+	Tran *t = (Tran *)pthread_getspecific(tran_key);
+	if(t == NULL){
+		t = new Tran();
+		pthread_setspecific(tran_key, t);
+	}
+	return t;
+}
+
+void BinlogQueue::free_tran(void *tran){
+	delete (Tran *)tran;
+}
+
+int BinlogQueue::stripe(const Bytes &key){
+	uint32_t h = 2166136261U;
+	for(int i=0; i<key.size(); i++){
+		h = (h ^ (unsigned char)key.data()[i]) * 16777619U;
+	}
+	return (int)(h % LOCK_STRIPES);
+}
+
 void BinlogQueue::begin(){
-	tran_seq = last_seq;
-	batch.Clear();
+	Tran *t = tran();
+	t->batch.Clear();
+	t->logs.clear();
 }
 
 void BinlogQueue::rollback(){
-	tran_seq = 0;
+	begin();
 }
 
+// Like leveldb's own group commit, but the binlogs of the group must be
+// given their seqs in the order they are written.
 leveldb::Status BinlogQueue::commit(){
+	double stime = millitime();
+	Writer w;
+	w.tran = tran();
+	w.done = false;
+	pthread_cond_init(&w.cond, NULL);
+
+	pthread_mutex_lock(&commit_mutex);
+	writers.push_back(&w);
+	while(!w.done && &w != writers.front()){
+		pthread_cond_wait(&w.cond, &commit_mutex);
+	}
+	if(w.done){
+		pthread_mutex_unlock(&commit_mutex);
+		pthread_cond_destroy(&w.cond);
+		ack_latency.add((uint64_t)((millitime() - stime) * 1000000));
+		return w.status;
+	}
+
+	// w is the leader, only the leader writes and updates last_seq
+	std::vector<Writer *> group;
+	size_t bytes = 0;
+	std::deque<Writer *>::iterator it;
+	for(it=writers.begin(); it!=writers.end(); it++){
+		if(group.size() >= MAX_GROUP_SIZE || bytes >= MAX_GROUP_BYTES){
+			break;
+		}
+		group.push_back(*it);
+		bytes += (*it)->tran->batch.ApproximateSize();
+	}
+	pthread_mutex_unlock(&commit_mutex);
+
+	leveldb::WriteBatch *batch = &w.tran->batch;
+	for(int i=1; i<(int)group.size(); i++){
+		batch->Append(group[i]->tran->batch);
+	}
+	uint64_t seq = last_seq;
+	for(int i=0; i<(int)group.size(); i++){
+		std::vector<std::string> *logs = &group[i]->tran->logs;
+		for(int j=0; j<(int)logs->size(); j++){
+			std::string *log = &logs->at(j);
+			seq ++;
+			memcpy(&(*log)[0], &seq, sizeof(uint64_t));
+			batch->Put(encode_seq_key(seq), *log);
+		}
+	}
 	leveldb::WriteOptions write_opts;
-	leveldb::Status s = db->Write(write_opts, &batch);
+	write_opts.sync = (fsync_interval == 0);
+	double wtime = millitime();
+	leveldb::Status s = db->Write(write_opts, batch);
+
+	pthread_mutex_lock(&commit_mutex);
 	if(s.ok()){
-		last_seq = tran_seq;
-		tran_seq = 0;
+		last_seq = seq;
+		if(write_opts.sync){
+			fsync_latency.add((uint64_t)((millitime() - wtime) * 1000000));
+			fsyncs ++;
+		}
+	}
+	commit_writes ++;
+	commit_trans += group.size();
+	for(int i=0; i<(int)group.size(); i++){
+		Writer *g = writers.front();
+		writers.pop_front();
+		if(g != &w){
+			g->status = s;
+			g->done = true;
+			pthread_cond_signal(&g->cond);
+		}
+	}
+	if(!writers.empty()){
+		pthread_cond_signal(&writers.front()->cond);
 	}
+	pthread_mutex_unlock(&commit_mutex);
+	pthread_cond_destroy(&w.cond);
+	ack_latency.add((uint64_t)((millitime() - stime) * 1000000));
 	return s;
 }
 
@@ -239,9 +442,9 @@ void BinlogQueue::add_log(char type, char cmd, const leveldb::Slice &key){
 	if(!enabled){
 		return;
 	}
-	tran_seq ++;
-	Binlog log(tran_seq, type, cmd, key);
-	batch.Put(encode_seq_key(tran_seq), log.repr());
+	// seq is filled in by commit()
+	Binlog log(0, type, cmd, key);
+	tran()->logs.push_back(log.repr());
 }
 
 void BinlogQueue::add_log(char type, char cmd, const std::string &key){
@@ -254,12 +457,12 @@ void BinlogQueue::add_log(char type, char cmd, const std::string &key){
 
 // leveldb put
 void BinlogQueue::Put(const leveldb::Slice& key, const leveldb::Slice& value){
-	batch.Put(key, value);
+	tran()->batch.Put(key, value);
 }
 
 // leveldb delete
 void BinlogQueue::Delete(const leveldb::Slice& key){
-	batch.Delete(key);
+	tran()->batch.Delete(key);
 }
 	
 int BinlogQueue::find_next(uint64_t next_seq, Binlog *log) const{
@@ -444,3 +647,52 @@ void BinlogQueue::merge(){
 	}
 	log_trace("merge reduce %d of %d binlogs", reduce_count, total);
 }
+
+
+/* Transaction */
+
+Transaction::Transaction(BinlogQueue *logs){
+	this->logs = logs;
+	this->lock();
+}
+
+Transaction::Transaction(BinlogQueue *logs, const Bytes &key){
+	this->logs = logs;
+	stripes.push_back(BinlogQueue::stripe(key));
+	this->lock();
+}
+
+Transaction::Transaction(BinlogQueue *logs, const std::vector<Bytes> &keys, int offset, int step){
+	this->logs = logs;
+	for(int i=offset; i<(int)keys.size(); i+=step){
+		stripes.push_back(BinlogQueue::stripe(keys[i]));
+	}
+	// locked in the same order by every transaction, so no deadlock
+	std::sort(stripes.begin(), stripes.end());
+	stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+	if(stripes.empty()){
+		stripes.push_back(0);
+	}
+	this->lock();
+}
+
+void Transaction::lock(){
+	if(stripes.empty()){
+		pthread_rwlock_wrlock(&logs->tran_lock);
+	}else{
+		pthread_rwlock_rdlock(&logs->tran_lock);
+		for(int i=0; i<(int)stripes.size(); i++){
+			logs->stripes[stripes[i]].lock();
+		}
+	}
+	logs->begin();
+}
+
+Transaction::~Transaction(){
+	// it is safe to call rollback after commit
+	logs->rollback();
+	for(int i=(int)stripes.size()-1; i>=0; i--){
+		logs->stripes[stripes[i]].unlock();
+	}
+	pthread_rwlock_unlock(&logs->tran_lock);
+}
@@ -7,6 +7,8 @@ found in the LICENSE file.
 #define SSDB_BINLOG_H_
 
 #include <string>
+#include <vector>
+#include <deque>
 #include "leveldb/db.h"
 #include "leveldb/options.h"
 #include "leveldb/slice.h"
@@ -14,6 +16,7 @@ found in the LICENSE file.
 #include "leveldb/write_batch.h"
 #include "../util/thread.h"
 #include "../util/bytes.h"
+#include "../util/histogram.h"
 
 
 class Binlog{
@@ -45,15 +48,70 @@ public:
 	std::string dumps() const;
 };
 
+class Transaction;
+
 // circular queue
+//
+// Writes are made in transactions, each thread builds its own batch
+// while holding the striped locks of the keys it modifies. Committed
+// batches are queued, the first committer(the leader) merges the
+// queued batches into one leveldb write, giving their binlogs a
+// contiguous seq range, while the others wait for it.
 class BinlogQueue{
 private:
+	friend class Transaction;
+
+	// the batch being built by a thread
+	struct Tran{
+		leveldb::WriteBatch batch;
+		// binlogs, seq is assigned by commit()
+		std::vector<std::string> logs;
+	};
+	struct Writer{
+		Tran *tran;
+		leveldb::Status status;
+		bool done;
+		pthread_cond_t cond;
+	};
+	static const int LOCK_STRIPES = 1024;
+	// merged into one write at most
+	static const int MAX_GROUP_SIZE = 128;
+	static const size_t MAX_GROUP_BYTES = 4 * 1024 * 1024;
+
 	leveldb::DB *db;
 	uint64_t min_seq;
 	uint64_t last_seq;
-	uint64_t tran_seq;
 	int capacity;
-	leveldb::WriteBatch batch;
+
+	// the Tran of the calling thread
+	pthread_key_t tran_key;
+	// taken exclusively by transactions not bound to keys
+	pthread_rwlock_t tran_lock;
+	Mutex stripes[LOCK_STRIPES];
+	// guards writers
+	pthread_mutex_t commit_mutex;
+	std::deque<Writer *> writers;
+	// number of leveldb writes and of the transactions committed by them
+	uint64_t commit_writes;
+	uint64_t commit_trans;
+	// in us, from commit() called to returned
+	Histogram ack_latency;
+
+	// see set_fsync()
+	int fsync_interval;
+	// commit_writes when the log was fsynced last time
+	uint64_t synced_writes;
+	uint64_t fsyncs;
+	// in us
+	Histogram fsync_latency;
+	pthread_t fsync_tid;
+	volatile bool fsync_quit;
+	static void* fsync_thread_func(void *arg);
+	int sync_log();
+
+	Tran* tran();
+	static void free_tran(void *tran);
+	static int stripe(const Bytes &key);
 
 	volatile bool thread_quit;
 	static void* log_clean_thread_func(void *arg);
@@ -65,12 +123,13 @@ private:
 	void merge();
 	bool enabled;
 public:
-	Mutex mutex;
-
 	BinlogQueue(leveldb::DB *db, bool enabled=true, int capacity=20000000);
 	~BinlogQueue();
+	// the methods below apply to the calling thread's transaction
 	void begin();
 	void rollback();
+	// could be called by many threads at the same time, they are
+	// committed in groups
 	leveldb::Status commit();
 	// leveldb put
 	void Put(const leveldb::Slice& key, const leveldb::Slice& value);
@@ -79,6 +138,11 @@ public:
 	void add_log(char type, char cmd, const leveldb::Slice &key);
 	void add_log(char type, char cmd, const std::string &key);
 		
+	// -1: the log is never fsynced, 0: fsync on every commit, the
+	// transactions committed together share one fsync, > 0: fsync every
+	// interval ms if there are new commits, transactions don't wait for it
+	void set_fsync(int interval);
+
 	int get(uint64_t seq, Binlog *log) const;
 	int update(uint64_t seq, char type, char cmd, const std::string &key);
 		
@@ -95,21 +159,22 @@ public:
 	std::string stats() const;
 };
 
+// Transactions modifying the same key(name of a hash, zset or queue)
+// are serialized, the ones on different keys run in parallel.
 class Transaction{
 private:
 	BinlogQueue *logs;
-public:
-	Transaction(BinlogQueue *logs){
-		this->logs = logs;
-		logs->mutex.lock();
-		logs->begin();
-	}
+	// stripes locked, in ascending order, empty if exclusive
+	std::vector<int> stripes;
 	
-	~Transaction(){
-		// it is safe to call rollback after commit
-		logs->rollback();
-		logs->mutex.unlock();
-	}
+	void lock();
+public:
+	// exclusive, against all other transactions
+	Transaction(BinlogQueue *logs);
+	Transaction(BinlogQueue *logs, const Bytes &key);
+	// keys[offset], keys[offset + step]...
+	Transaction(BinlogQueue *logs, const std::vector<Bytes> &keys, int offset, int step);
+	~Transaction();
 };
 
 
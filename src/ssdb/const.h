@@ -8,6 +8,11 @@ found in the LICENSE file.
 
 static const int SSDB_SCORE_WIDTH		= 9;
 static const int SSDB_KEY_LEN_MAX		= 255;
+// sent by the slaves in sync140, bumped when the binlogs change in a way
+// older slaves would apply wrongly(v2: kv values carry the expire header),
+// the master refuses the slaves of older versions, so the slaves must be
+// upgraded before their master
+static const int SSDB_SYNC_VERSION		= 2;
 
 class DataType{
 public:
@@ -18,8 +23,11 @@ public:
 	static const char ZSET		= 's'; // key => score
 	static const char ZSCORE	= 'z'; // key|score => ""
 	static const char ZSIZE		= 'Z';
+	static const char ZRANK		= 'r'; // name|level|score prefix => count
 	static const char QUEUE		= 'q';
 	static const char QSIZE		= 'Q';
+	static const char GARBAGE	= 'G'; // items of old generations to be swept
+	static const char TTL_INDEX	= 'T'; // expire time|key => ""
 	static const char MIN_PREFIX = HASH;
 	static const char MAX_PREFIX = ZSET;
 };
@@ -47,6 +55,11 @@ public:
 	static const char QPOP_BACK		= 12;
 	static const char QPOP_FRONT	= 13;
 	static const char QSET			= 14;
+	static const char HCLEAR		= 15;
+	static const char ZCLEAR		= 16;
+	static const char QCLEAR		= 17;
+	static const char ZDEL_RANGE	= 18;
+	static const char KDEL_EXPIRED	= 19;
 	
 	static const char BEGIN  = 7;
 	static const char END    = 8;
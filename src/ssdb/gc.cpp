@@ -0,0 +1,318 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include <pthread.h>
+#include <algorithm>
+#include "../include.h"
+#include "../util/log.h"
+#include "gc.h"
+#include "ssdb_impl.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+
+// items deleted in one write
+static const int SWEEP_BATCH = 1000;
+
+// the size key of a GARBAGE key type
+static std::string encode_size_key(char type, const Bytes &name){
+	switch(type){
+		case DataType::HSIZE:
+			return encode_hsize_key(name);
+		case DataType::ZSIZE:
+			return encode_zsize_key(name);
+		case DataType::QSIZE:
+			return encode_qsize_key(name);
+	}
+	return "";
+}
+
+int SSDBImpl::get_meta(const std::string &size_key, int64_t *size, uint64_t *gen){
+	*size = 0;
+	*gen = 0;
+	std::string val;
+	leveldb::Status s = ldb->Get(leveldb::ReadOptions(), size_key, &val);
+	if(s.IsNotFound()){
+		return 0;
+	}
+	if(!s.ok()){
+		log_error("get error: %s", s.ToString().c_str());
+		return -1;
+	}
+	decode_meta(val, size, gen);
+	return 0;
+}
+
+int SSDBImpl::put_meta(const std::string &size_key, const Bytes &name, int64_t size, uint64_t gen){
+	if(size <= 0 && gen > 0){
+		// the generation must not go back to 0 while the items of the
+		// older ones are being swept
+		std::string val;
+		int ret = this->get_item(encode_garbage_key(size_key[0], name, gen - 1), &val);
+		if(ret == -1){
+			return -1;
+		}
+		if(ret == 0){
+			gen = 0;
+		}
+	}
+	if(size <= 0 && gen == 0){
+		binlogs->Delete(size_key);
+	}else{
+		binlogs->Put(size_key, encode_meta(size < 0? 0 : size, gen));
+	}
+	return 0;
+}
+
+int SSDBImpl::get_item(const std::string &key, std::string *val){
+	leveldb::Status s = ldb->Get(leveldb::ReadOptions(), key, val);
+	if(s.IsNotFound()){
+		return 0;
+	}
+	if(!s.ok()){
+		log_error("get error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return 1;
+}
+
+int64_t SSDBImpl::clear(const std::string &size_key, const Bytes &name, char cmd, char log_type){
+	if(name.empty() || name.size() > SSDB_KEY_LEN_MAX){
+		return 0;
+	}
+	Transaction trans(binlogs, name);
+
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
+	if(size == 0){
+		return 0;
+	}
+	binlogs->Put(size_key, encode_meta(0, gen + 1));
+	binlogs->Put(encode_garbage_key(size_key[0], name, gen), "");
+	binlogs->add_log(log_type, cmd, name.String());
+
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("clear error: %s", s.ToString().c_str());
+		return -1;
+	}
+	sweeper->notify();
+	return size;
+}
+
+bool SSDBImpl::is_garbage(const Bytes &key){
+	if(key.size() < 2){
+		return false;
+	}
+	char type;
+	switch(key.data()[0]){
+		case DataType::HASH:
+			type = DataType::HSIZE;
+			break;
+		case DataType::ZSET:
+		case DataType::ZSCORE:
+		case DataType::ZRANK:
+			type = DataType::ZSIZE;
+			break;
+		case DataType::QUEUE:
+			type = DataType::QSIZE;
+			break;
+		default:
+			return false;
+	}
+	Decoder decoder(key.data() + 1, key.size() - 1);
+	std::string name;
+	uint64_t gen;
+	if(decode_item_name(&decoder, &name, &gen) == -1){
+		return false;
+	}
+	int64_t size;
+	uint64_t cur;
+	if(get_meta(encode_size_key(type, name), &size, &cur) == -1){
+		return false;
+	}
+	return gen != cur;
+}
+
+/* Sweeper */
+
+Sweeper::Sweeper(SSDBImpl *ssdb, int speed){
+	this->ssdb = ssdb;
+	this->speed = speed;
+	this->quit = false;
+	// garbage may be left by the last run
+	this->dirty = true;
+	this->swept = 0;
+
+	int err = pthread_create(&tid, NULL, &Sweeper::thread_func, this);
+	if(err != 0){
+		log_fatal("can't create thread: %s", strerror(err));
+		exit(0);
+	}
+}
+
+Sweeper::~Sweeper(){
+	quit = true;
+	pthread_join(tid, NULL);
+}
+
+void Sweeper::notify(){
+	dirty = true;
+}
+
+std::string Sweeper::stats() const{
+	std::string s;
+	s.append("    speed    : ");
+	s.append(speed > 0? str(speed) + " items/s" : "unlimited");
+	s.append("\n");
+	s.append("    swept    : " + str(swept) + " items");
+	return s;
+}
+
+void* Sweeper::thread_func(void *arg){
+	Sweeper *sweeper = (Sweeper *)arg;
+	while(!sweeper->quit){
+		if(!sweeper->dirty){
+			usleep(50 * 1000);
+			continue;
+		}
+		sweeper->dirty = false;
+		sweeper->sweep_all();
+	}
+	log_debug("sweeper quit");
+	return (void *)NULL;
+}
+
+void Sweeper::sweep_all(){
+	std::string start(1, DataType::GARBAGE);
+	while(!quit){
+		std::string key;
+		leveldb::Iterator *it = ssdb->ldb->NewIterator(leveldb::ReadOptions());
+		it->Seek(start);
+		if(it->Valid() && it->key()[0] == DataType::GARBAGE){
+			key = it->key().ToString();
+		}
+		delete it;
+		if(key.empty()){
+			break;
+		}
+		if(sweep(key) == -1){
+			// retry later
+			dirty = true;
+			for(int i=0; i<20 && !quit; i++){
+				usleep(50 * 1000);
+			}
+			break;
+		}
+		start = key;
+	}
+}
+
+int64_t Sweeper::sweep(const std::string &garbage_key){
+	char type = 0;
+	std::string name;
+	uint64_t gen = 0;
+	std::string types;
+	if(decode_garbage_key(garbage_key, &type, &name, &gen) == 0){
+		switch(type){
+			case DataType::HSIZE:
+				types.append(1, DataType::HASH);
+				break;
+			case DataType::ZSIZE:
+				types.append(1, DataType::ZSET);
+				types.append(1, DataType::ZSCORE);
+				types.append(1, DataType::ZRANK);
+				break;
+			case DataType::QSIZE:
+				types.append(1, DataType::QUEUE);
+				break;
+		}
+	}
+	if(types.empty()){
+		log_error("bad garbage key: %s", hexmem(garbage_key.data(), garbage_key.size()).c_str());
+		leveldb::Status s = ssdb->ldb->Delete(leveldb::WriteOptions(), garbage_key);
+		return s.ok()? 0 : -1;
+	}
+
+	int64_t count = 0;
+	for(int i=0; i<(int)types.size(); i++){
+		std::string prefix(1, types[i]);
+		encode_item_name(&prefix, name, gen);
+		int64_t ret = sweep_prefix(prefix);
+		if(ret == -1){
+			return -1;
+		}
+		count += ret;
+	}
+
+	Transaction trans(ssdb->binlogs, name);
+	ssdb->binlogs->Delete(garbage_key);
+	std::string size_key = encode_size_key(type, name);
+	int64_t size;
+	uint64_t cur;
+	if(ssdb->get_meta(size_key, &size, &cur) == -1){
+		return -1;
+	}
+	// nothing written since the clear, back to generation 0
+	if(size == 0 && cur == gen + 1){
+		ssdb->binlogs->Delete(size_key);
+	}
+	leveldb::Status s = ssdb->binlogs->commit();
+	if(!s.ok()){
+		log_error("sweep error: %s", s.ToString().c_str());
+		return -1;
+	}
+	log_debug("swept %" PRId64 " items, type: %c, name: %s, generation: %" PRIu64 "",
+		count, type, hexmem(name.data(), name.size()).c_str(), gen);
+	return count;
+}
+
+int64_t Sweeper::sweep_prefix(const std::string &prefix){
+	leveldb::ReadOptions opts;
+	opts.fill_cache = false;
+	int64_t count = 0;
+	// seeking from the last deleted key, instead of the prefix, skips
+	// the deleted keys
+	std::string start = prefix;
+	while(!quit){
+		leveldb::WriteBatch batch;
+		int num = 0;
+		leveldb::Iterator *it = ssdb->ldb->NewIterator(opts);
+		for(it->Seek(start); it->Valid() && num < SWEEP_BATCH; it->Next()){
+			if(!it->key().starts_with(prefix)){
+				break;
+			}
+			batch.Delete(it->key());
+			num ++;
+			if(num == SWEEP_BATCH){
+				start = it->key().ToString();
+			}
+		}
+		delete it;
+		if(num == 0){
+			return count;
+		}
+		leveldb::Status s = ssdb->ldb->Write(leveldb::WriteOptions(), &batch);
+		if(!s.ok()){
+			log_error("sweep error: %s", s.ToString().c_str());
+			return -1;
+		}
+		count += num;
+		swept += num;
+		if(num < SWEEP_BATCH){
+			return count;
+		}
+		if(speed > 0){
+			int64_t us = (int64_t)num * 1000 * 1000 / speed;
+			while(us > 0 && !quit){
+				usleep(std::min(us, (int64_t)50 * 1000));
+				us -= 50 * 1000;
+			}
+		}
+	}
+	return -1;
+}
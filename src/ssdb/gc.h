@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef SSDB_GC_H_
+#define SSDB_GC_H_
+
+#include <pthread.h>
+#include <string>
+#include "../util/bytes.h"
+#include "../util/strings.h"
+#include "const.h"
+
+/* generations
+ *
+ * Clearing a hash, zset or queue only bumps the generation kept in its
+ * size key, the items of the older generation become garbage, and are
+ * deleted in background by the Sweeper, which finds them through the
+ * GARBAGE keys written by the clears.
+ *
+ * The name in an item key is prefixed with a zero length(names are never
+ * empty) and the generation, unless the generation is 0, so the items
+ * written before generations existed are those of generation 0.
+ */
+
+inline static
+void encode_item_name(std::string *buf, const Bytes &name, uint64_t gen){
+	if(gen > 0){
+		buf->append(1, (uint8_t)0);
+		gen = big_endian(gen);
+		buf->append((char *)&gen, sizeof(uint64_t));
+	}
+	buf->append(1, (uint8_t)name.size());
+	buf->append(name.data(), name.size());
+}
+
+inline static
+int decode_item_name(Decoder *decoder, std::string *name, uint64_t *gen){
+	int len = decoder->read_8_data(name);
+	if(len == -1){
+		return -1;
+	}
+	uint64_t g = 0;
+	if(len == 1){
+		if(decoder->read_uint64(&g) == -1){
+			return -1;
+		}
+		g = big_endian(g);
+		if(decoder->read_8_data(name) == -1){
+			return -1;
+		}
+	}
+	if(gen){
+		*gen = g;
+	}
+	return 0;
+}
+
+// the value of a size key, the generation is left out if it is 0
+inline static
+std::string encode_meta(int64_t size, uint64_t gen){
+	std::string buf;
+	buf.append((char *)&size, sizeof(int64_t));
+	if(gen > 0){
+		buf.append((char *)&gen, sizeof(uint64_t));
+	}
+	return buf;
+}
+
+inline static
+void decode_meta(const Bytes &val, int64_t *size, uint64_t *gen){
+	*size = 0;
+	*gen = 0;
+	int n = val.size();
+	if(n != (int)sizeof(int64_t) && n != (int)(sizeof(int64_t) + sizeof(uint64_t))){
+		return;
+	}
+	memcpy(size, val.data(), sizeof(int64_t));
+	if(*size < 0){
+		*size = 0;
+	}
+	if(n > (int)sizeof(int64_t)){
+		memcpy(gen, val.data() + sizeof(int64_t), sizeof(uint64_t));
+	}
+}
+
+// type of the size key, name, generation => ""
+inline static
+std::string encode_garbage_key(char type, const Bytes &name, uint64_t gen){
+	std::string buf;
+	buf.append(1, DataType::GARBAGE);
+	buf.append(1, type);
+	buf.append(1, (uint8_t)name.size());
+	buf.append(name.data(), name.size());
+	gen = big_endian(gen);
+	buf.append((char *)&gen, sizeof(uint64_t));
+	return buf;
+}
+
+inline static
+int decode_garbage_key(const Bytes &slice, char *type, std::string *name, uint64_t *gen){
+	Decoder decoder(slice.data(), slice.size());
+	if(decoder.skip(2) == -1){
+		return -1;
+	}
+	*type = slice.data()[1];
+	if(decoder.read_8_data(name) == -1){
+		return -1;
+	}
+	if(decoder.read_uint64(gen) == -1){
+		return -1;
+	}
+	*gen = big_endian(*gen);
+	return 0;
+}
+
+class SSDBImpl;
+
+// Deletes the items of the old generations, at most `speed` items per
+// second(<= 0 means no limit), the writes are not replicated, as every
+// slave sweeps its own garbage.
+class Sweeper
+{
+public:
+	Sweeper(SSDBImpl *ssdb, int speed);
+	~Sweeper();
+	// called after a container is cleared
+	void notify();
+	std::string stats() const;
+
+private:
+	SSDBImpl *ssdb;
+	int speed;
+	pthread_t tid;
+	volatile bool quit;
+	// set when there may be garbage left
+	volatile bool dirty;
+	uint64_t swept;
+
+	static void* thread_func(void *arg);
+	void sweep_all();
+	// @return -1: error or quit, others: the number of items deleted
+	int64_t sweep(const std::string &garbage_key);
+	int64_t sweep_prefix(const std::string &prefix);
+};
+
+#endif
@@ -8,6 +8,7 @@ found in the LICENSE file.
 #include "t_hash.h"
 #include "t_zset.h"
 #include "t_queue.h"
+#include "../include.h"
 #include "../util/log.h"
 #include "../util/config.h"
 #include "leveldb/iterator.h"
@@ -84,9 +85,11 @@ bool Iterator::next(){
 
 /* KV */
 
-KIterator::KIterator(Iterator *it){
+KIterator::KIterator(Iterator *it, uint64_t limit){
 	this->it = it;
 	this->return_val_ = true;
+	this->limit = limit;
+	this->now = time_ms();
 }
 
 KIterator::~KIterator(){
@@ -98,6 +101,9 @@ void KIterator::return_val(bool onoff){
 }
 
 bool KIterator::next(){
+	if(limit == 0){
+		return false;
+	}
 	while(it->next()){
 		Bytes ks = it->key();
 		Bytes vs = it->val();
@@ -106,13 +112,19 @@ bool KIterator::next(){
 		if(ks.data()[0] != DataType::KV){
 			return false;
 		}
+		int64_t expire;
+		int n = decode_kv_header(vs, &expire);
+		if(is_expired(expire, now)){
+			continue;
+		}
 		uint16_t slot;
 		if(decode_kv_key(ks, &this->key, &slot) == -1){
 			continue;
 		}
 		if(return_val_){
-			this->val.assign(vs.data(), vs.size());
+			this->val.assign(vs.data() + n, vs.size() - n);
 		}
+		limit --;
 		return true;
 	}
 	return  false;
@@ -120,9 +132,10 @@ bool KIterator::next(){
 
 /* HASH */
 
-HIterator::HIterator(Iterator *it, const Bytes &name){
+HIterator::HIterator(Iterator *it, const Bytes &name, uint64_t gen){
 	this->it = it;
 	this->name.assign(name.data(), name.size());
+	this->gen = gen;
 	this->return_val_ = true;
 }
 
@@ -144,10 +157,11 @@ bool HIterator::next(){
 			return false;
 		}
 		std::string n;
-		if(decode_hash_key(ks, &n, &key) == -1){
+		uint64_t g;
+		if(decode_hash_key(ks, &n, &key, &g) == -1){
 			continue;
 		}
-		if(n != this->name){
+		if(n != this->name || g != this->gen){
 			return false;
 		}
 		if(return_val_){
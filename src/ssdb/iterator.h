@@ -42,13 +42,18 @@ public:
 	std::string key;
 	std::string val;
 
-	KIterator(Iterator *it);
+	// it must not be limited, as the expired keys skipped would count
+	KIterator(Iterator *it, uint64_t limit=UINT64_MAX);
 	~KIterator();
 	void return_val(bool onoff);
 	bool next();
 private:
 	Iterator *it;
 	bool return_val_;
+	// the keys left to return
+	uint64_t limit;
+	// the keys expired by now are skipped
+	int64_t now;
 };
 
 
@@ -58,12 +63,13 @@ public:
 	std::string key;
 	std::string val;
 
-	HIterator(Iterator *it, const Bytes &name);
+	HIterator(Iterator *it, const Bytes &name, uint64_t gen);
 	~HIterator();
 	void return_val(bool onoff);
 	bool next();
 private:
 	Iterator *it;
+	uint64_t gen;
 	bool return_val_;
 };
 
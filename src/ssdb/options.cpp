@@ -23,7 +23,9 @@ void Options::load(const Config &conf){
 	write_buffer_size = (size_t)conf.get_num("leveldb.write_buffer_size");
 	block_size = (size_t)conf.get_num("leveldb.block_size");
 	compaction_speed = conf.get_num("leveldb.compaction_speed");
+	sweep_speed = conf.get_num("leveldb.sweep_speed");
 	compression = conf.get_str("leveldb.compression");
+	std::string fsync = conf.get_str("leveldb.fsync");
 	std::string binlog = conf.get_str("replication.binlog");
 	binlog_capacity = (size_t)conf.get_num("replication.binlog.capacity");
 
@@ -40,6 +42,14 @@ void Options::load(const Config &conf){
 	if(binlog_capacity <= 0){
 		binlog_capacity = LOG_QUEUE_SIZE;
 	}
+	strtolower(&fsync);
+	if(fsync == "always"){
+		fsync_interval = 0;
+	}else if(str_to_int(fsync) > 0){
+		fsync_interval = str_to_int(fsync);
+	}else{
+		fsync_interval = -1;
+	}
 
 	if(cache_size <= 0){
 		cache_size = 16;
@@ -50,6 +60,9 @@ void Options::load(const Config &conf){
 	if(block_size <= 0){
 		block_size = 16;
 	}
+	if(sweep_speed <= 0){
+		sweep_speed = 50000;
+	}
 	if(max_open_files <= 0){
 		max_open_files = cache_size / 1024 * 300;
 		if(max_open_files < 500){
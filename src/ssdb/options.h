@@ -24,6 +24,11 @@ public:
 	std::string compression;
 	bool binlog;
 	size_t binlog_capacity;
+	// when the leveldb log is fsynced, -1: never(left to the OS),
+	// 0: on every commit, > 0: every fsync_interval ms
+	int fsync_interval;
+	// items of cleared hashes, zsets and queues deleted per second
+	int sweep_speed;
 };
 
 #endif
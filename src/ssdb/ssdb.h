@@ -32,6 +32,9 @@ public:
 	virtual std::vector<std::string> info() = 0;
 	virtual void compact() = 0;
 	virtual int key_range(std::vector<std::string> *keys) = 0;
+	// whether key is an item of a cleared hash, zset or queue, not yet
+	// swept
+	virtual bool is_garbage(const Bytes &key) = 0;
 
 	/* raw operates */
 
@@ -58,6 +61,24 @@ public:
 	virtual KIterator* scan(const Bytes &start, const Bytes &end, uint64_t limit) = 0;
 	virtual KIterator* rscan(const Bytes &start, const Bytes &end, uint64_t limit) = 0;
 
+	/* expiration of keys, expire is the absolute time in ms */
+
+	// sets the value and the expire time in one transaction and one binlog
+	virtual int setx(const Bytes &key, const Bytes &val, int64_t expire, char log_type=BinlogType::SYNC) = 0;
+	// @return -1: error, 0: no expiration, 1: found
+	virtual int get_expire(const Bytes &key, int64_t *expire) = 0;
+	// rewrites the value with the expire time in it
+	// @return -1: error, 0: key not found, 1: ok
+	virtual int set_expire(const Bytes &key, int64_t expire, char log_type=BinlogType::SYNC) = 0;
+	// @return -1: error, 0: no expiration, 1: removed
+	virtual int del_expire(const Bytes &key, char log_type=BinlogType::SYNC) = 0;
+	// deletes the keys expired by now in one transaction, logged as one
+	// binlog, expires(may be empty) are the times the keys were found at
+	// in the TTL_INDEX
+	// @return -1: error, other: the number of keys deleted
+	virtual int64_t del_expired(const std::vector<std::string> &keys,
+			const std::vector<int64_t> &expires, int64_t now, char log_type=BinlogType::SYNC) = 0;
+
 	/* hash */
 
 	virtual int hset(const Bytes &name, const Bytes &key, const Bytes &val, char log_type=BinlogType::SYNC) = 0;
@@ -66,7 +87,8 @@ public:
 	virtual int hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC) = 0;
 
 	virtual int64_t hsize(const Bytes &name) = 0;
-	virtual int64_t hclear(const Bytes &name) = 0;
+	// @return -1: error, other: the number of items cleared
+	virtual int64_t hclear(const Bytes &name, char log_type=BinlogType::SYNC) = 0;
 	virtual int hget(const Bytes &name, const Bytes &key, std::string *val) = 0;
 	virtual int hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list) = 0;
@@ -79,6 +101,16 @@ public:
 
 	virtual int zset(const Bytes &name, const Bytes &key, const Bytes &score, char log_type=BinlogType::SYNC) = 0;
 	virtual int zdel(const Bytes &name, const Bytes &key, char log_type=BinlogType::SYNC) = 0;
+	/**
+	 * delete the items from (score_start, key_start) to (score_end, key_end),
+	 * both inclusive, at most limit items. Empty score_start/score_end
+	 * means no bound, empty key_end means all the items of score_end.
+	 * @return -1: error, other: the number of items deleted
+	 */
+	virtual int64_t zdel_range(const Bytes &name,
+			const Bytes &score_start, const Bytes &key_start,
+			const Bytes &score_end, const Bytes &key_end,
+			uint64_t limit, char log_type=BinlogType::SYNC) = 0;
 	// -1: error, 1: ok, 0: value is not an integer or out of range
 	virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC) = 0;
 	
@@ -91,6 +123,10 @@ public:
 	virtual int64_t zrrank(const Bytes &name, const Bytes &key) = 0;
 	virtual ZIterator* zrange(const Bytes &name, uint64_t offset, uint64_t limit) = 0;
 	virtual ZIterator* zrrange(const Bytes &name, uint64_t offset, uint64_t limit) = 0;
+	// count the items in [score_start, score_end] and sum their scores,
+	// empty score_start/score_end means no bound
+	virtual int zaggregate(const Bytes &name, const Bytes &score_start, const Bytes &score_end,
+			int64_t *count, int64_t *sum) = 0;
 	/**
 	 * scan by score, but won't return @key if key.score=score_start.
 	 * return (score_start, score_end]
@@ -104,6 +140,7 @@ public:
 	virtual int zrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list) = 0;
 	virtual int64_t zfix(const Bytes &name) = 0;
+	virtual int64_t zclear(const Bytes &name, char log_type=BinlogType::SYNC) = 0;
 	
 	virtual int64_t qsize(const Bytes &name) = 0;
 	// @return 0: empty queue, 1: item peeked, -1: error
@@ -113,9 +150,16 @@ public:
 	// @return -1: error, other: the new length of the queue
 	virtual int64_t qpush_front(const Bytes &name, const Bytes &item, char log_type=BinlogType::SYNC) = 0;
 	virtual int64_t qpush_back(const Bytes &name, const Bytes &item, char log_type=BinlogType::SYNC) = 0;
+	// all the items are pushed in one transaction
+	virtual int64_t qpush_front(const Bytes &name, const std::vector<Bytes> &items, char log_type=BinlogType::SYNC) = 0;
+	virtual int64_t qpush_back(const Bytes &name, const std::vector<Bytes> &items, char log_type=BinlogType::SYNC) = 0;
 	// @return 0: empty queue, 1: item popped, -1: error
 	virtual int qpop_front(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC) = 0;
 	virtual int qpop_back(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC) = 0;
+	// pops at most limit items in one transaction
+	// @return -1: error, other: the number of items popped
+	virtual int64_t qpop_front(const Bytes &name, uint64_t limit, std::vector<std::string> *items, char log_type=BinlogType::SYNC) = 0;
+	virtual int64_t qpop_back(const Bytes &name, uint64_t limit, std::vector<std::string> *items, char log_type=BinlogType::SYNC) = 0;
 	virtual int qfix(const Bytes &name) = 0;
 	virtual int qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list) = 0;
@@ -126,6 +170,7 @@ public:
 	virtual int qget(const Bytes &name, int64_t index, std::string *item) = 0;
 	virtual int qset(const Bytes &name, int64_t index, const Bytes &item, char log_type=BinlogType::SYNC) = 0;
 	virtual int qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type=BinlogType::SYNC) = 0;
+	virtual int64_t qclear(const Bytes &name, char log_type=BinlogType::SYNC) = 0;
 };
 
 
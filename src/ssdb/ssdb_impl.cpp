@@ -3,11 +3,13 @@ Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
 Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
+#include "../include.h"
 #include "ssdb_impl.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "leveldb/cache.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/compaction_filter.h"
 
 #include "iterator.h"
 #include "t_kv.h"
@@ -15,12 +17,35 @@ found in the LICENSE file.
 #include "t_zset.h"
 #include "t_queue.h"
 
+// drops the kv pairs expired, which are hidden from reads already, so
+// most of the expired keys are gone before they are deleted by the
+// ExpirationHandler
+class ExpiredFilter : public leveldb::CompactionFilter
+{
+public:
+	virtual const char* Name() const{
+		return "ssdb.ExpiredFilter";
+	}
+	virtual bool Filter(int level, const leveldb::Slice &key, const leveldb::Slice &value) const{
+		if(key.size() == 0 || key[0] != DataType::KV){
+			return false;
+		}
+		int64_t expire;
+		decode_kv_header(Bytes(value.data(), value.size()), &expire);
+		return is_expired(expire, time_ms());
+	}
+};
+
 SSDBImpl::SSDBImpl(){
 	ldb = NULL;
 	binlogs = NULL;
+	sweeper = NULL;
 }
 
 SSDBImpl::~SSDBImpl(){
+	if(sweeper){
+		delete sweeper;
+	}
 	if(binlogs){
 		delete binlogs;
 	}
@@ -33,6 +58,9 @@ SSDBImpl::~SSDBImpl(){
 	if(options.filter_policy){
 		delete options.filter_policy;
 	}
+	if(options.compaction_filter){
+		delete options.compaction_filter;
+	}
 }
 
 SSDB* SSDB::open(const Options &opt, const std::string &dir){
@@ -40,6 +68,7 @@ SSDB* SSDB::open(const Options &opt, const std::string &dir){
 	ssdb->options.create_if_missing = true;
 	ssdb->options.max_open_files = opt.max_open_files;
 	ssdb->options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+	ssdb->options.compaction_filter = new ExpiredFilter();
 	ssdb->options.block_cache = leveldb::NewLRUCache(opt.cache_size * 1048576);
 	ssdb->options.block_size = opt.block_size * 1024;
 	ssdb->options.write_buffer_size = opt.write_buffer_size * 1024 * 1024;
@@ -58,6 +87,8 @@ SSDB* SSDB::open(const Options &opt, const std::string &dir){
 		goto err;
 	}
 	ssdb->binlogs = new BinlogQueue(ssdb->ldb, opt.binlog, opt.binlog_capacity);
+	ssdb->binlogs->set_fsync(opt.fsync_interval);
+	ssdb->sweeper = new Sweeper(ssdb, opt.sweep_speed);
 
 	return ssdb;
 err:
@@ -181,6 +212,9 @@ std::vector<std::string> SSDBImpl::info(){
 	//     of the sstables that make up the db contents.
 	std::vector<std::string> info;
 	std::vector<std::string> keys;
+
+	info.push_back("sweeper");
+	info.push_back(sweeper->stats());
 	/*
 	for(int i=0; i<7; i++){
 		char buf[128];
@@ -14,6 +14,7 @@ found in the LICENSE file.
 #include "ssdb.h"
 #include "binlog.h"
 #include "iterator.h"
+#include "gc.h"
 #include "t_kv.h"
 #include "t_hash.h"
 #include "t_zset.h"
@@ -28,8 +29,10 @@ class SSDBImpl : public SSDB
 {
 private:
 	friend class SSDB;
+	friend class Sweeper;
 	leveldb::DB* ldb;
 	leveldb::Options options;
+	Sweeper *sweeper;
 	
 	SSDBImpl();
 public:
@@ -48,6 +51,17 @@ public:
 	virtual std::vector<std::string> info();
 	virtual void compact();
 	virtual int key_range(std::vector<std::string> *keys);
+	virtual bool is_garbage(const Bytes &key);
+	
+	/* size keys of hashes, zsets and queues */
+
+	// @return -1: error, 0: ok, size and gen are 0 if not found
+	int get_meta(const std::string &size_key, int64_t *size, uint64_t *gen);
+	// in the current transaction, the size key is deleted when size is 0,
+	// unless the previous generation is not swept yet
+	int put_meta(const std::string &size_key, const Bytes &name, int64_t size, uint64_t gen);
+	// @return -1: error, 0: not found, 1: found
+	int get_item(const std::string &key, std::string *val);
 	
 	/* raw operates */
 
@@ -74,6 +88,31 @@ public:
 	virtual KIterator* scan(const Bytes &start, const Bytes &end, uint64_t limit);
 	virtual KIterator* rscan(const Bytes &start, const Bytes &end, uint64_t limit);
 
+	/* expiration of keys, expire is the absolute time in ms */
+
+	// sets the value and the expire time in one transaction and one binlog
+	virtual int setx(const Bytes &key, const Bytes &val, int64_t expire, char log_type=BinlogType::SYNC);
+	// @return -1: error, 0: no expiration, 1: found
+	virtual int get_expire(const Bytes &key, int64_t *expire);
+	// rewrites the value with the expire time in it
+	// @return -1: error, 0: key not found, 1: ok
+	virtual int set_expire(const Bytes &key, int64_t expire, char log_type=BinlogType::SYNC);
+	// @return -1: error, 0: no expiration, 1: removed
+	virtual int del_expire(const Bytes &key, char log_type=BinlogType::SYNC);
+	// deletes the keys expired by now in one transaction, logged as one
+	// binlog, expires(may be empty) are the times the keys were found at
+	// in the TTL_INDEX
+	// @return -1: error, other: the number of keys deleted
+	virtual int64_t del_expired(const std::vector<std::string> &keys,
+			const std::vector<int64_t> &expires, int64_t now, char log_type=BinlogType::SYNC);
+	// the value of key, expired or not, and its expire time(0 if none)
+	// @return -1: error, 0: not found, 1: found
+	int get_value(const Bytes &key, std::string *val, int64_t *expire);
+	// in the current transaction
+	void put_value(const std::string &kv_key, const Bytes &val, int64_t expire);
+	// deletes the TTL_INDEX entry of key, if any, in the current transaction
+	int del_expire_index(const Bytes &key);
+
 	/* hash */
 
 	virtual int hset(const Bytes &name, const Bytes &key, const Bytes &val, char log_type=BinlogType::SYNC);
@@ -84,7 +123,7 @@ public:
 	//int multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC);
 
 	virtual int64_t hsize(const Bytes &name);
-	virtual int64_t hclear(const Bytes &name);
+	virtual int64_t hclear(const Bytes &name, char log_type=BinlogType::SYNC);
 	virtual int hget(const Bytes &name, const Bytes &key, std::string *val);
 	virtual int hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list);
@@ -97,6 +136,10 @@ public:
 
 	virtual int zset(const Bytes &name, const Bytes &key, const Bytes &score, char log_type=BinlogType::SYNC);
 	virtual int zdel(const Bytes &name, const Bytes &key, char log_type=BinlogType::SYNC);
+	virtual int64_t zdel_range(const Bytes &name,
+			const Bytes &score_start, const Bytes &key_start,
+			const Bytes &score_end, const Bytes &key_end,
+			uint64_t limit, char log_type=BinlogType::SYNC);
 	// -1: error, 1: ok, 0: value is not an integer or out of range
 	virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type=BinlogType::SYNC);
 	//int multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC);
@@ -111,6 +154,10 @@ public:
 	virtual int64_t zrrank(const Bytes &name, const Bytes &key);
 	virtual ZIterator* zrange(const Bytes &name, uint64_t offset, uint64_t limit);
 	virtual ZIterator* zrrange(const Bytes &name, uint64_t offset, uint64_t limit);
+	// count the items in [score_start, score_end] and sum their scores,
+	// empty score_start/score_end means no bound
+	virtual int zaggregate(const Bytes &name, const Bytes &score_start, const Bytes &score_end,
+			int64_t *count, int64_t *sum);
 	/**
 	 * scan by score, but won't return @key if key.score=score_start.
 	 * return (score_start, score_end]
@@ -124,6 +171,7 @@ public:
 	virtual int zrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list);
 	virtual int64_t zfix(const Bytes &name);
+	virtual int64_t zclear(const Bytes &name, char log_type=BinlogType::SYNC);
 	
 	virtual int64_t qsize(const Bytes &name);
 	// @return 0: empty queue, 1: item peeked, -1: error
@@ -133,9 +181,14 @@ public:
 	// @return -1: error, other: the new length of the queue
 	virtual int64_t qpush_front(const Bytes &name, const Bytes &item, char log_type=BinlogType::SYNC);
 	virtual int64_t qpush_back(const Bytes &name, const Bytes &item, char log_type=BinlogType::SYNC);
+	virtual int64_t qpush_front(const Bytes &name, const std::vector<Bytes> &items, char log_type=BinlogType::SYNC);
+	virtual int64_t qpush_back(const Bytes &name, const std::vector<Bytes> &items, char log_type=BinlogType::SYNC);
 	// @return 0: empty queue, 1: item popped, -1: error
 	virtual int qpop_front(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC);
 	virtual int qpop_back(const Bytes &name, std::string *item, char log_type=BinlogType::SYNC);
+	// @return -1: error, other: the number of items popped
+	virtual int64_t qpop_front(const Bytes &name, uint64_t limit, std::vector<std::string> *items, char log_type=BinlogType::SYNC);
+	virtual int64_t qpop_back(const Bytes &name, uint64_t limit, std::vector<std::string> *items, char log_type=BinlogType::SYNC);
 	virtual int qfix(const Bytes &name);
 	virtual int qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list);
@@ -146,10 +199,13 @@ public:
 	virtual int qget(const Bytes &name, int64_t index, std::string *item);
 	virtual int qset(const Bytes &name, int64_t index, const Bytes &item, char log_type=BinlogType::SYNC);
 	virtual int qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type=BinlogType::SYNC);
+	virtual int64_t qclear(const Bytes &name, char log_type=BinlogType::SYNC);
 
 private:
-	int64_t _qpush(const Bytes &name, const Bytes &item, uint64_t front_or_back_seq, char log_type=BinlogType::SYNC);
-	int _qpop(const Bytes &name, std::string *item, uint64_t front_or_back_seq, char log_type=BinlogType::SYNC);
+	// bumps the generation of a hash, zset or queue
+	int64_t clear(const std::string &size_key, const Bytes &name, char cmd, char log_type);
+	int64_t _qpush(const Bytes &name, const std::vector<Bytes> &items, uint64_t front_or_back_seq, char log_type=BinlogType::SYNC);
+	int64_t _qpop(const Bytes &name, uint64_t limit, std::vector<std::string> *items, uint64_t front_or_back_seq, char log_type=BinlogType::SYNC);
 };
 
 #endif
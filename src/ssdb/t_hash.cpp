@@ -5,20 +5,25 @@ found in the LICENSE file.
 */
 #include "t_hash.h"
 
-static int hset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &val, char log_type);
-static int hdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, char log_type);
-static int incr_hsize(SSDBImpl *ssdb, const Bytes &name, int64_t incr);
+static int hset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &val, uint64_t gen, char log_type);
+static int hdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, uint64_t gen, char log_type);
 
 /**
  * @return -1: error, 0: item updated, 1: new item inserted
  */
 int SSDBImpl::hset(const Bytes &name, const Bytes &key, const Bytes &val, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 
-	int ret = hset_one(this, name, key, val, log_type);
+	std::string size_key = encode_hsize_key(name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
+	int ret = hset_one(this, name, key, val, gen, log_type);
 	if(ret >= 0){
 		if(ret > 0){
-			if(incr_hsize(this, name, ret) == -1){
+			if(put_meta(size_key, name, size + ret, gen) == -1){
 				return -1;
 			}
 		}
@@ -31,12 +36,18 @@ int SSDBImpl::hset(const Bytes &name, const Bytes &key, const Bytes &val, char l
 }
 
 int SSDBImpl::hdel(const Bytes &name, const Bytes &key, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 
-	int ret = hdel_one(this, name, key, log_type);
+	std::string size_key = encode_hsize_key(name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
+	int ret = hdel_one(this, name, key, gen, log_type);
 	if(ret >= 0){
 		if(ret > 0){
-			if(incr_hsize(this, name, -ret) == -1){
+			if(put_meta(size_key, name, size - ret, gen) == -1){
 				return -1;
 			}
 		}
@@ -49,10 +60,16 @@ int SSDBImpl::hdel(const Bytes &name, const Bytes &key, char log_type){
 }
 
 int SSDBImpl::hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 
+	std::string size_key = encode_hsize_key(name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
 	std::string old;
-	int ret = this->hget(name, key, &old);
+	int ret = get_item(encode_hash_key(name, key, gen), &old);
 	if(ret == -1){
 		return -1;
 	}else if(ret == 0){
@@ -64,13 +81,13 @@ int SSDBImpl::hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *ne
 		}
 	}
 
-	ret = hset_one(this, name, key, str(*new_val), log_type);
+	ret = hset_one(this, name, key, str(*new_val), gen, log_type);
 	if(ret == -1){
 		return -1;
 	}
 	if(ret >= 0){
 		if(ret > 0){
-			if(incr_hsize(this, name, ret) == -1){
+			if(put_meta(size_key, name, size + ret, gen) == -1){
 				return -1;
 			}
 		}
@@ -83,101 +100,87 @@ int SSDBImpl::hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *ne
 }
 
 int64_t SSDBImpl::hsize(const Bytes &name){
-	std::string size_key = encode_hsize_key(name);
-	std::string val;
-	leveldb::Status s;
-
-	s = ldb->Get(leveldb::ReadOptions(), size_key, &val);
-	if(s.IsNotFound()){
-		return 0;
-	}else if(!s.ok()){
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_hsize_key(name), &size, &gen) == -1){
 		return -1;
-	}else{
-		if(val.size() != sizeof(uint64_t)){
-			return 0;
-		}
-		int64_t ret = *(int64_t *)val.data();
-		return ret < 0? 0 : ret;
 	}
+	return size;
 }
 
-int64_t SSDBImpl::hclear(const Bytes &name){
-	int64_t count = 0;
-	while(1){
-		HIterator *it = this->hscan(name, "", "", 1000);
-		int num = 0;
-		while(it->next()){
-			int ret = this->hdel(name, it->key);
-			if(ret == -1){
-				delete it;
-				return 0;
-			}
-			num ++;
-		};
-		delete it;
-
-		if(num == 0){
-			break;
-		}
-		count += num;
-	}
-	return count;
+int64_t SSDBImpl::hclear(const Bytes &name, char log_type){
+	return clear(encode_hsize_key(name), name, BinlogCommand::HCLEAR, log_type);
 }
 
 int SSDBImpl::hget(const Bytes &name, const Bytes &key, std::string *val){
-	std::string dbkey = encode_hash_key(name, key);
-	leveldb::Status s = ldb->Get(leveldb::ReadOptions(), dbkey, val);
-	if(s.IsNotFound()){
-		return 0;
-	}
-	if(!s.ok()){
-		log_error("%s", s.ToString().c_str());
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_hsize_key(name), &size, &gen) == -1){
 		return -1;
 	}
-	return 1;
+	if(size == 0){
+		return 0;
+	}
+	return get_item(encode_hash_key(name, key, gen), val);
 }
 
 HIterator* SSDBImpl::hscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit){
 	std::string key_start, key_end;
+	int64_t size;
+	uint64_t gen;
+	get_meta(encode_hsize_key(name), &size, &gen);
 
-	key_start = encode_hash_key(name, start);
+	key_start = encode_hash_key(name, start, gen);
 	if(!end.empty()){
-		key_end = encode_hash_key(name, end);
+		key_end = encode_hash_key(name, end, gen);
 	}
 	//dump(key_start.data(), key_start.size(), "scan.start");
 	//dump(key_end.data(), key_end.size(), "scan.end");
 
-	return new HIterator(this->iterator(key_start, key_end, limit), name);
+	return new HIterator(this->iterator(key_start, key_end, limit), name, gen);
 }
 
 HIterator* SSDBImpl::hrscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit){
 	std::string key_start, key_end;
+	int64_t size;
+	uint64_t gen;
+	get_meta(encode_hsize_key(name), &size, &gen);
 
-	key_start = encode_hash_key(name, start);
+	key_start = encode_hash_key(name, start, gen);
 	if(start.empty()){
 		key_start.append(1, 255);
 	}
 	if(!end.empty()){
-		key_end = encode_hash_key(name, end);
+		key_end = encode_hash_key(name, end, gen);
 	}
 	//dump(key_start.data(), key_start.size(), "scan.start");
 	//dump(key_end.data(), key_end.size(), "scan.end");
 
-	return new HIterator(this->rev_iterator(key_start, key_end, limit), name);
+	return new HIterator(this->rev_iterator(key_start, key_end, limit), name, gen);
 }
 
-static void get_hnames(Iterator *it, std::vector<std::string> *list){
-	while(it->next()){
+static void get_hnames(Iterator *it, uint64_t limit, std::vector<std::string> *list){
+	// it is not limited, as the cleared names skipped would count
+	uint64_t num = 0;
+	while(num < limit && it->next()){
 		Bytes ks = it->key();
 		if(ks.data()[0] != DataType::HSIZE){
 			break;
 		}
+		int64_t size;
+		uint64_t gen;
+		decode_meta(it->val(), &size, &gen);
+		// cleared
+		if(size == 0){
+			continue;
+		}
 		std::string n;
 		uint16_t slot;
 		if(decode_hsize_key(ks, &n, &slot) == -1){
 			continue;
 		}
 		list->push_back(n);
+		num ++;
 	}
 }
 
@@ -191,8 +194,8 @@ int SSDBImpl::hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		end = encode_hsize_key(name_e);
 	}
 	
-	Iterator *it = this->iterator(start, end, limit);
-	get_hnames(it, list);
+	Iterator *it = this->iterator(start, end, UINT64_MAX);
+	get_hnames(it, limit, list);
 	delete it;
 	return 0;
 }
@@ -210,14 +213,14 @@ int SSDBImpl::hrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		end = encode_hsize_key(name_e);
 	}
 	
-	Iterator *it = this->rev_iterator(start, end, limit);
-	get_hnames(it, list);
+	Iterator *it = this->rev_iterator(start, end, UINT64_MAX);
+	get_hnames(it, limit, list);
 	delete it;
 	return 0;
 }
 
 // returns the number of newly added items
-static int hset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &val, char log_type){
+static int hset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &val, uint64_t gen, char log_type){
 	if(name.empty() || key.empty()){
 		log_error("empty name or key!");
 		return -1;
@@ -232,14 +235,17 @@ static int hset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const B
 	}
 	int ret = 0;
 	std::string dbval;
-	if(ssdb->hget(name, key, &dbval) == 0){ // not found
-		std::string hkey = encode_hash_key(name, key);
+	std::string hkey = encode_hash_key(name, key, gen);
+	int found = ssdb->get_item(hkey, &dbval);
+	if(found == -1){
+		return -1;
+	}
+	if(found == 0){
 		ssdb->binlogs->Put(hkey, slice(val));
 		ssdb->binlogs->add_log(log_type, BinlogCommand::HSET, hkey);
 		ret = 1;
 	}else{
 		if(dbval != val){
-			std::string hkey = encode_hash_key(name, key);
 			ssdb->binlogs->Put(hkey, slice(val));
 			ssdb->binlogs->add_log(log_type, BinlogCommand::HSET, hkey);
 		}
@@ -248,7 +254,7 @@ static int hset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const B
 	return ret;
 }
 
-static int hdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, char log_type){
+static int hdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, uint64_t gen, char log_type){
 	if(name.size() > SSDB_KEY_LEN_MAX ){
 		log_error("name too long! %s", hexmem(name.data(), name.size()).c_str());
 		return -1;
@@ -258,25 +264,14 @@ static int hdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, char lo
 		return -1;
 	}
 	std::string dbval;
-	if(ssdb->hget(name, key, &dbval) == 0){
-		return 0;
+	std::string hkey = encode_hash_key(name, key, gen);
+	int found = ssdb->get_item(hkey, &dbval);
+	if(found != 1){
+		return found;
 	}
 
-	std::string hkey = encode_hash_key(name, key);
 	ssdb->binlogs->Delete(hkey);
 	ssdb->binlogs->add_log(log_type, BinlogCommand::HDEL, hkey);
 	
 	return 1;
 }
-
-static int incr_hsize(SSDBImpl *ssdb, const Bytes &name, int64_t incr){
-	int64_t size = ssdb->hsize(name);
-	size += incr;
-	std::string size_key = encode_hsize_key(name);
-	if(size == 0){
-		ssdb->binlogs->Delete(size_key);
-	}else{
-		ssdb->binlogs->Put(size_key, leveldb::Slice((char *)&size, sizeof(int64_t)));
-	}
-	return 0;
-}
@@ -35,23 +35,22 @@ int decode_hsize_key(const Bytes &slice, std::string *name, uint16_t *slot){
 }
 
 inline static
-std::string encode_hash_key(const Bytes &name, const Bytes &key){
+std::string encode_hash_key(const Bytes &name, const Bytes &key, uint64_t gen){
 	std::string buf;
 	buf.append(1, DataType::HASH);
-	buf.append(1, (uint8_t)name.size());
-	buf.append(name.data(), name.size());
+	encode_item_name(&buf, name, gen);
 	buf.append(1, '=');
 	buf.append(key.data(), key.size());
 	return buf;
 }
 
 inline static
-int decode_hash_key(const Bytes &slice, std::string *name, std::string *key){
+int decode_hash_key(const Bytes &slice, std::string *name, std::string *key, uint64_t *gen=NULL){
 	Decoder decoder(slice.data(), slice.size());
 	if(decoder.skip(1) == -1){
 		return -1;
 	}
-	if(decoder.read_8_data(name) == -1){
+	if(decode_item_name(&decoder, name, gen) == -1){
 		return -1;
 	}
 	if(decoder.skip(1) == -1){
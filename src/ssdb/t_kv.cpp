@@ -3,10 +3,11 @@ Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
 Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
+#include "../include.h"
 #include "t_kv.h"
 
 int SSDBImpl::multi_set(const std::vector<Bytes> &kvs, int offset, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, kvs, offset, 2);
 
 	std::vector<Bytes>::const_iterator it;
 	it = kvs.begin() + offset;
@@ -19,7 +20,7 @@ int SSDBImpl::multi_set(const std::vector<Bytes> &kvs, int offset, char log_type
 		}
 		const Bytes &val = *(it + 1);
 		std::string buf = encode_kv_key(key);
-		binlogs->Put(buf, slice(val));
+		this->put_value(buf, val, 0);
 		binlogs->add_log(log_type, BinlogCommand::KSET, buf);
 	}
 	leveldb::Status s = binlogs->commit();
@@ -31,12 +32,15 @@ int SSDBImpl::multi_set(const std::vector<Bytes> &kvs, int offset, char log_type
 }
 
 int SSDBImpl::multi_del(const std::vector<Bytes> &keys, int offset, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, keys, offset, 1);
 
 	std::vector<Bytes>::const_iterator it;
 	it = keys.begin() + offset;
 	for(; it != keys.end(); it++){
 		const Bytes &key = *it;
+		if(this->del_expire_index(key) == -1){
+			return -1;
+		}
 		std::string buf = encode_kv_key(key);
 		binlogs->Delete(buf);
 		binlogs->add_log(log_type, BinlogCommand::KDEL, buf);
@@ -55,10 +59,10 @@ int SSDBImpl::set(const Bytes &key, const Bytes &val, char log_type){
 		//return -1;
 		return 0;
 	}
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, key);
 
 	std::string buf = encode_kv_key(key);
-	binlogs->Put(buf, slice(val));
+	this->put_value(buf, val, 0);
 	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
 	leveldb::Status s = binlogs->commit();
 	if(!s.ok()){
@@ -74,7 +78,7 @@ int SSDBImpl::setnx(const Bytes &key, const Bytes &val, char log_type){
 		//return -1;
 		return 0;
 	}
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, key);
 
 	std::string tmp;
 	int found = this->get(key, &tmp);
@@ -82,7 +86,7 @@ int SSDBImpl::setnx(const Bytes &key, const Bytes &val, char log_type){
 		return 0;
 	}
 	std::string buf = encode_kv_key(key);
-	binlogs->Put(buf, slice(val));
+	this->put_value(buf, val, 0);
 	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
 	leveldb::Status s = binlogs->commit();
 	if(!s.ok()){
@@ -98,11 +102,11 @@ int SSDBImpl::getset(const Bytes &key, std::string *val, const Bytes &newval, ch
 		//return -1;
 		return 0;
 	}
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, key);
 
 	int found = this->get(key, val);
 	std::string buf = encode_kv_key(key);
-	binlogs->Put(buf, slice(newval));
+	this->put_value(buf, newval, 0);
 	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
 	leveldb::Status s = binlogs->commit();
 	if(!s.ok()){
@@ -114,8 +118,11 @@ int SSDBImpl::getset(const Bytes &key, std::string *val, const Bytes &newval, ch
 
 
 int SSDBImpl::del(const Bytes &key, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, key);
 
+	if(this->del_expire_index(key) == -1){
+		return -1;
+	}
 	std::string buf = encode_kv_key(key);
 	binlogs->Delete(buf);
 	binlogs->add_log(log_type, BinlogCommand::KDEL, buf);
@@ -128,10 +135,15 @@ int SSDBImpl::del(const Bytes &key, char log_type){
 }
 
 int SSDBImpl::incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, key);
 
 	std::string old;
-	int ret = this->get(key, &old);
+	int64_t expire;
+	int ret = this->get_value(key, &old, &expire);
+	if(ret == 1 && is_expired(expire, time_ms())){
+		ret = 0;
+		expire = 0;
+	}
 	if(ret == -1){
 		return -1;
 	}else if(ret == 0){
@@ -143,8 +155,9 @@ int SSDBImpl::incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type
 		}
 	}
 
+	// the expiration is kept
 	std::string buf = encode_kv_key(key);
-	binlogs->Put(buf, str(*new_val));
+	this->put_value(buf, str(*new_val), expire);
 	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
 
 	leveldb::Status s = binlogs->commit();
@@ -156,6 +169,18 @@ int SSDBImpl::incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type
 }
 
 int SSDBImpl::get(const Bytes &key, std::string *val){
+	int64_t expire;
+	int ret = this->get_value(key, val, &expire);
+	// expired, but not deleted yet
+	if(ret == 1 && is_expired(expire, time_ms())){
+		val->clear();
+		return 0;
+	}
+	return ret;
+}
+
+int SSDBImpl::get_value(const Bytes &key, std::string *val, int64_t *expire){
+	*expire = 0;
 	std::string buf = encode_kv_key(key);
 
 	leveldb::Status s = ldb->Get(leveldb::ReadOptions(), buf, val);
@@ -166,9 +191,23 @@ int SSDBImpl::get(const Bytes &key, std::string *val){
 		log_error("get error: %s", s.ToString().c_str());
 		return -1;
 	}
+	int n = decode_kv_header(*val, expire);
+	if(n > 0){
+		val->erase(0, n);
+	}
 	return 1;
 }
 
+void SSDBImpl::put_value(const std::string &kv_key, const Bytes &val, int64_t expire){
+	if(expire == 0 && !kv_value_has_magic(val)){
+		binlogs->Put(kv_key, slice(val));
+		return;
+	}
+	std::string buf = encode_kv_header(expire);
+	buf.append(val.data(), val.size());
+	binlogs->Put(kv_key, buf);
+}
+
 KIterator* SSDBImpl::scan(const Bytes &start, const Bytes &end, uint64_t limit){
 	std::string key_start, key_end;
 	key_start = encode_kv_key(start);
@@ -180,7 +219,7 @@ KIterator* SSDBImpl::scan(const Bytes &start, const Bytes &end, uint64_t limit){
 	//dump(key_start.data(), key_start.size(), "scan.start");
 	//dump(key_end.data(), key_end.size(), "scan.end");
 
-	return new KIterator(this->iterator(key_start, key_end, limit));
+	return new KIterator(this->iterator(key_start, key_end, UINT64_MAX), limit);
 }
 
 KIterator* SSDBImpl::rscan(const Bytes &start, const Bytes &end, uint64_t limit){
@@ -196,7 +235,7 @@ KIterator* SSDBImpl::rscan(const Bytes &start, const Bytes &end, uint64_t limit)
 	//dump(key_start.data(), key_start.size(), "scan.start");
 	//dump(key_end.data(), key_end.size(), "scan.end");
 
-	return new KIterator(this->rev_iterator(key_start, key_end, limit));
+	return new KIterator(this->rev_iterator(key_start, key_end, UINT64_MAX), limit);
 }
 
 int SSDBImpl::setbit(const Bytes &key, int bitoffset, int on, char log_type){
@@ -204,13 +243,18 @@ int SSDBImpl::setbit(const Bytes &key, int bitoffset, int on, char log_type){
 		log_error("empty key!");
 		return 0;
 	}
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, key);
 	
 	std::string val;
-	int ret = this->get(key, &val);
+	int64_t expire;
+	int ret = this->get_value(key, &val, &expire);
 	if(ret == -1){
 		return -1;
 	}
+	if(ret == 1 && is_expired(expire, time_ms())){
+		val.clear();
+		expire = 0;
+	}
 	
 	int len = bitoffset / 8;
 	int bit = bitoffset % 8;
@@ -225,7 +269,7 @@ int SSDBImpl::setbit(const Bytes &key, int bitoffset, int on, char log_type){
 	}
 
 	std::string buf = encode_kv_key(key);
-	binlogs->Put(buf, val);
+	this->put_value(buf, val, expire);
 	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
 	leveldb::Status s = binlogs->commit();
 	if(!s.ok()){
@@ -250,4 +294,148 @@ int SSDBImpl::getbit(const Bytes &key, int bitoffset){
 	return (val[len] & (1 << bit)) == 0? 0 : 1;
 }
 
+int SSDBImpl::setx(const Bytes &key, const Bytes &val, int64_t expire, char log_type){
+	if(key.empty()){
+		log_error("empty key!");
+		return 0;
+	}
+	Transaction trans(binlogs, key);
+
+	if(this->del_expire_index(key) == -1){
+		return -1;
+	}
+	if(expire <= 0){
+		expire = 1;
+	}
+	std::string buf = encode_kv_key(key);
+	this->put_value(buf, val, expire);
+	binlogs->Put(encode_ttl_index_key(expire, key), "");
+	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("setx error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return 1;
+}
+
+int SSDBImpl::del_expire_index(const Bytes &key){
+	std::string val;
+	int64_t expire;
+	int ret = this->get_value(key, &val, &expire);
+	if(ret == -1){
+		return -1;
+	}
+	if(ret == 1 && expire > 0){
+		binlogs->Delete(encode_ttl_index_key(expire, key));
+	}
+	return 0;
+}
+
+int SSDBImpl::get_expire(const Bytes &key, int64_t *expire){
+	std::string val;
+	int ret = this->get_value(key, &val, expire);
+	if(ret != 1){
+		return ret;
+	}
+	if(*expire == 0 || is_expired(*expire, time_ms())){
+		return 0;
+	}
+	return 1;
+}
+
+int SSDBImpl::set_expire(const Bytes &key, int64_t expire, char log_type){
+	if(key.empty()){
+		log_error("empty key!");
+		return 0;
+	}
+	Transaction trans(binlogs, key);
+
+	std::string val;
+	int64_t old;
+	int ret = this->get_value(key, &val, &old);
+	if(ret != 1 || is_expired(old, time_ms())){
+		return ret == -1? -1 : 0;
+	}
+	if(old > 0){
+		binlogs->Delete(encode_ttl_index_key(old, key));
+	}
+	if(expire <= 0){
+		expire = 1;
+	}
+	std::string buf = encode_kv_key(key);
+	this->put_value(buf, val, expire);
+	binlogs->Put(encode_ttl_index_key(expire, key), "");
+	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("set_expire error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return 1;
+}
+
+int SSDBImpl::del_expire(const Bytes &key, char log_type){
+	Transaction trans(binlogs, key);
 
+	std::string val;
+	int64_t old;
+	int ret = this->get_value(key, &val, &old);
+	if(ret != 1 || old == 0 || is_expired(old, time_ms())){
+		return ret == -1? -1 : 0;
+	}
+	binlogs->Delete(encode_ttl_index_key(old, key));
+	std::string buf = encode_kv_key(key);
+	this->put_value(buf, val, 0);
+	binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("del_expire error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return 1;
+}
+
+int64_t SSDBImpl::del_expired(const std::vector<std::string> &keys,
+		const std::vector<int64_t> &expires, int64_t now, char log_type)
+{
+	std::vector<Bytes> names(keys.begin(), keys.end());
+	Transaction trans(binlogs, names, 0, 1);
+
+	std::string log;
+	int64_t num = 0;
+	bool dirty = false;
+	for(int i=0; i<(int)keys.size(); i++){
+		const std::string &key = keys[i];
+		std::string val;
+		int64_t expire;
+		int ret = this->get_value(key, &val, &expire);
+		if(ret == -1){
+			return -1;
+		}
+		// the index entry is left behind when the key was deleted, set
+		// without an expiration, or dropped by compaction
+		if(i < (int)expires.size() && expires[i] != expire){
+			binlogs->Delete(encode_ttl_index_key(expires[i], key));
+			dirty = true;
+		}
+		if(ret == 0 || expire == 0 || expire > now){
+			continue;
+		}
+		binlogs->Delete(encode_kv_key(key));
+		binlogs->Delete(encode_ttl_index_key(expire, key));
+		encode_expired_log(&log, key);
+		num ++;
+	}
+	if(num > 0){
+		binlogs->add_log(log_type, BinlogCommand::KDEL_EXPIRED, log);
+	}else if(!dirty){
+		return 0;
+	}
+	leveldb::Status s = binlogs->commit();
+	if(!s.ok()){
+		log_error("del_expired error: %s", s.ToString().c_str());
+		return -1;
+	}
+	return num;
+}
@@ -46,4 +46,116 @@ int decode_kv_key(const Bytes &slice, std::string *key){
 	return 0;
 }
 
+/* expiration
+ *
+ * The value of a key with an expiration is prefixed with KV_EXPIRE_MAGIC
+ * and the expire time(ms), so reads and compactions(see ExpiredFilter)
+ * learn it from the value itself. A value which happens to begin with
+ * the magic is stored with an expire time of 0(never).
+ *
+ * The expirations are also kept in the TTL_INDEX, ordered by time, so
+ * the keys expired by some time are a prefix of it.
+ */
+
+#define KV_EXPIRE_MAGIC			"\xff\xfettl\x00\xfe\xff"
+static const int KV_EXPIRE_MAGIC_LEN	= 8;
+static const int KV_EXPIRE_HEADER_LEN	= KV_EXPIRE_MAGIC_LEN + sizeof(int64_t);
+
+static inline
+std::string encode_expire_time(int64_t expire){
+	expire = big_endian((uint64_t)expire);
+	return std::string((char *)&expire, sizeof(int64_t));
+}
+
+static inline
+int decode_expire_time(const Bytes &slice, int64_t *expire){
+	Decoder decoder(slice.data(), slice.size());
+	if(decoder.read_int64(expire) == -1){
+		return -1;
+	}
+	*expire = big_endian((uint64_t)*expire);
+	return 0;
+}
+
+// whether val must be stored with the header, even without an expiration
+static inline
+bool kv_value_has_magic(const Bytes &val){
+	return val.size() >= KV_EXPIRE_MAGIC_LEN
+		&& memcmp(val.data(), KV_EXPIRE_MAGIC, KV_EXPIRE_MAGIC_LEN) == 0;
+}
+
+static inline
+std::string encode_kv_header(int64_t expire){
+	std::string buf(KV_EXPIRE_MAGIC, KV_EXPIRE_MAGIC_LEN);
+	buf.append(encode_expire_time(expire));
+	return buf;
+}
+
+// @return the length of the header(0 if none), expire is 0 if none
+static inline
+int decode_kv_header(const Bytes &val, int64_t *expire){
+	*expire = 0;
+	if(val.size() < KV_EXPIRE_HEADER_LEN || !kv_value_has_magic(val)){
+		return 0;
+	}
+	decode_expire_time(Bytes(val.data() + KV_EXPIRE_MAGIC_LEN, sizeof(int64_t)), expire);
+	return KV_EXPIRE_HEADER_LEN;
+}
+
+static inline
+bool is_expired(int64_t expire, int64_t now){
+	return expire > 0 && expire <= now;
+}
+
+static inline
+std::string encode_ttl_index_key(int64_t expire, const Bytes &key){
+	std::string buf;
+	buf.append(1, DataType::TTL_INDEX);
+	buf.append(encode_expire_time(expire));
+	buf.append(key.data(), key.size());
+	return buf;
+}
+
+static inline
+int decode_ttl_index_key(const Bytes &slice, int64_t *expire, std::string *key){
+	int n = 1 + sizeof(int64_t);
+	if(slice.size() < n || slice.data()[0] != DataType::TTL_INDEX){
+		return -1;
+	}
+	decode_expire_time(Bytes(slice.data() + 1, sizeof(int64_t)), expire);
+	key->assign(slice.data() + n, slice.size() - n);
+	return 0;
+}
+
+// the keys deleted by a KDEL_EXPIRED binlog, each prefixed with its length
+static inline
+void encode_expired_log(std::string *buf, const Bytes &key){
+	uint32_t len = big_endian((uint32_t)key.size());
+	buf->append((char *)&len, sizeof(uint32_t));
+	buf->append(key.data(), key.size());
+}
+
+static inline
+int decode_expired_log(const Bytes &slice, std::vector<std::string> *keys){
+	const char *p = slice.data();
+	int size = slice.size();
+	while(size > 0){
+		uint32_t len;
+		if(size < (int)sizeof(uint32_t)){
+			return -1;
+		}
+		memcpy(&len, p, sizeof(uint32_t));
+		len = big_endian(len);
+		p += sizeof(uint32_t);
+		size -= sizeof(uint32_t);
+		if((uint32_t)size < len){
+			return -1;
+		}
+		keys->push_back(std::string(p, len));
+		p += len;
+		size -= len;
+	}
+	return 0;
+}
+
 #endif
@@ -5,8 +5,8 @@ found in the LICENSE file.
 */
 #include "t_queue.h"
 
-static int qget_by_seq(leveldb::DB* db, const Bytes &name, uint64_t seq, std::string *val){
-	std::string key = encode_qitem_key(name, seq);
+static int qget_by_seq(leveldb::DB* db, const Bytes &name, uint64_t seq, uint64_t gen, std::string *val){
+	std::string key = encode_qitem_key(name, seq, gen);
 	leveldb::Status s;
 
 	s = db->Get(leveldb::ReadOptions(), key, val);
@@ -20,10 +20,10 @@ static int qget_by_seq(leveldb::DB* db, const Bytes &name, uint64_t seq, std::st
 	}
 }
 
-static int qget_uint64(leveldb::DB* db, const Bytes &name, uint64_t seq, uint64_t *ret){
+static int qget_uint64(leveldb::DB* db, const Bytes &name, uint64_t seq, uint64_t gen, uint64_t *ret){
 	std::string val;
 	*ret = 0;
-	int s = qget_by_seq(db, name, seq, &val);
+	int s = qget_by_seq(db, name, seq, gen, &val);
 	if(s == 1){
 		if(val.size() != sizeof(uint64_t)){
 			return -1;
@@ -33,34 +33,31 @@ static int qget_uint64(leveldb::DB* db, const Bytes &name, uint64_t seq, uint64_
 	return s;
 }
 
-static int qdel_one(SSDBImpl *ssdb, const Bytes &name, uint64_t seq){
-	std::string key = encode_qitem_key(name, seq);
+static int qdel_one(SSDBImpl *ssdb, const Bytes &name, uint64_t seq, uint64_t gen){
+	std::string key = encode_qitem_key(name, seq, gen);
 	leveldb::Status s;
 
 	ssdb->binlogs->Delete(key);
 	return 0;
 }
 
-static int qset_one(SSDBImpl *ssdb, const Bytes &name, uint64_t seq, const Bytes &item){
-	std::string key = encode_qitem_key(name, seq);
+static int qset_one(SSDBImpl *ssdb, const Bytes &name, uint64_t seq, uint64_t gen, const Bytes &item){
+	std::string key = encode_qitem_key(name, seq, gen);
 	leveldb::Status s;
 
 	ssdb->binlogs->Put(key, slice(item));
 	return 0;
 }
 
-static int64_t incr_qsize(SSDBImpl *ssdb, const Bytes &name, int64_t incr){
-	int64_t size = ssdb->qsize(name);
-	if(size == -1){
+// size is the size before incr
+static int64_t incr_qsize(SSDBImpl *ssdb, const Bytes &name, int64_t size, uint64_t gen, int64_t incr){
+	size += incr;
+	if(ssdb->put_meta(encode_qsize_key(name), name, size, gen) == -1){
 		return -1;
 	}
-	size += incr;
 	if(size <= 0){
-		ssdb->binlogs->Delete(encode_qsize_key(name));
-		qdel_one(ssdb, name, QFRONT_SEQ);
-		qdel_one(ssdb, name, QBACK_SEQ);
-	}else{
-		ssdb->binlogs->Put(encode_qsize_key(name), leveldb::Slice((char *)&size, sizeof(size)));
+		qdel_one(ssdb, name, QFRONT_SEQ, gen);
+		qdel_one(ssdb, name, QBACK_SEQ, gen);
 	}
 	return size;
 }
@@ -68,63 +65,68 @@ static int64_t incr_qsize(SSDBImpl *ssdb, const Bytes &name, int64_t incr){
 /****************/
 
 int64_t SSDBImpl::qsize(const Bytes &name){
-	std::string key = encode_qsize_key(name);
-	std::string val;
-
-	leveldb::Status s;
-	s = ldb->Get(leveldb::ReadOptions(), key, &val);
-	if(s.IsNotFound()){
-		return 0;
-	}else if(!s.ok()){
-		log_error("Get() error!");
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
 		return -1;
-	}else{
-		if(val.size() != sizeof(uint64_t)){
-			return -1;
-		}
-		return *(int64_t *)val.data();
 	}
+	return size;
+}
+
+int64_t SSDBImpl::qclear(const Bytes &name, char log_type){
+	return clear(encode_qsize_key(name), name, BinlogCommand::QCLEAR, log_type);
 }
 
 // @return 0: empty queue, 1: item peeked, -1: error
 int SSDBImpl::qfront(const Bytes &name, std::string *item){
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
 	int ret = 0;
 	uint64_t seq;
-	ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &seq);
+	ret = qget_uint64(this->ldb, name, QFRONT_SEQ, gen, &seq);
 	if(ret == -1){
 		return -1;
 	}
 	if(ret == 0){
 		return 0;
 	}
-	ret = qget_by_seq(this->ldb, name, seq, item);
+	ret = qget_by_seq(this->ldb, name, seq, gen, item);
 	return ret;
 }
 
 // @return 0: empty queue, 1: item peeked, -1: error
 int SSDBImpl::qback(const Bytes &name, std::string *item){
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
 	int ret = 0;
 	uint64_t seq;
-	ret = qget_uint64(this->ldb, name, QBACK_SEQ, &seq);
+	ret = qget_uint64(this->ldb, name, QBACK_SEQ, gen, &seq);
 	if(ret == -1){
 		return -1;
 	}
 	if(ret == 0){
 		return 0;
 	}
-	ret = qget_by_seq(this->ldb, name, seq, item);
+	ret = qget_by_seq(this->ldb, name, seq, gen, item);
 	return ret;
 }
 
 int SSDBImpl::qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 	uint64_t min_seq, max_seq;
 	int ret;
-	int64_t size = this->qsize(name);
-	if(size == -1){
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
 		return -1;
 	}
-	ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &min_seq);
+	ret = qget_uint64(this->ldb, name, QFRONT_SEQ, gen, &min_seq);
 	if(ret == -1){
 		return -1;
 	}
@@ -133,12 +135,12 @@ int SSDBImpl::qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, ch
 		return 0;
 	}
 
-	ret = qset_one(this, name, seq, item);
+	ret = qset_one(this, name, seq, gen, item);
 	if(ret == -1){
 		return -1;
 	}
 
-	std::string buf = encode_qitem_key(name, seq);
+	std::string buf = encode_qitem_key(name, seq, gen);
 	binlogs->add_log(log_type, BinlogCommand::QSET, buf);
 
 	leveldb::Status s = binlogs->commit();
@@ -151,9 +153,10 @@ int SSDBImpl::qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, ch
 
 // return: 0: index out of range, -1: error, 1: ok
 int SSDBImpl::qset(const Bytes &name, int64_t index, const Bytes &item, char log_type){
-	Transaction trans(binlogs);
-	int64_t size = this->qsize(name);
-	if(size == -1){
+	Transaction trans(binlogs, name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
 		return -1;
 	}
 	if(index >= size || index < -size){
@@ -163,10 +166,10 @@ int SSDBImpl::qset(const Bytes &name, int64_t index, const Bytes &item, char log
 	int ret;
 	uint64_t seq;
 	if(index >= 0){
-		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &seq);
+		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, gen, &seq);
 		seq += index;
 	}else{
-		ret = qget_uint64(this->ldb, name, QBACK_SEQ, &seq);
+		ret = qget_uint64(this->ldb, name, QBACK_SEQ, gen, &seq);
 		seq += index + 1;
 	}
 	if(ret == -1){
@@ -176,13 +179,13 @@ int SSDBImpl::qset(const Bytes &name, int64_t index, const Bytes &item, char log
 		return 0;
 	}
 
-	ret = qset_one(this, name, seq, item);
+	ret = qset_one(this, name, seq, gen, item);
 	if(ret == -1){
 		return -1;
 	}
 
 	//log_info("qset %s %" PRIu64 "", hexmem(name.data(), name.size()).c_str(), seq);
-	std::string buf = encode_qitem_key(name, seq);
+	std::string buf = encode_qitem_key(name, seq, gen);
 	binlogs->add_log(log_type, BinlogCommand::QSET, buf);
 	
 	leveldb::Status s = binlogs->commit();
@@ -193,51 +196,75 @@ int SSDBImpl::qset(const Bytes &name, int64_t index, const Bytes &item, char log
 	return 1;
 }
 
-int64_t SSDBImpl::_qpush(const Bytes &name, const Bytes &item, uint64_t front_or_back_seq, char log_type){
-	Transaction trans(binlogs);
+// items are pushed one after another, at seqs reserved in one block
+int64_t SSDBImpl::_qpush(const Bytes &name, const std::vector<Bytes> &items, uint64_t front_or_back_seq, char log_type){
+	if(name.empty() || name.size() > SSDB_KEY_LEN_MAX){
+		log_error("empty name or name too long!");
+		return -1;
+	}
+	Transaction trans(binlogs, name);
 
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
+	if(items.empty()){
+		return size;
+	}
 	int ret;
-	// generate seq
+	uint64_t n = items.size();
+	// the seq of the first item
 	uint64_t seq;
-	ret = qget_uint64(this->ldb, name, front_or_back_seq, &seq);
+	ret = qget_uint64(this->ldb, name, front_or_back_seq, gen, &seq);
 	if(ret == -1){
 		return -1;
 	}
-	// update front and/or back
 	if(ret == 0){
 		seq = QITEM_SEQ_INIT;
-		ret = qset_one(this, name, QFRONT_SEQ, Bytes(&seq, sizeof(seq)));
-		if(ret == -1){
-			return -1;
-		}
-		ret = qset_one(this, name, QBACK_SEQ, Bytes(&seq, sizeof(seq)));
 	}else{
 		seq += (front_or_back_seq == QFRONT_SEQ)? -1 : +1;
-		ret = qset_one(this, name, front_or_back_seq, Bytes(&seq, sizeof(seq)));
-	}
-	if(ret == -1){
-		return -1;
 	}
-	if(seq <= QITEM_MIN_SEQ || seq >= QITEM_MAX_SEQ){
-		log_info("queue is full, seq: %" PRIu64 " out of range", seq);
-		return -1;
+	if(front_or_back_seq == QFRONT_SEQ){
+		if(seq <= QITEM_MIN_SEQ || seq - QITEM_MIN_SEQ <= n - 1){
+			log_info("queue is full, seq: %" PRIu64 " out of range", seq);
+			return -1;
+		}
+	}else{
+		if(seq >= QITEM_MAX_SEQ || QITEM_MAX_SEQ - seq <= n - 1){
+			log_info("queue is full, seq: %" PRIu64 " out of range", seq);
+			return -1;
+		}
 	}
 	
-	// prepend/append item
-	ret = qset_one(this, name, seq, item);
+	// update front and/or back
+	uint64_t last = (front_or_back_seq == QFRONT_SEQ)? seq - (n - 1) : seq + (n - 1);
+	if(ret == 0){
+		uint64_t other = (front_or_back_seq == QFRONT_SEQ)? QBACK_SEQ : QFRONT_SEQ;
+		ret = qset_one(this, name, other, gen, Bytes(&seq, sizeof(seq)));
+		if(ret == -1){
+			return -1;
+		}
+	}
+	ret = qset_one(this, name, front_or_back_seq, gen, Bytes(&last, sizeof(last)));
 	if(ret == -1){
 		return -1;
 	}
-
-	std::string buf = encode_qitem_key(name, seq);
-	if(front_or_back_seq == QFRONT_SEQ){
-		binlogs->add_log(log_type, BinlogCommand::QPUSH_FRONT, buf);
-	}else{
-		binlogs->add_log(log_type, BinlogCommand::QPUSH_BACK, buf);
+	
+	// prepend/append items
+	char cmd = (front_or_back_seq == QFRONT_SEQ)? BinlogCommand::QPUSH_FRONT : BinlogCommand::QPUSH_BACK;
+	for(uint64_t i=0; i<n; i++){
+		uint64_t s = (front_or_back_seq == QFRONT_SEQ)? seq - i : seq + i;
+		ret = qset_one(this, name, s, gen, items[i]);
+		if(ret == -1){
+			return -1;
+		}
+		std::string buf = encode_qitem_key(name, s, gen);
+		binlogs->add_log(log_type, cmd, buf);
 	}
 	
 	// update size
-	int64_t size = incr_qsize(this, name, +1);
+	size = incr_qsize(this, name, size, gen, n);
 	if(size == -1){
 		return -1;
 	}
@@ -251,19 +278,32 @@ int64_t SSDBImpl::_qpush(const Bytes &name, const Bytes &item, uint64_t front_or
 }
 
 int64_t SSDBImpl::qpush_front(const Bytes &name, const Bytes &item, char log_type){
-	return _qpush(name, item, QFRONT_SEQ, log_type);
+	return _qpush(name, std::vector<Bytes>(1, item), QFRONT_SEQ, log_type);
 }
 
 int64_t SSDBImpl::qpush_back(const Bytes &name, const Bytes &item, char log_type){
-	return _qpush(name, item, QBACK_SEQ, log_type);
+	return _qpush(name, std::vector<Bytes>(1, item), QBACK_SEQ, log_type);
+}
+
+int64_t SSDBImpl::qpush_front(const Bytes &name, const std::vector<Bytes> &items, char log_type){
+	return _qpush(name, items, QFRONT_SEQ, log_type);
 }
 
-int SSDBImpl::_qpop(const Bytes &name, std::string *item, uint64_t front_or_back_seq, char log_type){
-	Transaction trans(binlogs);
+int64_t SSDBImpl::qpush_back(const Bytes &name, const std::vector<Bytes> &items, char log_type){
+	return _qpush(name, items, QBACK_SEQ, log_type);
+}
+
+int64_t SSDBImpl::_qpop(const Bytes &name, uint64_t limit, std::vector<std::string> *items, uint64_t front_or_back_seq, char log_type){
+	Transaction trans(binlogs, name);
 	
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
 	int ret;
 	uint64_t seq;
-	ret = qget_uint64(this->ldb, name, front_or_back_seq, &seq);
+	ret = qget_uint64(this->ldb, name, front_or_back_seq, gen, &seq);
 	if(ret == -1){
 		return -1;
 	}
@@ -271,37 +311,43 @@ int SSDBImpl::_qpop(const Bytes &name, std::string *item, uint64_t front_or_back
 		return 0;
 	}
 	
-	ret = qget_by_seq(this->ldb, name, seq, item);
-	if(ret == -1){
-		return -1;
-	}
-	if(ret == 0){
-		return 0;
-	}
+	char cmd = (front_or_back_seq == QFRONT_SEQ)? BinlogCommand::QPOP_FRONT : BinlogCommand::QPOP_BACK;
+	int64_t count = 0;
+	while((uint64_t)count < limit && count < size){
+		std::string item;
+		ret = qget_by_seq(this->ldb, name, seq, gen, &item);
+		if(ret == -1){
+			return -1;
+		}
+		if(ret == 0){
+			break;
+		}
+		items->push_back(item);
 
-	// delete item
-	ret = qdel_one(this, name, seq);
-	if(ret == -1){
-		return -1;
-	}
+		// delete item
+		ret = qdel_one(this, name, seq, gen);
+		if(ret == -1){
+			return -1;
+		}
+		binlogs->add_log(log_type, cmd, name.String());
 
-	if(front_or_back_seq == QFRONT_SEQ){
-		binlogs->add_log(log_type, BinlogCommand::QPOP_FRONT, name.String());
-	}else{
-		binlogs->add_log(log_type, BinlogCommand::QPOP_BACK, name.String());
+		seq += (front_or_back_seq == QFRONT_SEQ)? +1 : -1;
+		count ++;
+	}
+	if(count == 0){
+		return 0;
 	}
 
 	// update size
-	int64_t size = incr_qsize(this, name, -1);
+	size = incr_qsize(this, name, size, gen, -count);
 	if(size == -1){
 		return -1;
 	}
 		
 	// update front
 	if(size > 0){
-		seq += (front_or_back_seq == QFRONT_SEQ)? +1 : -1;
 		//log_debug("seq: %" PRIu64 ", ret: %d", seq, ret);
-		ret = qset_one(this, name, front_or_back_seq, Bytes(&seq, sizeof(seq)));
+		ret = qset_one(this, name, front_or_back_seq, gen, Bytes(&seq, sizeof(seq)));
 		if(ret == -1){
 			return -1;
 		}
@@ -312,31 +358,59 @@ int SSDBImpl::_qpop(const Bytes &name, std::string *item, uint64_t front_or_back
 		log_error("Write error! %s", s.ToString().c_str());
 		return -1;
 	}
-	return 1;
+	return count;
 }
 
 // @return 0: empty queue, 1: item popped, -1: error
 int SSDBImpl::qpop_front(const Bytes &name, std::string *item, char log_type){
-	return _qpop(name, item, QFRONT_SEQ, log_type);
+	std::vector<std::string> items;
+	int64_t ret = _qpop(name, 1, &items, QFRONT_SEQ, log_type);
+	if(ret == 1){
+		item->swap(items[0]);
+	}
+	return (int)ret;
 }
 
 int SSDBImpl::qpop_back(const Bytes &name, std::string *item, char log_type){
-	return _qpop(name, item, QBACK_SEQ, log_type);
+	std::vector<std::string> items;
+	int64_t ret = _qpop(name, 1, &items, QBACK_SEQ, log_type);
+	if(ret == 1){
+		item->swap(items[0]);
+	}
+	return (int)ret;
 }
 
-static void get_qnames(Iterator *it, std::vector<std::string> *list){
-	while(it->next()){
+int64_t SSDBImpl::qpop_front(const Bytes &name, uint64_t limit, std::vector<std::string> *items, char log_type){
+	return _qpop(name, limit, items, QFRONT_SEQ, log_type);
+}
+
+int64_t SSDBImpl::qpop_back(const Bytes &name, uint64_t limit, std::vector<std::string> *items, char log_type){
+	return _qpop(name, limit, items, QBACK_SEQ, log_type);
+}
+
+static void get_qnames(Iterator *it, uint64_t limit, std::vector<std::string> *list){
+	// it is not limited, as the cleared names skipped would count
+	uint64_t num = 0;
+	while(num < limit && it->next()){
 		Bytes ks = it->key();
 		//dump(ks.data(), ks.size());
 		if(ks.data()[0] != DataType::QSIZE){
 			break;
 		}
+		int64_t size;
+		uint64_t gen;
+		decode_meta(it->val(), &size, &gen);
+		// cleared
+		if(size == 0){
+			continue;
+		}
 		std::string n;
 		uint16_t slot;
 		if(decode_qsize_key(ks, &n, &slot) == -1){
 			continue;
 		}
 		list->push_back(n);
+		num ++;
 	}
 }
 
@@ -350,8 +424,8 @@ int SSDBImpl::qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		end = encode_qsize_key(name_e);
 	}
 	
-	Iterator *it = this->iterator(start, end, limit);
-	get_qnames(it, list);
+	Iterator *it = this->iterator(start, end, UINT64_MAX);
+	get_qnames(it, limit, list);
 	delete it;
 	return 0;
 }
@@ -369,16 +443,21 @@ int SSDBImpl::qrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		end = encode_qsize_key(name_e);
 	}
 	
-	Iterator *it = this->rev_iterator(start, end, limit);
-	get_qnames(it, list);
+	Iterator *it = this->rev_iterator(start, end, UINT64_MAX);
+	get_qnames(it, limit, list);
 	delete it;
 	return 0;
 }
 
 int SSDBImpl::qfix(const Bytes &name){
-	Transaction trans(binlogs);
-	std::string key_s = encode_qitem_key(name, QITEM_MIN_SEQ - 1);
-	std::string key_e = encode_qitem_key(name, QITEM_MAX_SEQ);
+	Transaction trans(binlogs, name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
+	std::string key_s = encode_qitem_key(name, QITEM_MIN_SEQ - 1, gen);
+	std::string key_e = encode_qitem_key(name, QITEM_MAX_SEQ, gen);
 
 	bool error = false;
 	uint64_t seq_min = 0;
@@ -405,14 +484,15 @@ int SSDBImpl::qfix(const Bytes &name){
 		return -1;
 	}
 	
+	if(put_meta(encode_qsize_key(name), name, count, gen) == -1){
+		return -1;
+	}
 	if(count == 0){
-		this->binlogs->Delete(encode_qsize_key(name));
-		qdel_one(this, name, QFRONT_SEQ);
-		qdel_one(this, name, QBACK_SEQ);
+		qdel_one(this, name, QFRONT_SEQ, gen);
+		qdel_one(this, name, QBACK_SEQ, gen);
 	}else{
-		this->binlogs->Put(encode_qsize_key(name), leveldb::Slice((char *)&count, sizeof(count)));
-		qset_one(this, name, QFRONT_SEQ, Bytes(&seq_min, sizeof(seq_min)));
-		qset_one(this, name, QBACK_SEQ, Bytes(&seq_max, sizeof(seq_max)));
+		qset_one(this, name, QFRONT_SEQ, gen, Bytes(&seq_min, sizeof(seq_min)));
+		qset_one(this, name, QBACK_SEQ, gen, Bytes(&seq_max, sizeof(seq_max)));
 	}
 		
 	leveldb::Status s = binlogs->commit();
@@ -426,11 +506,16 @@ int SSDBImpl::qfix(const Bytes &name){
 int SSDBImpl::qslice(const Bytes &name, int64_t begin, int64_t end,
 		std::vector<std::string> *list)
 {
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
 	int ret;
 	uint64_t seq_begin, seq_end;
 	if(begin >= 0 && end >= 0){
 		uint64_t tmp_seq;
-		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &tmp_seq);
+		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, gen, &tmp_seq);
 		if(ret != 1){
 			return ret;
 		}
@@ -438,7 +523,7 @@ int SSDBImpl::qslice(const Bytes &name, int64_t begin, int64_t end,
 		seq_end = tmp_seq + end;
 	}else if(begin < 0 && end < 0){
 		uint64_t tmp_seq;
-		ret = qget_uint64(this->ldb, name, QBACK_SEQ, &tmp_seq);
+		ret = qget_uint64(this->ldb, name, QBACK_SEQ, gen, &tmp_seq);
 		if(ret != 1){
 			return ret;
 		}
@@ -446,11 +531,11 @@ int SSDBImpl::qslice(const Bytes &name, int64_t begin, int64_t end,
 		seq_end = tmp_seq + end + 1;
 	}else{
 		uint64_t f_seq, b_seq;
-		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &f_seq);
+		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, gen, &f_seq);
 		if(ret != 1){
 			return ret;
 		}
-		ret = qget_uint64(this->ldb, name, QBACK_SEQ, &b_seq);
+		ret = qget_uint64(this->ldb, name, QBACK_SEQ, gen, &b_seq);
 		if(ret != 1){
 			return ret;
 		}
@@ -468,7 +553,7 @@ int SSDBImpl::qslice(const Bytes &name, int64_t begin, int64_t end,
 	
 	for(; seq_begin <= seq_end; seq_begin++){
 		std::string item;
-		ret = qget_by_seq(this->ldb, name, seq_begin, &item);
+		ret = qget_by_seq(this->ldb, name, seq_begin, gen, &item);
 		if(ret == -1){
 			return -1;
 		}
@@ -481,13 +566,18 @@ int SSDBImpl::qslice(const Bytes &name, int64_t begin, int64_t end,
 }
 
 int SSDBImpl::qget(const Bytes &name, int64_t index, std::string *item){
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_qsize_key(name), &size, &gen) == -1){
+		return -1;
+	}
 	int ret;
 	uint64_t seq;
 	if(index >= 0){
-		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &seq);
+		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, gen, &seq);
 		seq += index;
 	}else{
-		ret = qget_uint64(this->ldb, name, QBACK_SEQ, &seq);
+		ret = qget_uint64(this->ldb, name, QBACK_SEQ, gen, &seq);
 		seq += index + 1;
 	}
 	if(ret == -1){
@@ -497,6 +587,6 @@ int SSDBImpl::qget(const Bytes &name, int64_t index, std::string *item){
 		return 0;
 	}
 	
-	ret = qget_by_seq(this->ldb, name, seq, item);
+	ret = qget_by_seq(this->ldb, name, seq, gen, item);
 	return ret;
 }
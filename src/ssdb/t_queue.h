@@ -41,23 +41,22 @@ int decode_qsize_key(const Bytes &slice, std::string *name, uint16_t *slot){
 }
 
 inline static
-std::string encode_qitem_key(const Bytes &name, uint64_t seq){
+std::string encode_qitem_key(const Bytes &name, uint64_t seq, uint64_t gen){
 	std::string buf;
 	buf.append(1, DataType::QUEUE);
-	buf.append(1, (uint8_t)name.size());
-	buf.append(name.data(), name.size());
+	encode_item_name(&buf, name, gen);
 	seq = big_endian(seq);
 	buf.append((char *)&seq, sizeof(uint64_t));
 	return buf;
 }
 
 inline static
-int decode_qitem_key(const Bytes &slice, std::string *name, uint64_t *seq){
+int decode_qitem_key(const Bytes &slice, std::string *name, uint64_t *seq, uint64_t *gen=NULL){
 	Decoder decoder(slice.data(), slice.size());
 	if(decoder.skip(1) == -1){
 		return -1;
 	}
-	if(decoder.read_8_data(name) == -1){
+	if(decode_item_name(&decoder, name, gen) == -1){
 		return -1;
 	}
 	if(decoder.read_uint64(seq) == -1){
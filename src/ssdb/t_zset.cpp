@@ -4,26 +4,254 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include <limits.h>
+#include <map>
 #include "../include.h"
 #include "t_zset.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
 
 static const char *SSDB_SCORE_MIN		= "-9223372036854775808";
 static const char *SSDB_SCORE_MAX		= "+9223372036854775807";
 
-static int zset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, char log_type);
-static int zdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, char log_type);
-static int incr_zsize(SSDBImpl *ssdb, const Bytes &name, int64_t incr);
+static int zset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, uint64_t gen, char log_type);
+static int zdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, uint64_t gen, char log_type);
+static int zrank_update(SSDBImpl *ssdb, const Bytes &name, uint64_t gen,
+		const std::string *old_score, const std::string *new_score);
+static int zrank_rebuild(leveldb::DB *ldb, const Bytes &name, uint64_t gen);
+
+/* rank index
+ *
+ * A radix tree over the 8 bytes of the score, stored as ZRANK keys. A node
+ * of level n counts the items whose score starts with its n bytes, and sums
+ * their scores, so the root(level 0) covers all the items and a leaf(level
+ * 8) the items of one score. The rank of an item is the sum of the nodes
+ * which sort before its path, plus the items of the same score with a
+ * smaller key, at most 8 * 255 nodes whatever the size of the zset. The
+ * count and sum of a score range are taken the same way at both ends.
+ *
+ * Zsets written before the index existed are not indexed(the root does
+ * not match zsize), they are ranked by scanning, until zfix rebuilds the
+ * index.
+ */
+
+static const int ZRANK_LEVELS = 8;
+// smaller offsets are skipped by the iterator, cheaper than the index
+static const uint64_t ZRANGE_SCAN_MAX = 100;
+
+// scores are mapped to unsigned, so that their bytes sort as they do
+static void zrank_score(const Bytes &score, char *buf){
+	uint64_t u = (uint64_t)score.Int64() ^ (1ULL << 63);
+	u = big_endian(u);
+	memcpy(buf, &u, sizeof(u));
+}
+
+static std::string zrank_score_str(const char *buf){
+	uint64_t u;
+	memcpy(&u, buf, sizeof(u));
+	u = big_endian(u);
+	return str((int64_t)(u ^ (1ULL << 63)));
+}
+
+// a node is the count of items followed by the sum of their scores,
+// the sum wraps around on overflow
+static const int ZRANK_NODE_SIZE = 2 * sizeof(int64_t);
+
+// pending changes of the nodes, key => (count, sum), the nodes shared by
+// the items updated in one transaction are written once
+typedef std::map<std::string, std::pair<int64_t, uint64_t> > ZRankDelta;
+
+static int zrank_indexed(SSDBImpl *ssdb, const Bytes &name, uint64_t gen);
+static void zrank_diff(ZRankDelta *delta, const Bytes &name, uint64_t gen,
+		const std::string *old_score, const std::string *new_score);
+static int zrank_apply(SSDBImpl *ssdb, const ZRankDelta &delta);
+
+static int64_t zrank_count(const leveldb::Slice &val){
+	if(val.size() != ZRANK_NODE_SIZE){
+		return 0;
+	}
+	int64_t ret;
+	memcpy(&ret, val.data(), sizeof(ret));
+	return ret;
+}
+
+static int64_t zrank_sum(const leveldb::Slice &val){
+	if(val.size() != ZRANK_NODE_SIZE){
+		return 0;
+	}
+	int64_t ret;
+	memcpy(&ret, val.data() + sizeof(int64_t), sizeof(ret));
+	return ret;
+}
+
+static std::string zrank_node(int64_t count, int64_t sum){
+	std::string buf;
+	buf.append((char *)&count, sizeof(int64_t));
+	buf.append((char *)&sum, sizeof(int64_t));
+	return buf;
+}
+
+// Reads the index of a zset from a snapshot of the db.
+class ZRankReader
+{
+public:
+	// the generation of the zset
+	uint64_t gen;
+
+	ZRankReader(leveldb::DB *ldb, const Bytes &name){
+		this->name = name;
+		this->zsize = 0;
+		this->gen = 0;
+		it = ldb->NewIterator(leveldb::ReadOptions());
+		if(seek(encode_zsize_key(name))){
+			Bytes val(it->value().data(), it->value().size());
+			decode_meta(val, &zsize, &gen);
+		}
+	}
+	~ZRankReader(){
+		delete it;
+	}
+
+	// 0 if the zset is not indexed
+	int64_t size(){
+		if(zsize <= 0 || !seek(encode_zrank_key(name, gen, 0, "")) || zrank_count(it->value()) != zsize){
+			return 0;
+		}
+		return zsize;
+	}
+
+	// count the items whose score is less than score(or equal, if
+	// inclusive), and sum their scores
+	void less(const Bytes &score, bool inclusive, int64_t *count, int64_t *sum){
+		char path[ZRANK_LEVELS];
+		zrank_score(score, path);
+		uint64_t c = 0, s = 0;
+		for(int level=1; level<=ZRANK_LEVELS; level++){
+			// the siblings with a smaller byte
+			std::string end = encode_zrank_key(name, gen, level, path);
+			std::string start(end.data(), end.size() - 1);
+			for(it->Seek(start); it->Valid() && it->key().compare(end) < 0; it->Next()){
+				c += zrank_count(it->value());
+				s += zrank_sum(it->value());
+			}
+			if(inclusive && level == ZRANK_LEVELS && seek(end)){
+				c += zrank_count(it->value());
+				s += zrank_sum(it->value());
+			}
+		}
+		*count = (int64_t)c;
+		*sum = (int64_t)s;
+	}
+
+	void total(int64_t *count, int64_t *sum){
+		*count = 0;
+		*sum = 0;
+		if(seek(encode_zrank_key(name, gen, 0, ""))){
+			*count = zrank_count(it->value());
+			*sum = zrank_sum(it->value());
+		}
+	}
+
+	// @return -1: not found, others: the number of items before key
+	int64_t rank(const Bytes &key){
+		std::string buf = encode_zset_key(name, key, gen);
+		it->Seek(buf);
+		if(!it->Valid() || it->key() != buf){
+			return -1;
+		}
+		std::string score = it->value().ToString();
+
+		int64_t ret, sum;
+		less(score, false, &ret, &sum);
+		// items of the same score are sorted by key
+		std::string start = encode_zscore_key(name, "", score, gen);
+		std::string end = encode_zscore_key(name, key, score, gen);
+		for(it->Seek(start); it->Valid() && it->key().compare(end) < 0; it->Next()){
+			ret ++;
+		}
+		return ret;
+	}
+
+	// find the item at rank, *offset is set to its position among the
+	// items of the same score
+	// @return -1: error, 0: not found, 1: found
+	int find(int64_t rank, std::string *score, int64_t *offset){
+		char path[ZRANK_LEVELS];
+		memset(path, 0, sizeof(path));
+		for(int level=1; level<=ZRANK_LEVELS; level++){
+			std::string parent = encode_zrank_key(name, gen, level, path);
+			parent.resize(parent.size() - 1);
+			bool found = false;
+			for(it->Seek(parent); it->Valid() && it->key().starts_with(parent); it->Next()){
+				int64_t count = zrank_count(it->value());
+				if(rank < count){
+					path[level - 1] = it->key()[parent.size()];
+					found = true;
+					break;
+				}
+				rank -= count;
+			}
+			if(!found){
+				if(level > 1){
+					log_error("corrupted zset rank index, name: %s",
+						hexmem(name.data(), name.size()).c_str());
+					return -1;
+				}
+				return 0;
+			}
+		}
+		*score = zrank_score_str(path);
+		*offset = rank;
+		return 1;
+	}
+
+	// the key of the item at offset among the items of score
+	int key_at(const std::string &score, int64_t offset, std::string *key){
+		it->Seek(encode_zscore_key(name, "", score, gen));
+		for(; it->Valid() && offset > 0; offset--){
+			it->Next();
+		}
+		if(!it->Valid()){
+			return 0;
+		}
+		Bytes ks(it->key().data(), it->key().size());
+		std::string name2, score2;
+		uint64_t gen2;
+		if(ks.data()[0] != DataType::ZSCORE || decode_zscore_key(ks, &name2, key, &score2, &gen2) == -1){
+			return 0;
+		}
+		if(name != name2 || gen != gen2 || score != score2){
+			return 0;
+		}
+		return 1;
+	}
+
+private:
+	Bytes name;
+	int64_t zsize;
+	leveldb::Iterator *it;
+
+	bool seek(const std::string &key){
+		it->Seek(key);
+		return it->Valid() && it->key() == key;
+	}
+};
 
 /**
  * @return -1: error, 0: item updated, 1: new item inserted
  */
 int SSDBImpl::zset(const Bytes &name, const Bytes &key, const Bytes &score, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 
-	int ret = zset_one(this, name, key, score, log_type);
+	std::string size_key = encode_zsize_key(name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
+	int ret = zset_one(this, name, key, score, gen, log_type);
 	if(ret >= 0){
 		if(ret > 0){
-			if(incr_zsize(this, name, ret) == -1){
+			if(put_meta(size_key, name, size + ret, gen) == -1){
 				return -1;
 			}
 		}
@@ -37,12 +265,18 @@ int SSDBImpl::zset(const Bytes &name, const Bytes &key, const Bytes &score, char
 }
 
 int SSDBImpl::zdel(const Bytes &name, const Bytes &key, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 
-	int ret = zdel_one(this, name, key, log_type);
+	std::string size_key = encode_zsize_key(name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
+	int ret = zdel_one(this, name, key, gen, log_type);
 	if(ret >= 0){
 		if(ret > 0){
-			if(incr_zsize(this, name, -ret) == -1){
+			if(put_meta(size_key, name, size - ret, gen) == -1){
 				return -1;
 			}
 		}
@@ -55,11 +289,120 @@ int SSDBImpl::zdel(const Bytes &name, const Bytes &key, char log_type){
 	return ret;
 }
 
+// items deleted in one transaction
+static const int ZDEL_RANGE_BATCH = 1000;
+
+int64_t SSDBImpl::zdel_range(const Bytes &name,
+		const Bytes &score_start, const Bytes &key_start,
+		const Bytes &score_end, const Bytes &key_end,
+		uint64_t limit, char log_type)
+{
+	if(name.empty() || name.size() > SSDB_KEY_LEN_MAX){
+		return 0;
+	}
+	int64_t end = score_end.empty()? INT64_MAX : score_end.Int64();
+	// where the next batch starts
+	std::string next_score = score_start.empty()? SSDB_SCORE_MIN : score_start.String();
+	std::string next_key = key_start.String();
+	bool first = true;
+	int64_t count = 0;
+
+	leveldb::ReadOptions opts;
+	opts.fill_cache = false;
+	std::string size_key = encode_zsize_key(name);
+	while((uint64_t)count < limit){
+		Transaction trans(binlogs, name);
+
+		int64_t size;
+		uint64_t gen;
+		if(get_meta(size_key, &size, &gen) == -1){
+			return -1;
+		}
+		if(size == 0){
+			break;
+		}
+		int indexed = zrank_indexed(this, name, gen);
+		if(indexed == -1){
+			return -1;
+		}
+
+		std::string prefix(1, DataType::ZSCORE);
+		encode_item_name(&prefix, name, gen);
+		std::string start = encode_zscore_key(name, next_key, next_score, gen);
+		if(!first){
+			start.append(1, '\0');
+		}
+		ZRankDelta delta;
+		std::string first_key, first_score;
+		bool done = false;
+		int num = 0;
+		leveldb::Iterator *it = ldb->NewIterator(opts);
+		for(it->Seek(start); num < ZDEL_RANGE_BATCH && (uint64_t)(count + num) < limit; it->Next()){
+			if(!it->Valid() || !it->key().starts_with(prefix)){
+				done = true;
+				break;
+			}
+			Bytes ks(it->key().data(), it->key().size());
+			std::string key, score;
+			if(decode_zscore_key(ks, NULL, &key, &score) == -1){
+				continue;
+			}
+			int64_t s = str_to_int64(score);
+			if(s > end || (s == end && !key_end.empty() && Bytes(key).compare(key_end) > 0)){
+				done = true;
+				break;
+			}
+			binlogs->Delete(it->key());
+			binlogs->Delete(encode_zset_key(name, key, gen));
+			if(indexed){
+				zrank_diff(&delta, name, gen, &score, NULL);
+			}
+			if(num == 0){
+				first_key = key;
+				first_score = score;
+			}
+			next_key = key;
+			next_score = score;
+			num ++;
+		}
+		delete it;
+		if(num == 0){
+			break;
+		}
+		first = false;
+
+		if(zrank_apply(this, delta) == -1){
+			return -1;
+		}
+		if(put_meta(size_key, name, size - num, gen) == -1){
+			return -1;
+		}
+		std::string buf = encode_zdel_range_log(name, first_score, first_key, next_score, next_key);
+		binlogs->add_log(log_type, BinlogCommand::ZDEL_RANGE, buf);
+		leveldb::Status s = binlogs->commit();
+		if(!s.ok()){
+			log_error("zdel_range error: %s", s.ToString().c_str());
+			return -1;
+		}
+		count += num;
+		if(done){
+			break;
+		}
+	}
+	return count;
+}
+
 int SSDBImpl::zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 
+	std::string size_key = encode_zsize_key(name);
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(size_key, &size, &gen) == -1){
+		return -1;
+	}
 	std::string old;
-	int ret = this->zget(name, key, &old);
+	int ret = get_item(encode_zset_key(name, key, gen), &old);
 	if(ret == -1){
 		return -1;
 	}else if(ret == 0){
@@ -68,13 +411,13 @@ int SSDBImpl::zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *ne
 		*new_val = str_to_int64(old) + by;
 	}
 
-	ret = zset_one(this, name, key, str(*new_val), log_type);
+	ret = zset_one(this, name, key, str(*new_val), gen, log_type);
 	if(ret == -1){
 		return -1;
 	}
 	if(ret >= 0){
 		if(ret > 0){
-			if(incr_zsize(this, name, ret) == -1){
+			if(put_meta(size_key, name, size + ret, gen) == -1){
 				return -1;
 			}
 		}
@@ -88,78 +431,73 @@ int SSDBImpl::zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *ne
 }
 
 int64_t SSDBImpl::zsize(const Bytes &name){
-	std::string size_key = encode_zsize_key(name);
-	std::string val;
-	leveldb::Status s;
-
-	s = ldb->Get(leveldb::ReadOptions(), size_key, &val);
-	if(s.IsNotFound()){
-		return 0;
-	}else if(!s.ok()){
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_zsize_key(name), &size, &gen) == -1){
 		return -1;
-	}else{
-		if(val.size() != sizeof(uint64_t)){
-			return 0;
-		}
-		int64_t ret = *(int64_t *)val.data();
-		return ret < 0? 0 : ret;
 	}
+	return size;
 }
 
 int SSDBImpl::zget(const Bytes &name, const Bytes &key, std::string *score){
-	std::string buf = encode_zset_key(name, key);
-	leveldb::Status s = ldb->Get(leveldb::ReadOptions(), buf, score);
-	if(s.IsNotFound()){
-		return 0;
-	}
-	if(!s.ok()){
-		log_error("zget error: %s", s.ToString().c_str());
+	int64_t size;
+	uint64_t gen;
+	if(get_meta(encode_zsize_key(name), &size, &gen) == -1){
 		return -1;
 	}
-	return 1;
+	if(size == 0){
+		return 0;
+	}
+	return get_item(encode_zset_key(name, key, gen), score);
+}
+
+int64_t SSDBImpl::zclear(const Bytes &name, char log_type){
+	return clear(encode_zsize_key(name), name, BinlogCommand::ZCLEAR, log_type);
 }
 
 static ZIterator* ziterator(
 	SSDBImpl *ssdb,
-	const Bytes &name, const Bytes &key_start,
+	const Bytes &name, uint64_t gen, const Bytes &key_start,
 	const Bytes &score_start, const Bytes &score_end,
 	uint64_t limit, Iterator::Direction direction)
 {
 	if(direction == Iterator::FORWARD){
 		std::string start, end;
 		if(score_start.empty()){
-			start = encode_zscore_key(name, key_start, SSDB_SCORE_MIN);
+			start = encode_zscore_key(name, key_start, SSDB_SCORE_MIN, gen);
 		}else{
-			start = encode_zscore_key(name, key_start, score_start);
+			start = encode_zscore_key(name, key_start, score_start, gen);
 		}
 		if(score_end.empty()){
-			end = encode_zscore_key(name, "\xff", SSDB_SCORE_MAX);
+			end = encode_zscore_key(name, "\xff", SSDB_SCORE_MAX, gen);
 		}else{
-			end = encode_zscore_key(name, "\xff", score_end);
+			end = encode_zscore_key(name, "\xff", score_end, gen);
 		}
 		return new ZIterator(ssdb->iterator(start, end, limit), name);
 	}else{
 		std::string start, end;
 		if(score_start.empty()){
-			start = encode_zscore_key(name, key_start, SSDB_SCORE_MAX);
+			start = encode_zscore_key(name, key_start, SSDB_SCORE_MAX, gen);
 		}else{
 			if(key_start.empty()){
-				start = encode_zscore_key(name, "\xff", score_start);
+				start = encode_zscore_key(name, "\xff", score_start, gen);
 			}else{
-				start = encode_zscore_key(name, key_start, score_start);
+				start = encode_zscore_key(name, key_start, score_start, gen);
 			}
 		}
 		if(score_end.empty()){
-			end = encode_zscore_key(name, "", SSDB_SCORE_MIN);
+			end = encode_zscore_key(name, "", SSDB_SCORE_MIN, gen);
 		}else{
-			end = encode_zscore_key(name, "", score_end);
+			end = encode_zscore_key(name, "", score_end, gen);
 		}
 		return new ZIterator(ssdb->rev_iterator(start, end, limit), name);
 	}
 }
 
-int64_t SSDBImpl::zrank(const Bytes &name, const Bytes &key){
-	ZIterator *it = ziterator(this, name, "", "", "", INT_MAX, Iterator::FORWARD);
+static int64_t zrank_scan(SSDBImpl *ssdb, const Bytes &name, uint64_t gen, const Bytes &key,
+		Iterator::Direction direction)
+{
+	ZIterator *it = ziterator(ssdb, name, gen, "", "", "", INT_MAX, direction);
 	uint64_t ret = 0;
 	while(true){
 		if(it->next() == false){
@@ -175,80 +513,171 @@ int64_t SSDBImpl::zrank(const Bytes &name, const Bytes &key){
 	return ret;
 }
 
+int64_t SSDBImpl::zrank(const Bytes &name, const Bytes &key){
+	ZRankReader index(ldb, name);
+	if(index.size() == 0){
+		return zrank_scan(this, name, index.gen, key, Iterator::FORWARD);
+	}
+	return index.rank(key);
+}
+
 int64_t SSDBImpl::zrrank(const Bytes &name, const Bytes &key){
-	ZIterator *it = ziterator(this, name, "", "", "", INT_MAX, Iterator::BACKWARD);
-	uint64_t ret = 0;
-	while(true){
-		if(it->next() == false){
-			ret = -1;
-			break;
-		}
-		if(key == it->key){
-			break;
-		}
-		ret ++;
+	ZRankReader index(ldb, name);
+	int64_t size = index.size();
+	if(size == 0){
+		return zrank_scan(this, name, index.gen, key, Iterator::BACKWARD);
 	}
-	delete it;
-	return ret;
+	int64_t ret = index.rank(key);
+	if(ret == -1){
+		return -1;
+	}
+	return size - 1 - ret;
 }
 
 ZIterator* SSDBImpl::zrange(const Bytes &name, uint64_t offset, uint64_t limit){
+	ZRankReader index(ldb, name);
+	uint64_t gen = index.gen;
+	if(offset > ZRANGE_SCAN_MAX){
+		int64_t size = index.size();
+		if(size > 0){
+			std::string score;
+			int64_t ties;
+			if(offset >= (uint64_t)size || index.find(offset, &score, &ties) != 1){
+				return ziterator(this, name, gen, "", "", "", 0, Iterator::FORWARD);
+			}
+			if(ties + limit > limit){
+				limit = ties + limit;
+			}
+			ZIterator *it = ziterator(this, name, gen, "", score, "", limit, Iterator::FORWARD);
+			it->skip(ties);
+			return it;
+		}
+	}
 	if(offset + limit > limit){
 		limit = offset + limit;
 	}
-	ZIterator *it = ziterator(this, name, "", "", "", limit, Iterator::FORWARD);
+	ZIterator *it = ziterator(this, name, gen, "", "", "", limit, Iterator::FORWARD);
 	it->skip(offset);
 	return it;
 }
 
 ZIterator* SSDBImpl::zrrange(const Bytes &name, uint64_t offset, uint64_t limit){
+	ZRankReader index(ldb, name);
+	uint64_t gen = index.gen;
+	if(offset > ZRANGE_SCAN_MAX){
+		int64_t size = index.size();
+		if(size > 0){
+			std::string score, key;
+			int64_t ties;
+			if(offset >= (uint64_t)size
+				|| index.find(size - 1 - offset, &score, &ties) != 1
+				|| index.key_at(score, ties, &key) != 1)
+			{
+				return ziterator(this, name, gen, "", "", "", 0, Iterator::BACKWARD);
+			}
+			// the iterator starts right before key_start, exclusive
+			key.append(1, '\0');
+			return ziterator(this, name, gen, key, score, "", limit, Iterator::BACKWARD);
+		}
+	}
 	if(offset + limit > limit){
 		limit = offset + limit;
 	}
-	ZIterator *it = ziterator(this, name, "", "", "", limit, Iterator::BACKWARD);
+	ZIterator *it = ziterator(this, name, gen, "", "", "", limit, Iterator::BACKWARD);
 	it->skip(offset);
 	return it;
 }
 
+int SSDBImpl::zaggregate(const Bytes &name, const Bytes &score_start, const Bytes &score_end,
+		int64_t *count, int64_t *sum)
+{
+	*count = 0;
+	*sum = 0;
+	ZRankReader index(ldb, name);
+	uint64_t gen = index.gen;
+	if(index.size() > 0){
+		int64_t c0 = 0, s0 = 0;
+		int64_t c1, s1;
+		if(!score_start.empty()){
+			index.less(score_start, false, &c0, &s0);
+		}
+		if(score_end.empty()){
+			index.total(&c1, &s1);
+		}else{
+			index.less(score_end, true, &c1, &s1);
+		}
+		// empty if score_start > score_end
+		if(c1 > c0){
+			*count = c1 - c0;
+			*sum = (int64_t)((uint64_t)s1 - (uint64_t)s0);
+		}
+		return 0;
+	}
+
+	ZIterator *it = ziterator(this, name, gen, "", score_start, score_end, -1, Iterator::FORWARD);
+	while(it->next()){
+		*sum += str_to_int64(it->score);
+		*count += 1;
+	}
+	delete it;
+	return 0;
+}
+
 ZIterator* SSDBImpl::zscan(const Bytes &name, const Bytes &key,
 		const Bytes &score_start, const Bytes &score_end, uint64_t limit)
 {
 	std::string score;
+	int64_t size;
+	uint64_t gen;
+	get_meta(encode_zsize_key(name), &size, &gen);
 	// if only key is specified, load its value
 	if(!key.empty() && score_start.empty()){
-		this->zget(name, key, &score);
+		get_item(encode_zset_key(name, key, gen), &score);
 	}else{
 		score = score_start.String();
 	}
-	return ziterator(this, name, key, score, score_end, limit, Iterator::FORWARD);
+	return ziterator(this, name, gen, key, score, score_end, limit, Iterator::FORWARD);
 }
 
 ZIterator* SSDBImpl::zrscan(const Bytes &name, const Bytes &key,
 		const Bytes &score_start, const Bytes &score_end, uint64_t limit)
 {
 	std::string score;
+	int64_t size;
+	uint64_t gen;
+	get_meta(encode_zsize_key(name), &size, &gen);
 	// if only key is specified, load its value
 	if(!key.empty() && score_start.empty()){
-		this->zget(name, key, &score);
+		get_item(encode_zset_key(name, key, gen), &score);
 	}else{
 		score = score_start.String();
 	}
-	return ziterator(this, name, key, score, score_end, limit, Iterator::BACKWARD);
+	return ziterator(this, name, gen, key, score, score_end, limit, Iterator::BACKWARD);
 }
 
-static void get_znames(Iterator *it, std::vector<std::string> *list){
-	while(it->next()){
+static void get_znames(Iterator *it, uint64_t limit, std::vector<std::string> *list){
+	// it is not limited, as the cleared names skipped would count
+	uint64_t num = 0;
+	while(num < limit && it->next()){
 		Bytes ks = it->key();
 		//dump(ks.data(), ks.size());
 		if(ks.data()[0] != DataType::ZSIZE){
 			break;
 		}
+		int64_t size;
+		uint64_t gen;
+		decode_meta(it->val(), &size, &gen);
+		// cleared
+		if(size == 0){
+			continue;
+		}
 		std::string n;
 		uint16_t slot;
 		if(decode_zsize_key(ks, &n, &slot) == -1){
 			continue;
 		}
 		list->push_back(n);
+		num ++;
 	}
 }
 
@@ -262,8 +691,8 @@ int SSDBImpl::zlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		end = encode_zsize_key(name_e);
 	}
 	
-	Iterator *it = this->iterator(start, end, limit);
-	get_znames(it, list);
+	Iterator *it = this->iterator(start, end, UINT64_MAX);
+	get_znames(it, limit, list);
 	delete it;
 	return 0;
 }
@@ -281,8 +710,8 @@ int SSDBImpl::zrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		end = encode_zsize_key(name_e);
 	}
 
-	Iterator *it = this->rev_iterator(start, end, limit);
-	get_znames(it, list);
+	Iterator *it = this->rev_iterator(start, end, UINT64_MAX);
+	get_znames(it, limit, list);
 	delete it;
 	return 0;
 }
@@ -293,7 +722,7 @@ static std::string filter_score(const Bytes &score){
 }
 
 // returns the number of newly added items
-static int zset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, char log_type){
+static int zset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, uint64_t gen, char log_type){
 	if(name.empty() || key.empty()){
 		log_error("empty name or key!");
 		return 0;
@@ -309,31 +738,38 @@ static int zset_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, const B
 	}
 	std::string new_score = filter_score(score);
 	std::string old_score;
-	int found = ssdb->zget(name, key, &old_score);
+	int found = ssdb->get_item(encode_zset_key(name, key, gen), &old_score);
+	if(found == -1){
+		return -1;
+	}
 	if(found == 0 || old_score != new_score){
 		std::string k0, k1, k2;
 
 		if(found){
 			// delete zscore key
-			k1 = encode_zscore_key(name, key, old_score);
+			k1 = encode_zscore_key(name, key, old_score, gen);
 			ssdb->binlogs->Delete(k1);
 		}
 
 		// add zscore key
-		k2 = encode_zscore_key(name, key, new_score);
+		k2 = encode_zscore_key(name, key, new_score, gen);
 		ssdb->binlogs->Put(k2, "");
 
 		// update zset
-		k0 = encode_zset_key(name, key);
+		k0 = encode_zset_key(name, key, gen);
 		ssdb->binlogs->Put(k0, new_score);
 		ssdb->binlogs->add_log(log_type, BinlogCommand::ZSET, k0);
 
+		if(zrank_update(ssdb, name, gen, found? &old_score : NULL, &new_score) == -1){
+			return -1;
+		}
+
 		return found? 0 : 1;
 	}
 	return 0;
 }
 
-static int zdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, char log_type){
+static int zdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, uint64_t gen, char log_type){
 	if(name.size() > SSDB_KEY_LEN_MAX ){
 		log_error("name too long!");
 		return -1;
@@ -343,46 +779,212 @@ static int zdel_one(SSDBImpl *ssdb, const Bytes &name, const Bytes &key, char lo
 		return -1;
 	}
 	std::string old_score;
-	int found = ssdb->zget(name, key, &old_score);
+	int found = ssdb->get_item(encode_zset_key(name, key, gen), &old_score);
 	if(found != 1){
-		return 0;
+		return found;
 	}
 
 	std::string k0, k1;
 	// delete zscore key
-	k1 = encode_zscore_key(name, key, old_score);
+	k1 = encode_zscore_key(name, key, old_score, gen);
 	ssdb->binlogs->Delete(k1);
 
 	// delete zset
-	k0 = encode_zset_key(name, key);
+	k0 = encode_zset_key(name, key, gen);
 	ssdb->binlogs->Delete(k0);
 	ssdb->binlogs->add_log(log_type, BinlogCommand::ZDEL, k0);
 
+	if(zrank_update(ssdb, name, gen, &old_score, NULL) == -1){
+		return -1;
+	}
+
 	return 1;
 }
 
-static int incr_zsize(SSDBImpl *ssdb, const Bytes &name, int64_t incr){
+// updates the nodes of levels [from, to] on path
+static void zrank_incr(ZRankDelta *delta, const Bytes &name, uint64_t gen, const char *path,
+		int from, int to, int64_t count_incr, int64_t sum_incr)
+{
+	for(int level=from; level<=to; level++){
+		std::pair<int64_t, uint64_t> &d = (*delta)[encode_zrank_key(name, gen, level, path)];
+		d.first += count_incr;
+		d.second += (uint64_t)sum_incr;
+	}
+}
+
+static int zrank_apply(SSDBImpl *ssdb, const ZRankDelta &delta){
+	ZRankDelta::const_iterator it;
+	for(it=delta.begin(); it!=delta.end(); it++){
+		if(it->second.first == 0 && it->second.second == 0){
+			continue;
+		}
+		std::string val;
+		if(ssdb->raw_get(it->first, &val) == -1){
+			return -1;
+		}
+		int64_t count = zrank_count(val) + it->second.first;
+		int64_t sum = (int64_t)((uint64_t)zrank_sum(val) + it->second.second);
+		if(count <= 0){
+			ssdb->binlogs->Delete(it->first);
+		}else{
+			ssdb->binlogs->Put(it->first, zrank_node(count, sum));
+		}
+	}
+	return 0;
+}
+
+// must be called before zsize is updated
+// @return -1: error, 0: not indexed, 1: indexed
+static int zrank_indexed(SSDBImpl *ssdb, const Bytes &name, uint64_t gen){
+	std::string val;
+	if(ssdb->raw_get(encode_zrank_key(name, gen, 0, ""), &val) == -1){
+		return -1;
+	}
 	int64_t size = ssdb->zsize(name);
-	size += incr;
-	std::string size_key = encode_zsize_key(name);
-	if(size == 0){
-		ssdb->binlogs->Delete(size_key);
-	}else{
-		ssdb->binlogs->Put(size_key, leveldb::Slice((char *)&size, sizeof(int64_t)));
+	if(size == -1){
+		return -1;
+	}
+	if(size > 0 && (val.size() != ZRANK_NODE_SIZE || zrank_count(val) != size)){
+		return 0;
+	}
+	return 1;
+}
+
+// old_score or new_score is NULL if the item is inserted or deleted
+static void zrank_diff(ZRankDelta *delta, const Bytes &name, uint64_t gen,
+		const std::string *old_score, const std::string *new_score)
+{
+	char old_path[ZRANK_LEVELS];
+	char new_path[ZRANK_LEVELS];
+	int64_t old_val = 0, new_val = 0;
+	if(old_score){
+		zrank_score(*old_score, old_path);
+		old_val = str_to_int64(*old_score);
+	}
+	if(new_score){
+		zrank_score(*new_score, new_path);
+		new_val = str_to_int64(*new_score);
+	}
+	int from = 0;
+	if(old_score && new_score){
+		// the nodes above the first different byte are shared, only
+		// their sums change
+		while(from < ZRANK_LEVELS && old_path[from] == new_path[from]){
+			from ++;
+		}
+		from ++;
+		int64_t diff = (int64_t)((uint64_t)new_val - (uint64_t)old_val);
+		zrank_incr(delta, name, gen, new_path, 0, from - 1, 0, diff);
+	}
+	if(old_score){
+		zrank_incr(delta, name, gen, old_path, from, ZRANK_LEVELS, -1, -old_val);
+	}
+	if(new_score){
+		zrank_incr(delta, name, gen, new_path, from, ZRANK_LEVELS, +1, new_val);
+	}
+}
+
+static int zrank_update(SSDBImpl *ssdb, const Bytes &name, uint64_t gen,
+		const std::string *old_score, const std::string *new_score)
+{
+	int ret = zrank_indexed(ssdb, name, gen);
+	if(ret != 1){
+		return ret;
+	}
+	ZRankDelta delta;
+	zrank_diff(&delta, name, gen, old_score, new_score);
+	return zrank_apply(ssdb, delta);
+}
+
+static int zrank_rebuild(leveldb::DB *ldb, const Bytes &name, uint64_t gen){
+	leveldb::WriteBatch batch;
+	leveldb::ReadOptions opts;
+	opts.fill_cache = false;
+	leveldb::Iterator *it = ldb->NewIterator(opts);
+
+	std::string prefix = encode_zrank_key(name, gen, 0, "");
+	prefix.resize(prefix.size() - 1);
+	for(it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()){
+		batch.Delete(it->key());
+	}
+
+	// items are sorted by score, so a node is complete once the next
+	// item takes another path
+	char path[ZRANK_LEVELS];
+	char cur[ZRANK_LEVELS];
+	int64_t counts[ZRANK_LEVELS + 1];
+	uint64_t sums[ZRANK_LEVELS + 1];
+	memset(counts, 0, sizeof(counts));
+	memset(sums, 0, sizeof(sums));
+	int64_t size = 0;
+	leveldb::Status s;
+
+	prefix.clear();
+	prefix.append(1, DataType::ZSCORE);
+	encode_item_name(&prefix, name, gen);
+	for(it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()){
+		Bytes ks(it->key().data(), it->key().size());
+		std::string name2, key, score;
+		if(decode_zscore_key(ks, &name2, &key, &score) == -1){
+			continue;
+		}
+		zrank_score(score, path);
+		if(size > 0){
+			int from = 0;
+			while(from < ZRANK_LEVELS && cur[from] == path[from]){
+				from ++;
+			}
+			for(int level=from+1; level<=ZRANK_LEVELS; level++){
+				std::string k = encode_zrank_key(name, gen, level, cur);
+				batch.Put(k, zrank_node(counts[level], (int64_t)sums[level]));
+				counts[level] = 0;
+				sums[level] = 0;
+			}
+		}
+		memcpy(cur, path, sizeof(cur));
+		for(int level=0; level<=ZRANK_LEVELS; level++){
+			counts[level] ++;
+			sums[level] += (uint64_t)str_to_int64(score);
+		}
+		size ++;
+
+		if(batch.ApproximateSize() > 1024 * 1024){
+			s = ldb->Write(leveldb::WriteOptions(), &batch);
+			if(!s.ok()){
+				break;
+			}
+			batch.Clear();
+		}
+	}
+	delete it;
+	if(s.ok()){
+		for(int level=0; size > 0 && level<=ZRANK_LEVELS; level++){
+			std::string k = encode_zrank_key(name, gen, level, cur);
+			batch.Put(k, zrank_node(counts[level], (int64_t)sums[level]));
+		}
+		s = ldb->Write(leveldb::WriteOptions(), &batch);
+	}
+	if(!s.ok()){
+		log_error("db error! %s", s.ToString().c_str());
+		return -1;
 	}
 	return 0;
 }
 
 int64_t SSDBImpl::zfix(const Bytes &name){
-	Transaction trans(binlogs);
+	Transaction trans(binlogs, name);
 	std::string it_start, it_end;
 	Iterator *it;
 	leveldb::Status s;
 	int64_t size = 0;
 	int64_t old_size;
+	uint64_t gen;
+	if(get_meta(encode_zsize_key(name), &old_size, &gen) == -1){
+		return -1;
+	}
 
-	it_start = encode_zscore_key(name, "", SSDB_SCORE_MIN);
-	it_end = encode_zscore_key(name, "\xff", SSDB_SCORE_MAX);
+	it_start = encode_zscore_key(name, "", SSDB_SCORE_MIN, gen);
+	it_end = encode_zscore_key(name, "\xff", SSDB_SCORE_MAX, gen);
 	it = this->iterator(it_start, it_end, UINT64_MAX);
 	size = 0;
 	while(it->next()){
@@ -394,16 +996,17 @@ int64_t SSDBImpl::zfix(const Bytes &name){
 			break;
 		}
 		std::string name2, key, score;
-		if(decode_zscore_key(ks, &name2, &key, &score) == -1){
+		uint64_t gen2;
+		if(decode_zscore_key(ks, &name2, &key, &score, &gen2) == -1){
 			size = -1;
 			break;
 		}
-		if(name != name2){
+		if(name != name2 || gen != gen2){
 			break;
 		}
 		size ++;
 		
-		std::string buf = encode_zset_key(name, key);
+		std::string buf = encode_zset_key(name, key, gen);
 		std::string score2;
 		s = ldb->Get(leveldb::ReadOptions(), buf, &score2);
 		if(!s.ok() && !s.IsNotFound()){
@@ -438,17 +1041,17 @@ int64_t SSDBImpl::zfix(const Bytes &name){
 		log_info("fix zsize, name: %s, size: %" PRId64 " => %" PRId64,
 			hexmem(name.data(), name.size()).c_str(), old_size, size);
 		std::string size_key = encode_zsize_key(name);
-		if(size == 0){
+		if(size == 0 && gen == 0){
 			s = ldb->Delete(leveldb::WriteOptions(), size_key);
 		}else{
-			s = ldb->Put(leveldb::WriteOptions(), size_key, leveldb::Slice((char *)&size, sizeof(int64_t)));
+			s = ldb->Put(leveldb::WriteOptions(), size_key, encode_meta(size, gen));
 		}
 	}
 	
 	//////////////////////////////////////////
 
-	it_start = encode_zset_key(name, "");
-	it_end = encode_zset_key(name.String() + "\xff", "");
+	it_start = encode_zset_key(name, "", gen);
+	it_end = encode_zset_key(name.String() + "\xff", "", gen);
 	it = this->iterator(it_start, it_end, UINT64_MAX);
 	size = 0;
 	while(it->next()){
@@ -460,17 +1063,18 @@ int64_t SSDBImpl::zfix(const Bytes &name){
 			break;
 		}
 		std::string name2, key;
-		if(decode_zset_key(ks, &name2, &key) == -1){
+		uint64_t gen2;
+		if(decode_zset_key(ks, &name2, &key, &gen2) == -1){
 			size = -1;
 			break;
 		}
-		if(name != name2){
+		if(name != name2 || gen != gen2){
 			break;
 		}
 		size ++;
 		Bytes score = it->val();
 		
-		std::string buf = encode_zscore_key(name, key, score);
+		std::string buf = encode_zscore_key(name, key, score, gen);
 		std::string score2;
 		s = ldb->Get(leveldb::ReadOptions(), buf, &score2);
 		if(!s.ok() && !s.IsNotFound()){
@@ -505,14 +1109,18 @@ int64_t SSDBImpl::zfix(const Bytes &name){
 		log_info("fix zsize, name: %s, size: %" PRId64 " => %" PRId64,
 			hexmem(name.data(), name.size()).c_str(), old_size, size);
 		std::string size_key = encode_zsize_key(name);
-		if(size == 0){
+		if(size == 0 && gen == 0){
 			s = ldb->Delete(leveldb::WriteOptions(), size_key);
 		}else{
-			s = ldb->Put(leveldb::WriteOptions(), size_key, leveldb::Slice((char *)&size, sizeof(int64_t)));
+			s = ldb->Put(leveldb::WriteOptions(), size_key, encode_meta(size, gen));
 		}
 	}
 	
 	//////////////////////////////////////////
+
+	if(zrank_rebuild(ldb, name, gen) == -1){
+		return -1;
+	}
 	
 	return size;
 }
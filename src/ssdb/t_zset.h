@@ -38,23 +38,22 @@ int decode_zsize_key(const Bytes &slice, std::string *name, uint16_t *slot){
 }
 
 static inline
-std::string encode_zset_key(const Bytes &name, const Bytes &key){
+std::string encode_zset_key(const Bytes &name, const Bytes &key, uint64_t gen){
 	std::string buf;
 	buf.append(1, DataType::ZSET);
-	buf.append(1, (uint8_t)name.size());
-	buf.append(name.data(), name.size());
+	encode_item_name(&buf, name, gen);
 	buf.append(1, (uint8_t)key.size());
 	buf.append(key.data(), key.size());
 	return buf;
 }
 
 static inline
-int decode_zset_key(const Bytes &slice, std::string *name, std::string *key){
+int decode_zset_key(const Bytes &slice, std::string *name, std::string *key, uint64_t *gen=NULL){
 	Decoder decoder(slice.data(), slice.size());
 	if(decoder.skip(1) == -1){
 		return -1;
 	}
-	if(decoder.read_8_data(name) == -1){
+	if(decode_item_name(&decoder, name, gen) == -1){
 		return -1;
 	}
 	if(decoder.read_8_data(key) == -1){
@@ -65,11 +64,10 @@ int decode_zset_key(const Bytes &slice, std::string *name, std::string *key){
 
 // type, len, key, score, =, val
 static inline
-std::string encode_zscore_key(const Bytes &key, const Bytes &val, const Bytes &score){
+std::string encode_zscore_key(const Bytes &key, const Bytes &val, const Bytes &score, uint64_t gen){
 	std::string buf;
 	buf.append(1, DataType::ZSCORE);
-	buf.append(1, (uint8_t)key.size());
-	buf.append(key.data(), key.size());
+	encode_item_name(&buf, key, gen);
 
 	int64_t s = score.Int64();
 	if(s < 0){
@@ -86,12 +84,14 @@ std::string encode_zscore_key(const Bytes &key, const Bytes &val, const Bytes &s
 }
 
 static inline
-int decode_zscore_key(const Bytes &slice, std::string *name, std::string *key, std::string *score){
+int decode_zscore_key(const Bytes &slice, std::string *name, std::string *key, std::string *score,
+		uint64_t *gen=NULL)
+{
 	Decoder decoder(slice.data(), slice.size());
 	if(decoder.skip(1) == -1){
 		return -1;
 	}
-	if(decoder.read_8_data(name) == -1){
+	if(decode_item_name(&decoder, name, gen) == -1){
 		return -1;
 	}
 	if(decoder.skip(1) == -1){
@@ -115,4 +115,62 @@ int decode_zscore_key(const Bytes &slice, std::string *name, std::string *key, s
 	return 0;
 }
 
+// name, the score and key of the first item, of the last item
+static inline
+std::string encode_zdel_range_log(const Bytes &name,
+		const Bytes &score_start, const Bytes &key_start,
+		const Bytes &score_end, const Bytes &key_end)
+{
+	std::string buf;
+	buf.append(1, (uint8_t)name.size());
+	buf.append(name.data(), name.size());
+	int64_t s = encode_score(score_start.Int64());
+	buf.append((char *)&s, sizeof(int64_t));
+	buf.append(1, (uint8_t)key_start.size());
+	buf.append(key_start.data(), key_start.size());
+	s = encode_score(score_end.Int64());
+	buf.append((char *)&s, sizeof(int64_t));
+	buf.append(1, (uint8_t)key_end.size());
+	buf.append(key_end.data(), key_end.size());
+	return buf;
+}
+
+static inline
+int decode_zdel_range_log(const Bytes &slice, std::string *name,
+		std::string *score_start, std::string *key_start,
+		std::string *score_end, std::string *key_end)
+{
+	Decoder decoder(slice.data(), slice.size());
+	if(decoder.read_8_data(name) == -1){
+		return -1;
+	}
+	int64_t s;
+	if(decoder.read_int64(&s) == -1){
+		return -1;
+	}
+	score_start->assign(str((int64_t)decode_score(s)));
+	if(decoder.read_8_data(key_start) == -1){
+		return -1;
+	}
+	if(decoder.read_int64(&s) == -1){
+		return -1;
+	}
+	score_end->assign(str((int64_t)decode_score(s)));
+	if(decoder.read_8_data(key_end) == -1){
+		return -1;
+	}
+	return 0;
+}
+
+// type, name, level, the first `level` bytes of the score
+static inline
+std::string encode_zrank_key(const Bytes &name, uint64_t gen, int level, const char *score){
+	std::string buf;
+	buf.append(1, DataType::ZRANK);
+	encode_item_name(&buf, name, gen);
+	buf.append(1, (uint8_t)level);
+	buf.append(score, level);
+	return buf;
+}
+
 #endif
@@ -5,28 +5,21 @@ found in the LICENSE file.
 */
 #include <pthread.h>
 #include <time.h>
+#include <algorithm>
 #include "../include.h"
 #include "../util/log.h"
 #include "ttl.h"
+#include "t_kv.h"
 
 
 ExpirationHandler::ExpirationHandler(SSDB *ssdb){
 	this->ssdb = ssdb;
 	this->thread_quit = false;
-	this->list_name = EXPIRATION_LIST_KEY;
-	this->first_timeout = 0;
-	this->start();
-}
-
-ExpirationHandler::~ExpirationHandler(){
-	Locking l(&this->mutex);
-	this->stop();
-	ssdb = NULL;
-}
+	this->cursor = std::string(1, DataType::TTL_INDEX);
+	this->due = 0;
+	this->expired = 0;
+	this->migrate();
 
-void ExpirationHandler::start(){
-	thread_quit = false;
-	pthread_t tid;
 	int err = pthread_create(&tid, NULL, &ExpirationHandler::thread_func, this);
 	if(err != 0){
 		log_fatal("can't create thread: %s", strerror(err));
@@ -34,124 +27,278 @@ void ExpirationHandler::start(){
 	}
 }
 
-void ExpirationHandler::stop(){
+ExpirationHandler::~ExpirationHandler(){
 	thread_quit = true;
-	for(int i=0; i<100; i++){
-		if(!thread_quit){
-			break;
-		}
-		usleep(10 * 1000);
+	pthread_join(tid, NULL);
+	std::map<std::string, Entry *>::iterator it;
+	for(it = entries.begin(); it != entries.end(); it++){
+		wheel.del(&it->second->timer);
+		delete it->second;
+	}
+	entries.clear();
+	ssdb = NULL;
+}
+
+static int64_t expire_time(int64_t ttl){
+	int64_t expire = time_ms() + ttl * 1000;
+	if(expire < 1){
+		expire = 1;
 	}
+	return expire;
 }
 
 int ExpirationHandler::set_ttl(const Bytes &key, int64_t ttl){
-	int64_t expired = time_ms() + ttl * 1000;
-	char data[30];
-	int size = snprintf(data, sizeof(data), "%" PRId64, expired);
-	if(size <= 0){
-		log_error("snprintf return error!");
-		return -1;
+	int64_t expire = expire_time(ttl);
+	int ret = ssdb->set_expire(key, expire);
+	if(ret != 1){
+		return ret;
 	}
+	wheel_set(key.String(), expire);
+	return 1;
+}
 
-	int ret = ssdb->zset(this->list_name, key, Bytes(data, size));
+int ExpirationHandler::setx(const Bytes &key, const Bytes &val, int64_t ttl){
+	int64_t expire = expire_time(ttl);
+	int ret = ssdb->setx(key, val, expire);
+	if(ret != 1){
+		return ret;
+	}
+	wheel_set(key.String(), expire);
+	return 1;
+}
+
+int ExpirationHandler::del(const Bytes &key){
+	int ret = ssdb->del(key);
 	if(ret == -1){
 		return -1;
 	}
-	if(expired < first_timeout){
-		first_timeout = expired;
+	wheel_del(key.String());
+	return ret;
+}
+
+int ExpirationHandler::multi_del(const std::vector<Bytes> &keys, int offset){
+	int ret = ssdb->multi_del(keys, offset);
+	if(ret == -1){
+		return -1;
 	}
-	std::string s_key = key.String();
-	if(!fast_keys.empty() && expired <= fast_keys.max_score()){
-		fast_keys.add(s_key, expired);
-		if(fast_keys.size() > BATCH_SIZE){
-			log_debug("pop_back");
-			fast_keys.pop_back();
-		}
-	}else{
-		fast_keys.del(s_key);
-		//log_debug("don't put in fast_keys");
+	for(int i=offset; i<(int)keys.size(); i++){
+		wheel_del(keys[i].String());
 	}
-	
-	return 0;
+	return ret;
 }
 
 int ExpirationHandler::del_ttl(const Bytes &key){
-	// 这样用是有 bug 的, 虽然 fast_keys 为空, 不代表整个 ttl 队列为空
-	// if(!this->fast_keys.empty()){
-	if(first_timeout != INT64_MAX){
-		fast_keys.del(key.String());
-		ssdb->zdel(this->list_name, key);
+	int ret = ssdb->del_expire(key);
+	if(ret == -1){
+		return -1;
 	}
-	return 0;
+	wheel_del(key.String());
+	return ret;
 }
 
 int64_t ExpirationHandler::get_ttl(const Bytes &key){
-	std::string score;
-	if(ssdb->zget(this->list_name, key, &score) == 1){
-		int64_t ex = str_to_int64(score);
-		return (ex - time_ms())/1000;
+	int64_t expire;
+	if(ssdb->get_expire(key, &expire) == 1){
+		return (expire - time_ms())/1000;
 	}
 	return -1;
 }
 
-void ExpirationHandler::load_expiration_keys_from_db(int num){
-	ZIterator *it;
-	it = ssdb->zscan(this->list_name, "", "", "", num);
+std::string ExpirationHandler::stats(){
+	// the oldest expiration not deleted yet
+	int64_t now = time_ms() - EXPIRE_DELAY;
+	int64_t lag = 0;
+	std::string start(1, DataType::TTL_INDEX);
+	Iterator *it = ssdb->iterator(start, encode_ttl_index_key(now, ""), 1);
+	if(it->next()){
+		int64_t expire;
+		std::string key;
+		if(decode_ttl_index_key(it->key(), &expire, &key) == 0){
+			lag = now - expire;
+		}
+	}
+	delete it;
+
+	std::string s;
+	s.append("    wheel    : " + str(wheel.size()) + " keys\n");
+	s.append("    due      : " + str(due) + " keys\n");
+	s.append("    lag      : " + str(lag) + " ms\n");
+	s.append("    expired  : " + str(expired) + " keys");
+	return s;
+}
+
+void ExpirationHandler::migrate(){
+	std::string name = EXPIRATION_LIST_KEY;
+	if(ssdb->zsize(name) <= 0){
+		return;
+	}
+	log_info("moving expirations into the index...");
+	int64_t num = 0;
+	std::string key, score;
+	while(1){
+		ZIterator *it = ssdb->zscan(name, key, score, "", 1000);
+		int n = 0;
+		while(it->next()){
+			key = it->key;
+			score = it->score;
+			int64_t expire = str_to_int64(score);
+			if(expire < 2000000000){
+				// older version compatible
+				expire *= 1000;
+			}
+			if(ssdb->set_expire(key, expire) == -1){
+				delete it;
+				log_error("failed to move expirations");
+				return;
+			}
+			n ++;
+		}
+		delete it;
+		if(n == 0){
+			break;
+		}
+		num += n;
+	}
+	ssdb->zclear(name);
+	log_info("%" PRId64 " expirations moved", num);
+}
+
+void ExpirationHandler::wheel_add(const std::string &key, int64_t expire){
+	Entry *entry;
+	std::map<std::string, Entry *>::iterator it = entries.find(key);
+	if(it != entries.end()){
+		entry = it->second;
+	}else{
+		entry = new Entry();
+		entry->key = key;
+		entry->timer.data = entry;
+		entries[key] = entry;
+	}
+	wheel.add(&entry->timer, expire);
+}
+
+void ExpirationHandler::wheel_del(const std::string &key){
+	std::map<std::string, Entry *>::iterator it = entries.find(key);
+	if(it == entries.end()){
+		return;
+	}
+	Entry *entry = it->second;
+	wheel.del(&entry->timer);
+	entries.erase(it);
+	delete entry;
+}
+
+void ExpirationHandler::wheel_set(const std::string &key, int64_t expire){
+	// the keys after cursor will be loaded in order
+	if(encode_ttl_index_key(expire, key) <= cursor){
+		wheel_add(key, expire);
+	}else{
+		wheel_del(key);
+	}
+}
+
+void ExpirationHandler::load(int64_t now){
+	int limit = std::min(LOAD_BATCH, MAX_WHEEL_KEYS - (int)entries.size());
+	if(limit <= 0){
+		return;
+	}
+	std::string end = encode_ttl_index_key(now + LOAD_AHEAD, "");
+	if(cursor >= end){
+		return;
+	}
 	int n = 0;
+	Iterator *it = ssdb->iterator(cursor, end, limit);
 	while(it->next()){
-		n ++;
-		std::string &key = it->key;
-		int64_t score = str_to_int64(it->score);
-		if(score < 2000000000){
-			// older version compatible
-			score *= 1000;
+		int64_t expire;
+		std::string key;
+		if(decode_ttl_index_key(it->key(), &expire, &key) == 0){
+			wheel_add(key, expire);
 		}
-		fast_keys.add(key, score);
+		cursor = it->key().String();
+		n ++;
 	}
 	delete it;
-	log_debug("load %d keys into fast_keys", n);
+	if(n < limit){
+		cursor = end;
+	}
 }
 
-void ExpirationHandler::expire_loop(){
-	Locking l(&this->mutex);
-	if(!this->ssdb){
-		return;
+void ExpirationHandler::fire(int64_t now, std::vector<std::string> *keys, std::vector<int64_t> *expires){
+	std::vector<Timer *> timers;
+	wheel.expire(now, &timers);
+	for(int i=0; i<(int)timers.size(); i++){
+		Entry *entry = (Entry *)timers[i]->data;
+		keys->push_back(entry->key);
+		expires->push_back(entry->timer.expire);
+		entries.erase(entry->key);
+		delete entry;
 	}
+}
 
-	if(this->fast_keys.empty()){
-		this->load_expiration_keys_from_db(BATCH_SIZE);
-		if(this->fast_keys.empty()){
-			this->first_timeout = INT64_MAX;
-			return;
+void ExpirationHandler::find_overdue(int64_t now, std::vector<std::string> *keys, std::vector<int64_t> *expires){
+	std::string start(1, DataType::TTL_INDEX);
+	std::string end = encode_ttl_index_key(now - OVERDUE_MS, "");
+	Iterator *it = ssdb->iterator(start, end, EXPIRE_BATCH);
+	while(it->next()){
+		int64_t expire;
+		std::string key;
+		if(decode_ttl_index_key(it->key(), &expire, &key) == 0){
+			keys->push_back(key);
+			expires->push_back(expire);
 		}
 	}
-	
-	int64_t score;
-	std::string key;
-	if(this->fast_keys.front(&key, &score)){
-		this->first_timeout = score;
-		
-		if(score <= time_ms()){
-			log_debug("expired %s", key.c_str());
-			ssdb->del(key);
-			ssdb->zdel(this->list_name, key);
-			this->fast_keys.pop_front();
+	delete it;
+}
+
+void ExpirationHandler::expire_keys(const std::vector<std::string> &keys,
+		const std::vector<int64_t> &expires, int64_t now)
+{
+	due = keys.size();
+	int i = 0;
+	while(i < (int)keys.size() && !thread_quit){
+		int n = std::min((int)keys.size() - i, EXPIRE_BATCH);
+		std::vector<std::string> batch(keys.begin() + i, keys.begin() + i + n);
+		std::vector<int64_t> batch_expires(expires.begin() + i, expires.begin() + i + n);
+		int64_t ret;
+		{
+			Locking l(&this->mutex);
+			ret = ssdb->del_expired(batch, batch_expires, now);
+		}
+		if(ret == -1){
+			// the keys left will be found by find_overdue()
+			log_error("failed to delete expired keys");
+			break;
 		}
+		log_debug("expired %" PRId64 " keys", ret);
+		expired += ret;
+		due -= n;
+		i += n;
 	}
+	due = 0;
 }
 
 void* ExpirationHandler::thread_func(void *arg){
 	ExpirationHandler *handler = (ExpirationHandler *)arg;
-	
+
 	while(!handler->thread_quit){
-		if(handler->first_timeout > time_ms()){
+		int64_t now = time_ms() - EXPIRE_DELAY;
+		std::vector<std::string> keys;
+		std::vector<int64_t> expires;
+		{
+			Locking l(&handler->mutex);
+			handler->load(now);
+			handler->fire(now, &keys, &expires);
+		}
+		if(keys.empty()){
+			handler->find_overdue(now, &keys, &expires);
+		}
+		if(keys.empty()){
 			usleep(10 * 1000);
 			continue;
 		}
-		handler->expire_loop();
+		handler->expire_keys(keys, expires, now);
 	}
-	
+
 	log_debug("ExpirationHandler thread quit");
-	handler->thread_quit = false;
 	return (void *)NULL;
 }
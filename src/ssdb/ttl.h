@@ -6,14 +6,27 @@ found in the LICENSE file.
 #ifndef SSDB_TTL_H_
 #define SSDB_TTL_H_
 
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
 #include "ssdb.h"
 #include "../util/thread.h"
-#include "../util/sorted_set.h"
-#include <string>
+#include "../net/timer.h"
 
+// where the expirations were kept by older versions, moved into the
+// TTL_INDEX at startup
 #define EXPIRATION_LIST_KEY "EXPIRE_LIST|KV|\xff\xff\xff\xff\xff"
-#define BATCH_SIZE    1000
 
+// The expirations are kept in the TTL_INDEX(ordered by time), the ones
+// due in the next LOAD_AHEAD ms are loaded into a timing wheel, in
+// order, so the keys of the whole window are not scanned on every tick.
+// The keys fired by the wheel are deleted in batches, each batch in one
+// transaction and one binlog.
+//
+// Expired keys are hidden from reads at once, and deleted EXPIRE_DELAY
+// ms later, by when the compactions may have dropped them already(see
+// ExpiredFilter), saving the deletes.
 class ExpirationHandler
 {
 public:
@@ -26,22 +39,57 @@ public:
 	// or if the key exist but has no associated expire. Starting with Redis 2.8.."
 	// I stick to Redis 2.6
 	int64_t get_ttl(const Bytes &key);
-	// The caller must hold mutex before calling set/del functions
-	int del_ttl(const Bytes &key);
+	// The caller must hold mutex before calling set/del functions,
+	// each of them is one write and one binlog
+	// @return -1: error, 0: key not found, 1: ok
 	int set_ttl(const Bytes &key, int64_t ttl);
+	int del_ttl(const Bytes &key);
+	int setx(const Bytes &key, const Bytes &val, int64_t ttl);
+	// deletes the keys with their expirations
+	int del(const Bytes &key);
+	int multi_del(const std::vector<Bytes> &keys, int offset);
+	std::string stats();
 
 private:
+	static const int EXPIRE_DELAY	= 60 * 1000;
+	static const int LOAD_AHEAD		= 5000;
+	// index keys read at most in one load
+	static const int LOAD_BATCH		= 10000;
+	static const int MAX_WHEEL_KEYS	= 200000;
+	// keys deleted in one transaction
+	static const int EXPIRE_BATCH	= 1000;
+	// the expirations older than this, not in the wheel(written by
+	// replication, or skipped when the wheel was full), are found by
+	// scanning the index
+	static const int OVERDUE_MS		= 1000;
+
+	struct Entry{
+		Timer timer;
+		std::string key;
+	};
+
 	SSDB *ssdb;
+	pthread_t tid;
 	volatile bool thread_quit;
-	std::string list_name;
-	int64_t first_timeout;
-	SortedSet fast_keys;
+	TimerWheel wheel;
+	std::map<std::string, Entry *> entries;
+	// the index keys up to cursor have been loaded into the wheel
+	std::string cursor;
+	// fired by the wheel, not deleted yet
+	volatile int64_t due;
+	volatile uint64_t expired;
 
-	void start();
-	void stop();
-	void expire_loop();
+	void migrate();
+	void load(int64_t now);
+	void wheel_add(const std::string &key, int64_t expire);
+	void wheel_del(const std::string &key);
+	// adds key to the wheel, unless it will be loaded from the index
+	void wheel_set(const std::string &key, int64_t expire);
+	void fire(int64_t now, std::vector<std::string> *keys, std::vector<int64_t> *expires);
+	void find_overdue(int64_t now, std::vector<std::string> *keys, std::vector<int64_t> *expires);
+	void expire_keys(const std::vector<std::string> &keys,
+			const std::vector<int64_t> &expires, int64_t now);
 	static void* thread_func(void *arg);
-	void load_expiration_keys_from_db(int num);
 };
 
 #endif
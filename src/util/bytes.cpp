@@ -4,16 +4,110 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include "bytes.h"
+#include <pthread.h>
+
+/*
+Memory of buffers with sizes of power of 2, from POOL_MIN_SIZE to
+POOL_MAX_SIZE, is kept in per size freelists when released, up to
+POOL_CLASS_BYTES per size, so that links borrow and return their
+buffers cheaply. Plain POD, usable while static objects are destroyed.
+*/
+#define POOL_MIN_BITS     13 // 8K
+#define POOL_MAX_BITS     22 // 4M
+#define POOL_CLASSES      (POOL_MAX_BITS - POOL_MIN_BITS + 1)
+#define POOL_CLASS_BYTES  (8 * 1024 * 1024)
+
+struct BufferPoolClass{
+	pthread_mutex_t mutex;
+	int count;
+	char *blocks[POOL_CLASS_BYTES >> POOL_MIN_BITS];
+};
+
+static BufferPoolClass pool_classes[POOL_CLASSES] = {
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+	{PTHREAD_MUTEX_INITIALIZER, 0, {NULL}},
+};
+
+// -1 if memory of this size is not pooled
+static int pool_class(int size){
+	if(size < (1 << POOL_MIN_BITS) || size > (1 << POOL_MAX_BITS) || (size & (size - 1))){
+		return -1;
+	}
+	return (31 - __builtin_clz(size)) - POOL_MIN_BITS;
+}
+
+static char* pool_alloc(int size){
+	int c = pool_class(size);
+	if(c != -1){
+		BufferPoolClass *pc = &pool_classes[c];
+		char *p = NULL;
+		pthread_mutex_lock(&pc->mutex);
+		if(pc->count > 0){
+			p = pc->blocks[--pc->count];
+		}
+		pthread_mutex_unlock(&pc->mutex);
+		if(p){
+			return p;
+		}
+	}
+	return (char *)malloc(size);
+}
+
+static void pool_free(char *p, int size){
+	if(p == NULL){
+		return;
+	}
+	int c = pool_class(size);
+	if(c != -1){
+		BufferPoolClass *pc = &pool_classes[c];
+		bool kept = false;
+		pthread_mutex_lock(&pc->mutex);
+		if((int64_t)(pc->count + 1) * size <= POOL_CLASS_BYTES){
+			pc->blocks[pc->count++] = p;
+			kept = true;
+		}
+		pthread_mutex_unlock(&pc->mutex);
+		if(kept){
+			return;
+		}
+	}
+	free(p);
+}
 
 Buffer::Buffer(int total){
 	size_ = 0;
 	total_ = origin_total = total;
-	buf = (char *)malloc(total);
+	buf = pool_alloc(total);
 	data_ = buf;
 }
 
 Buffer::~Buffer(){
-	free(buf);
+	pool_free(buf, total_);
+}
+
+void Buffer::shrink(){
+	if(size_ > 0){
+		return;
+	}
+	data_ = buf;
+	if(total_ <= origin_total){
+		return;
+	}
+	char *p = pool_alloc(origin_total);
+	if(p == NULL){
+		return;
+	}
+	pool_free(buf, total_);
+	buf = data_ = p;
+	total_ = origin_total;
 }
 
 void Buffer::nice(){
@@ -36,12 +130,16 @@ int Buffer::grow(){ // 扩大缓冲区
 		n = 2 * total_;
 	}
 	//log_debug("Buffer resize %d => %d", total_, n);
-	char *p = (char *)realloc(buf, n);
+	char *p = pool_alloc(n);
 	if(p == NULL){
 		return -1;
 	}
-	data_ = p + (data_ - buf);
-	buf = p;
+	// only the data is kept, moved to the head
+	if(size_ > 0){
+		memcpy(p, data_, size_);
+	}
+	pool_free(buf, total_);
+	buf = data_ = p;
 	total_ = n;
 	return total_;
 }
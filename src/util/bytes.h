@@ -214,6 +214,8 @@ class Buffer{
 		void nice();
 		// 扩大缓冲区
 		int grow();
+		// give the memory of an empty buffer back, to its initial size
+		void shrink();
 
 		std::string stats() const;
 		int read_record(Bytes *s);
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#include "histogram.h"
+#include <stdio.h>
+
+Histogram::Histogram(){
+	this->reset();
+}
+
+void Histogram::reset(){
+	count_ = 0;
+	sum_ = 0;
+	max_ = 0;
+	for(int i=0; i<NUM_BUCKETS; i++){
+		buckets[i] = 0;
+	}
+	__sync_synchronize();
+}
+
+int Histogram::bucket_index(uint64_t val){
+	if(val < SUB_BUCKETS){
+		return (int)val;
+	}
+	int bits = 63 - __builtin_clzll(val);
+	if(bits >= MAX_BITS){
+		return NUM_BUCKETS - 1;
+	}
+	int sub = (int)(val >> (bits - SUB_BITS)) & (SUB_BUCKETS - 1);
+	return SUB_BUCKETS + (bits - SUB_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucket_value(int index){
+	if(index < SUB_BUCKETS){
+		return index;
+	}
+	int bits = (index - SUB_BUCKETS) / SUB_BUCKETS + SUB_BITS;
+	int sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+	uint64_t width = (uint64_t)1 << (bits - SUB_BITS);
+	uint64_t low = ((uint64_t)1 << bits) + sub * width;
+	return low + width/2;
+}
+
+void Histogram::add(uint64_t val){
+	__sync_fetch_and_add(&buckets[bucket_index(val)], 1);
+	__sync_fetch_and_add(&count_, 1);
+	__sync_fetch_and_add(&sum_, val);
+	uint64_t m = max_;
+	while(val > m){
+		if(__sync_bool_compare_and_swap(&max_, m, val)){
+			break;
+		}
+		m = max_;
+	}
+}
+
+uint64_t Histogram::percentile(double p) const{
+	uint64_t total = 0;
+	for(int i=0; i<NUM_BUCKETS; i++){
+		total += buckets[i];
+	}
+	if(total == 0){
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(total * p / 100.0 + 0.5);
+	if(rank == 0){
+		rank = 1;
+	}
+	uint64_t n = 0;
+	for(int i=0; i<NUM_BUCKETS; i++){
+		n += buckets[i];
+		if(n >= rank){
+			uint64_t val = bucket_value(i);
+			// no percentile is larger than max
+			return val < max_? val : (uint64_t)max_;
+		}
+	}
+	return max_;
+}
+
+std::string Histogram::stats() const{
+	char buf[256];
+	uint64_t count = count_;
+	snprintf(buf, sizeof(buf),
+		"count: %" PRIu64 "\tavg: %" PRIu64 "\tp50: %" PRIu64 "\tp90: %" PRIu64
+		"\tp99: %" PRIu64 "\tp999: %" PRIu64 "\tmax: %" PRIu64 "",
+		count, count? (uint64_t)(sum_ / count) : 0,
+		percentile(50), percentile(90), percentile(99), percentile(99.9),
+		(uint64_t)max_);
+	return std::string(buf);
+}
@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_HISTOGRAM_H_
+#define UTIL_HISTOGRAM_H_
+
+#include <inttypes.h>
+#include <string>
+
+// Lock free log-linear histogram, for values such as latency in us.
+// Values are grouped by power of 2, and each group is divided into
+// SUB_BUCKETS linear buckets, so the error is below 1/SUB_BUCKETS.
+// add() could be called by many threads at the same time.
+class Histogram
+{
+public:
+	Histogram();
+	void add(uint64_t val);
+	// not atomic to concurrent add()s, a few of them may survive
+	void reset();
+
+	uint64_t count() const{
+		return count_;
+	}
+	uint64_t sum() const{
+		return sum_;
+	}
+	uint64_t max() const{
+		return max_;
+	}
+	// p: [0, 100]
+	uint64_t percentile(double p) const;
+	// count, avg, p50, p90, p99, p999, max
+	std::string stats() const;
+
+private:
+	static const int SUB_BITS = 3;
+	static const int SUB_BUCKETS = 1 << SUB_BITS;
+	// values larger than 2^MAX_BITS fall into the last bucket
+	static const int MAX_BITS = 40;
+	static const int NUM_BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BITS) * SUB_BUCKETS;
+
+	volatile uint64_t count_;
+	volatile uint64_t sum_;
+	volatile uint64_t max_;
+	volatile uint64_t buckets[NUM_BUCKETS];
+
+	static int bucket_index(uint64_t val);
+	// middle value of the bucket
+	static uint64_t bucket_value(int index);
+};
+
+#endif
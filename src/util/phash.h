@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2012-2014 The SSDB Authors. All rights reserved.
+Use of this source code is governed by a BSD-style license that can be
+found in the LICENSE file.
+*/
+#ifndef UTIL_PHASH_H_
+#define UTIL_PHASH_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// A static, case insensitive string map, rebuilt into a perfect hash
+// table(hash and displace) whenever a key is added, so that lookups cost
+// two array accesses and no probing. Only the first and the last 4 bytes
+// of the key, along with its length, are hashed, unless some keys share
+// those bytes. Keys are kept inline in the table, no longer than
+// MAX_KEY_LEN.
+//
+// Meant for small sets of keys known at startup(command names), set()
+// is expensive and not thread safe, get() could be called by any thread
+// once all keys are set.
+template <class T>
+class PerfectHash{
+	public:
+		static const int MAX_KEY_LEN = 31;
+
+		PerfectHash();
+
+		// return -1 if key is too long
+		int set(const std::string &key, T val);
+		// return T() if not found
+		T get(const char *key, int len) const;
+		int size() const{
+			return (int)keys.size();
+		}
+
+	private:
+		struct Slot{
+			T val;
+			// 0: empty
+			uint8_t len;
+			char key[MAX_KEY_LEN];
+		};
+
+		// hash every byte of the keys, when sampling is not enough to
+		// tell them apart
+		bool full;
+		// 64 - log2(number of slots or buckets)
+		int slot_shift;
+		int bucket_shift;
+		std::vector<uint32_t> disps;
+		std::vector<Slot> slots;
+
+		std::vector<std::string> keys;
+		std::vector<T> vals;
+
+		void build();
+		bool place(int bits, int bucket_bits);
+		uint64_t hash(const char *key, int len) const;
+
+		static int lower(int c){
+			return (c >= 'A' && c <= 'Z')? c + ('a' - 'A') : c;
+		}
+		// the slot of a key, given its hash and the displacement of its bucket
+		static uint64_t displace(uint64_t h, uint32_t disp, int shift){
+			return ((h ^ disp) * 0xc4ceb9fe1a85ec53ULL) >> shift;
+		}
+		static uint32_t load32(const char *p){
+			uint32_t v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+};
+
+
+template <class T>
+PerfectHash<T>::PerfectHash(){
+	full = false;
+	slot_shift = 64;
+	bucket_shift = 64;
+}
+
+template <class T>
+int PerfectHash<T>::set(const std::string &key, T val){
+	if(key.empty() || key.size() > MAX_KEY_LEN){
+		return -1;
+	}
+	std::string k = key;
+	for(int i=0; i<(int)k.size(); i++){
+		k[i] = lower(k[i]);
+	}
+	std::vector<std::string>::iterator it = std::find(keys.begin(), keys.end(), k);
+	if(it != keys.end()){
+		vals[it - keys.begin()] = val;
+	}else{
+		keys.push_back(k);
+		vals.push_back(val);
+	}
+	build();
+	return 0;
+}
+
+template <class T>
+T PerfectHash<T>::get(const char *key, int len) const{
+	if(slots.empty() || len <= 0 || len > MAX_KEY_LEN){
+		return T();
+	}
+	uint64_t h = hash(key, len);
+	uint32_t disp = disps[h >> bucket_shift];
+	const Slot &slot = slots[displace(h, disp, slot_shift)];
+	if(slot.len != len){
+		return T();
+	}
+	// keys are mostly sent in lower case
+	if(memcmp(slot.key, key, len) != 0){
+		for(int i=0; i<len; i++){
+			if(slot.key[i] != lower(key[i])){
+				return T();
+			}
+		}
+	}
+	return slot.val;
+}
+
+// Bit 0x20 is set on every byte hashed, which lowers the letters, false
+// positives are filtered out by comparing the key.
+template <class T>
+uint64_t PerfectHash<T>::hash(const char *key, int len) const{
+	uint64_t h;
+	if(full){
+		// FNV-1a
+		h = 14695981039346656037ULL;
+		for(int i=0; i<len; i++){
+			h ^= (uint64_t)(key[i] | 0x20);
+			h *= 1099511628211ULL;
+		}
+	}else if(len >= 4){
+		h = load32(key) | ((uint64_t)load32(key + len - 4) << 32);
+		h |= 0x2020202020202020ULL;
+	}else{
+		const unsigned char *p = (const unsigned char *)key;
+		h = p[0] | (p[len/2] << 8) | (p[len-1] << 16);
+		h |= 0x202020ULL;
+	}
+	return (h ^ (uint64_t)len) * 0x9e3779b97f4a7c15ULL;
+}
+
+template <class T>
+void PerfectHash<T>::build(){
+	int n = (int)keys.size();
+
+	full = false;
+	std::vector<uint64_t> hs;
+	for(int i=0; i<n; i++){
+		hs.push_back(hash(keys[i].data(), keys[i].size()));
+	}
+	std::sort(hs.begin(), hs.end());
+	if(std::adjacent_find(hs.begin(), hs.end()) != hs.end()){
+		full = true;
+	}
+
+	// load factor no more than 0.5, about 2 keys per bucket
+	int bits = 4;
+	while((1 << bits) < n * 2){
+		bits ++;
+	}
+	while(!place(bits, bits - 2)){
+		bits ++;
+	}
+}
+
+template <class T>
+bool PerfectHash<T>::place(int bits, int bucket_bits){
+	int n = (int)keys.size();
+	uint64_t size = 1ULL << bits;
+	uint64_t num_buckets = 1ULL << bucket_bits;
+	std::vector<uint64_t> hs(n);
+	std::vector<std::vector<int> > buckets(num_buckets);
+	for(int i=0; i<n; i++){
+		hs[i] = hash(keys[i].data(), keys[i].size());
+		buckets[hs[i] >> (64 - bucket_bits)].push_back(i);
+	}
+	// the largest buckets are placed first, while most slots are free
+	std::vector<std::pair<int, int> > order;
+	for(int b=0; b<(int)num_buckets; b++){
+		order.push_back(std::make_pair(-(int)buckets[b].size(), b));
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<uint32_t> new_disps(num_buckets, 0);
+	std::vector<int> owner(size, -1);
+	for(int o=0; o<(int)order.size(); o++){
+		const std::vector<int> &bucket = buckets[order[o].second];
+		if(bucket.empty()){
+			break;
+		}
+		bool found = false;
+		for(uint32_t disp=0; disp<(1<<16) && !found; disp++){
+			found = true;
+			int k;
+			for(k=0; k<(int)bucket.size(); k++){
+				uint64_t s = displace(hs[bucket[k]], disp, 64 - bits);
+				if(owner[s] != -1){
+					found = false;
+					break;
+				}
+				owner[s] = bucket[k];
+			}
+			if(!found){
+				// undo
+				for(int j=0; j<k; j++){
+					owner[displace(hs[bucket[j]], disp, 64 - bits)] = -1;
+				}
+			}else{
+				new_disps[order[o].second] = disp;
+			}
+		}
+		if(!found){
+			return false;
+		}
+	}
+
+	std::vector<Slot> new_slots(size);
+	for(uint64_t s=0; s<size; s++){
+		Slot *slot = &new_slots[s];
+		slot->val = T();
+		slot->len = 0;
+		if(owner[s] != -1){
+			const std::string &key = keys[owner[s]];
+			slot->val = vals[owner[s]];
+			slot->len = (uint8_t)key.size();
+			memcpy(slot->key, key.data(), key.size());
+		}
+	}
+	slot_shift = 64 - bits;
+	bucket_shift = 64 - bucket_bits;
+	disps.swap(new_disps);
+	slots.swap(new_slots);
+	return true;
+}
+
+#endif
@@ -9,11 +9,17 @@ found in the LICENSE file.
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
 #include <queue>
 #include <vector>
+#ifdef __linux__
+	#include <sys/eventfd.h>
+#endif
 
 class Mutex{
 	private:
@@ -77,6 +83,12 @@ class Queue{
 		pthread_cond_t cond;
 		pthread_mutex_t mutex;
 		std::queue<T> items;
+		// number of consumers blocked in pop()
+		int waiting;
+		// consumers of thief may steal items from this queue
+		Queue<T> *thief;
+
+		void notify();
 	public:
 		Queue();
 		~Queue();
@@ -85,27 +97,57 @@ class Queue{
 		int size();
 		int push(const T item);
 		// TODO: with timeout
-		int pop(T *data);
+		// when this queue is empty, an item is taken from victim(if not
+		// NULL) instead, see set_thief()
+		int pop(T *data, Queue<T> *victim=NULL);
+		// non-blocking, return 1: popped, 0: empty
+		int try_pop(T *data);
+		// thief's consumers are woken up when items are pushed into this
+		// queue while all of its own consumers are busy
+		void set_thief(Queue<T> *thief){
+			this->thief = thief;
+		}
 };
 
 
-// Selectable queue, multi writers, single reader
+// Selectable queue, multi writers, single reader.
+// Items are kept in a bounded lock-free ring, the reader is woken up by
+// an eventfd(a pipe where eventfd is not available). Wakeups are
+// coalesced: only the first push after the reader rearmed signals the
+// fd, the reader should then pop() until the queue is empty.
 template <class T>
 class SelectableQueue{
 	private:
+		struct cell_t{
+			volatile size_t seq;
+			T data;
+		};
+		static const int CAPACITY = 16 * 1024;
+		cell_t *cells;
+		size_t mask;
+		volatile size_t head;
+		volatile size_t tail;
+		// 1 if the fd has been signaled and not rearmed yet
+		volatile int signaled;
 		int fds[2];
-		pthread_mutex_t mutex;
-		std::queue<T> items;
+
+		int enqueue(const T &item);
+		int dequeue(T *data);
 	public:
 		SelectableQueue();
 		~SelectableQueue();
 		int fd(){
 			return fds[0];
 		}
+		// approximate size
 		int size();
 		// multi writer
 		int push(const T item);
-		// single reader
+		// single reader, must be called when fd() becomes readable,
+		// before draining the queue with pop()
+		int rearm();
+		// single reader, non-blocking
+		// return 1: popped, 0: empty
 		int pop(T *data);
 };
 
@@ -126,9 +168,16 @@ class WorkerPool{
 				std::string name;
 		};
 	private:
+		struct job_item{
+			JOB job;
+			// where the result goes, default to the pool's own results
+			SelectableQueue<JOB> *results;
+		};
 		std::string name;
-		Queue<JOB> jobs;
+		Queue<job_item> jobs;
 		SelectableQueue<JOB> results;
+		// idle workers take jobs from this pool, see steal_from()
+		WorkerPool *victim;
 
 		int num_workers;
 		std::vector<pthread_t> tids;
@@ -149,8 +198,15 @@ class WorkerPool{
 		
 		int start(int num_workers);
 		int stop();
+		// Workers of this pool process jobs of victim when they have
+		// nothing to do, and victim's workers are all busy. Must be
+		// called before start().
+		void steal_from(WorkerPool *victim);
 		
 		int push(JOB job);
+		// the result will be pushed into `results` instead of the pool's own
+		int push(JOB job, SelectableQueue<JOB> *results);
+		// non-blocking, see SelectableQueue
 		int pop(JOB *job);
 };
 
@@ -162,6 +218,8 @@ template <class T>
 Queue<T>::Queue(){
 	pthread_cond_init(&cond, NULL);
 	pthread_mutex_init(&mutex, NULL);
+	waiting = 0;
+	thief = NULL;
 }
 
 template <class T>
@@ -194,27 +252,64 @@ int Queue<T>::size(){
 
 template <class T>
 int Queue<T>::push(const T item){
+	bool busy;
 	if(pthread_mutex_lock(&mutex) != 0){
 		return -1;
 	}
 	{
 		items.push(item);
+		busy = (int)items.size() > waiting;
 	}
 	pthread_mutex_unlock(&mutex);
 	pthread_cond_signal(&cond);
+	if(busy && thief){
+		thief->notify();
+	}
 	return 1;
 }
 
+// The lock is taken so that a consumer can't miss the signal between
+// checking the victim queue and starting to wait.
+template <class T>
+void Queue<T>::notify(){
+	pthread_mutex_lock(&mutex);
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+template <class T>
+int Queue<T>::try_pop(T *data){
+	int ret = 0;
+	if(pthread_mutex_lock(&mutex) != 0){
+		return -1;
+	}
+	if(!items.empty()){
+		*data = items.front();
+		items.pop();
+		ret = 1;
+	}
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
 template <class T>
-int Queue<T>::pop(T *data){
+int Queue<T>::pop(T *data, Queue<T> *victim){
 	if(pthread_mutex_lock(&mutex) != 0){
 		return -1;
 	}
 	{
 		// 必须放在循环中, 因为 pthread_cond_wait 可能抢不到锁而被其它处理了
 		while(items.empty()){
+			// lock order: thief, then victim
+			if(victim && victim->try_pop(data) == 1){
+				pthread_mutex_unlock(&mutex);
+				return 1;
+			}
 			//fprintf(stderr, "%d wait\n", pthread_self());
-			if(pthread_cond_wait(&cond, &mutex) != 0){
+			waiting ++;
+			int ret = pthread_cond_wait(&cond, &mutex);
+			waiting --;
+			if(ret != 0){
 				//fprintf(stderr, "%s %d -1!\n", __FILE__, __LINE__);
 				return -1;
 			}
@@ -235,78 +330,144 @@ int Queue<T>::pop(T *data){
 
 template <class T>
 SelectableQueue<T>::SelectableQueue(){
+	cells = new cell_t[CAPACITY];
+	mask = CAPACITY - 1;
+	for(size_t i=0; i<CAPACITY; i++){
+		cells[i].seq = i;
+	}
+	head = 0;
+	tail = 0;
+	signaled = 0;
+#ifdef __linux__
+	fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK);
+	if(fds[0] == -1){
+		fprintf(stderr, "create eventfd error\n");
+		exit(0);
+	}
+#else
 	if(pipe(fds) == -1){
 		fprintf(stderr, "create pipe error\n");
 		exit(0);
 	}
-	pthread_mutex_init(&mutex, NULL);
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+#endif
 }
 
 template <class T>
 SelectableQueue<T>::~SelectableQueue(){
-	pthread_mutex_destroy(&mutex);
+	delete[] cells;
 	close(fds[0]);
-	close(fds[1]);
+	if(fds[1] != fds[0]){
+		close(fds[1]);
+	}
 }
 
+// bounded MPMC ring, see Dmitry Vyukov's bounded queue
 template <class T>
-int SelectableQueue<T>::push(const T item){
-	if(pthread_mutex_lock(&mutex) != 0){
-		return -1;
+int SelectableQueue<T>::enqueue(const T &item){
+	cell_t *cell;
+	size_t pos = tail;
+	while(1){
+		cell = &cells[pos & mask];
+		size_t seq = cell->seq;
+		__sync_synchronize();
+		intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+		if(dif == 0){
+			if(__sync_bool_compare_and_swap(&tail, pos, pos + 1)){
+				break;
+			}
+		}else if(dif < 0){
+			return 0;
+		}
+		pos = tail;
 	}
-	{
-		items.push(item);
+	cell->data = item;
+	__sync_synchronize();
+	cell->seq = pos + 1;
+	return 1;
+}
+
+template <class T>
+int SelectableQueue<T>::dequeue(T *data){
+	cell_t *cell;
+	size_t pos = head;
+	while(1){
+		cell = &cells[pos & mask];
+		size_t seq = cell->seq;
+		__sync_synchronize();
+		intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+		if(dif == 0){
+			if(__sync_bool_compare_and_swap(&head, pos, pos + 1)){
+				break;
+			}
+		}else if(dif < 0){
+			return 0;
+		}
+		pos = head;
 	}
-	if(::write(fds[1], "1", 1) == -1){
-		fprintf(stderr, "write fds error\n");
-		exit(0);
+	*data = cell->data;
+	__sync_synchronize();
+	cell->seq = pos + mask + 1;
+	return 1;
+}
+
+template <class T>
+int SelectableQueue<T>::push(const T item){
+	// the reader drains the whole queue on every wakeup, so it is
+	// full only for a short while
+	while(enqueue(item) == 0){
+		sched_yield();
+	}
+	// pairs with the fence in rearm(): the item must be visible before
+	// signaled is read, or the reader may clear signaled, find the queue
+	// empty and sleep, while we see the old signaled == 1 and not signal
+	__sync_synchronize();
+	if(signaled == 0 && __sync_bool_compare_and_swap(&signaled, 0, 1)){
+#ifdef __linux__
+		uint64_t n = 1;
+		if(::write(fds[1], &n, sizeof(n)) == -1){
+#else
+		if(::write(fds[1], "1", 1) == -1){
+#endif
+			fprintf(stderr, "write fds error\n");
+			exit(0);
+		}
 	}
-	pthread_mutex_unlock(&mutex);
 	return 1;
 }
 
 template <class T>
 int SelectableQueue<T>::size(){
-	int ret = 0;
-	pthread_mutex_lock(&mutex);
-	ret = items.size();
-	pthread_mutex_unlock(&mutex);
-	return ret;
+	return (int)(tail - head);
 }
 
 template <class T>
-int SelectableQueue<T>::pop(T *data){
-	int n, ret = 1;
-	char buf[1];
-
+int SelectableQueue<T>::rearm(){
+	char buf[8];
 	while(1){
-		n = ::read(fds[0], buf, 1);
-		if(n < 0){
+		int n = ::read(fds[0], buf, sizeof(buf));
+		if(n == -1){
 			if(errno == EINTR){
 				continue;
-			}else{
-				return -1;
 			}
-		}else if(n == 0){
-			ret = -1;
-		}else{
-			if(pthread_mutex_lock(&mutex) != 0){
+			if(errno != EAGAIN){
 				return -1;
 			}
-			{
-				if(items.empty()){
-					fprintf(stderr, "%s %d error!\n", __FILE__, __LINE__);
-					pthread_mutex_unlock(&mutex);
-					return -1;
-				}
-				*data = items.front();
-				items.pop();
-			}
-			pthread_mutex_unlock(&mutex);
 		}
 		break;
 	}
-	return ret;
+	// items pushed after this point will signal fd again, the fence
+	// pairs with the one in push() between enqueue() and reading
+	// signaled, so either the pusher sees signaled == 0, or we see its
+	// item when draining
+	__sync_lock_release(&signaled);
+	__sync_synchronize();
+	return 0;
+}
+
+template <class T>
+int SelectableQueue<T>::pop(T *data){
+	return dequeue(data);
 }
 
 
@@ -315,6 +476,7 @@ template<class W, class JOB>
 WorkerPool<W, JOB>::WorkerPool(const char *name){
 	this->name = name;
 	this->started = false;
+	this->victim = NULL;
 }
 
 template<class W, class JOB>
@@ -326,7 +488,15 @@ WorkerPool<W, JOB>::~WorkerPool(){
 
 template<class W, class JOB>
 int WorkerPool<W, JOB>::push(JOB job){
-	return this->jobs.push(job);
+	return this->push(job, &this->results);
+}
+
+template<class W, class JOB>
+int WorkerPool<W, JOB>::push(JOB job, SelectableQueue<JOB> *results){
+	job_item item;
+	item.job = job;
+	item.results = results;
+	return this->jobs.push(item);
 }
 
 template<class W, class JOB>
@@ -334,6 +504,12 @@ int WorkerPool<W, JOB>::pop(JOB *job){
 	return this->results.pop(job);
 }
 
+template<class W, class JOB>
+void WorkerPool<W, JOB>::steal_from(WorkerPool *victim){
+	this->victim = victim;
+	victim->jobs.set_thief(&this->jobs);
+}
+
 template<class W, class JOB>
 void* WorkerPool<W, JOB>::_run_worker(void *arg){
 	struct run_arg *p = (struct run_arg*)arg;
@@ -345,15 +521,16 @@ void* WorkerPool<W, JOB>::_run_worker(void *arg){
 	Worker *worker = (Worker *)&w;
 	worker->id = id;
 	worker->init();
+	Queue<job_item> *victim = tp->victim? &tp->victim->jobs : NULL;
 	while(1){
-		JOB job;
-		if(tp->jobs.pop(&job) == -1){
+		job_item item;
+		if(tp->jobs.pop(&item, victim) == -1){
 			fprintf(stderr, "jobs.pop error\n");
 			::exit(0);
 			break;
 		}
-		worker->proc(job);
-		if(tp->results.push(job) == -1){
+		worker->proc(item.job);
+		if(item.results->push(item.job) == -1){
 			fprintf(stderr, "results.push error\n");
 			::exit(0);
 			break;
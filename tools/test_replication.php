@@ -0,0 +1,119 @@
+<?php
+/**
+ * replication test, starts a master and a slave of its own.
+ *
+ * usage: php test_replication.php [/path/to/ssdb-server]
+ */
+
+include(dirname(__FILE__) . '/../api/php/SSDB.php');
+
+$bin = isset($argv[1])? $argv[1] : dirname(__FILE__) . '/../ssdb-server';
+$dir = '/tmp/ssdb_test_replication';
+$master_port = 8898;
+$slave_port = 8899;
+
+$passed = 0;
+$failed = 0;
+
+function check($val, $desc){
+	global $passed, $failed;
+	if($val === true){
+		$passed ++;
+	}else{
+		$failed ++;
+		printf("    Failed: %s\n", $desc);
+	}
+}
+
+function start_server($bin, $dir, $name, $port, $replication){
+	$wd = "$dir/$name";
+	@mkdir($wd, 0755, true);
+	$conf = "work_dir = $wd\n"
+		. "pidfile = $wd/ssdb.pid\n"
+		. "server:\n"
+		. "\tip: 127.0.0.1\n"
+		. "\tport: $port\n"
+		. "replication:\n"
+		. "\tbinlog: yes\n"
+		. $replication
+		. "logger:\n"
+		. "\tlevel: info\n"
+		. "\toutput: $wd/log.txt\n";
+	file_put_contents("$wd/ssdb.conf", $conf);
+	exec("$bin -d $wd/ssdb.conf");
+	for($i=0; $i<50; $i++){
+		try{
+			return new SimpleSSDB('127.0.0.1', $port);
+		}catch(SSDBException $e){
+			usleep(100 * 1000);
+		}
+	}
+	echo "failed to start $name\n";
+	exit(1);
+}
+
+function stop_server($bin, $dir, $name){
+	exec("$bin $dir/$name/ssdb.conf -s stop");
+}
+
+function wait_for($func, $seconds){
+	for($i=0; $i<$seconds * 10; $i++){
+		if($func()){
+			return true;
+		}
+		usleep(100 * 1000);
+	}
+	return false;
+}
+
+exec("rm -rf $dir");
+
+// the copy is throttled, so that the containers are cleared on the master
+// while their items are being copied to the slave
+$master = start_server($bin, $dir, 'master', $master_port, "\tsync_speed: 1\n");
+
+$val = str_repeat('v', 2000);
+for($i=0; $i<3000; $i++){
+	$master->hset('zzz_h', "f$i", $val);
+	$master->qpush_back('zzz_q', $val);
+	$master->zset('zzz_z', "m$i" . str_repeat('x', 240), $i);
+}
+
+$slave = start_server($bin, $dir, 'slave', $slave_port,
+	"\tslaveof:\n\t\tid: master\n\t\ttype: sync\n"
+	. "\t\thost: 127.0.0.1\n\t\tport: $master_port\n");
+
+$types = array(
+	array('hsize', 'hclear', 'hset', array('new', 'v')),
+	array('qsize', 'qclear', 'qpush_back', array('new')),
+	array('zsize', 'zclear', 'zset', array('new', 1)),
+	);
+foreach($types as $type){
+	list($size, $clear, $set, $args) = $type;
+	$name = 'zzz_' . $size[0];
+	$copying = wait_for(function() use($slave, $size, $name){
+		return $slave->$size($name) > 0;
+	}, 60);
+	check($copying, "$name copying");
+	check($master->$clear($name) === 3000, "$clear $name");
+	call_user_func_array(array($master, $set), array_merge(array($name), $args));
+}
+
+// items copied before the clears are cleared on the slave too
+foreach($types as $type){
+	list($size) = $type;
+	$name = 'zzz_' . $size[0];
+	$synced = wait_for(function() use($slave, $size, $name){
+		return $slave->$size($name) === 1;
+	}, 60);
+	check($synced, "$name synced, size: " . $slave->$size($name));
+}
+check($slave->hgetall('zzz_h') === array('new' => 'v'), 'hgetall zzz_h');
+check($slave->qslice('zzz_q', 0, -1) === array('new'), 'qslice zzz_q');
+check($slave->zrange('zzz_z', 0, 10) === array('new' => 1), 'zrange zzz_z');
+
+stop_server($bin, $dir, 'slave');
+stop_server($bin, $dir, 'master');
+
+printf("passed: %3d, failed: %3d\n", $passed, $failed);
+exit($failed? 1 : 0);
@@ -92,6 +92,24 @@ class SSDBTest extends UnitTest{
 		$ret = $this->ssdb->get('TEST_a');
 		$this->assert($ret === null);
 
+		// expired keys, not deleted yet, are not counted in the limit
+		for($i=0; $i<200; $i++){
+			$ssdb->setx('TEST_x' . $i, $val, 1);
+		}
+		for($i=0; $i<10; $i++){
+			$ssdb->set('TEST_y' . $i, $i);
+		}
+		usleep(1.5 * 1000 * 1000);
+		$all = $ssdb->keys('', '', 1000000);
+		$ret = $ssdb->keys('', '', 10);
+		$this->assert($ret === array_slice($all, 0, 10));
+		$all = $ssdb->scan('', '', 1000000);
+		$ret = $ssdb->scan('', '', 10);
+		$this->assert($ret === array_slice($all, 0, 10, true));
+		for($i=0; $i<10; $i++){
+			$ssdb->del('TEST_y' . $i);
+		}
+
 		$ssdb->set('TEST_a', $val);
 		$ssdb->set('TEST_b', $val);
 		
@@ -261,6 +279,68 @@ class SSDBTest extends UnitTest{
 		$this->assert($ret === 1);
 	}
 
+	function test_bqpop(){
+		$ssdb = $this->ssdb;
+		$name = "TEST_" . mt_rand();
+
+		$ssdb->qclear($name);
+		$ssdb->qpush_back($name, array('a', 'b'));
+		$ret = $ssdb->bqpop_front($name, 1);
+		$this->assert($ret === array('a'));
+		$ret = $ssdb->bqpop_back($name, 0);
+		$this->assert($ret === array('b'));
+
+		$stime = microtime(true);
+		$ret = $ssdb->bqpop_front($name, 0.5);
+		$time = microtime(true) - $stime;
+		$this->assert($ret === null);
+		$this->assert($time >= 0.4 && $time < 1.5);
+
+		// blocked until items are pushed, a 0 timeout waits forever
+		$socks = array(
+			$this->send_raw(array('bqpop_front', $name, 0)),
+			$this->send_raw(array('bqpop_back', $name, 0)),
+			);
+		usleep(1200 * 1000);
+		$read = $socks;
+		$write = $except = null;
+		$ret = stream_select($read, $write, $except, 0);
+		$this->assert($ret === 0);
+		$ssdb->qpush_back($name, 'x');
+		$ssdb->qpush_back($name, 'y');
+		$this->assert($this->recv_raw($socks[0]) === array('ok', 'x'));
+		$this->assert($this->recv_raw($socks[1]) === array('ok', 'y'));
+		$ret = $ssdb->qsize($name);
+		$this->assert($ret === 0);
+		foreach($socks as $sock){
+			fclose($sock);
+		}
+	}
+
+	// requests on connections of their own, the responses are read later
+	private function send_raw($req){
+		$sock = stream_socket_client('127.0.0.1:8888');
+		stream_set_timeout($sock, 5);
+		$s = '';
+		foreach(array_merge(array('auth', 'very-strong-password-11111111111111111'), $req) as $i=>$p){
+			$s .= strlen($p) . "\n" . $p . "\n";
+			if($i == 1){
+				$s .= "\n";
+			}
+		}
+		fwrite($sock, $s . "\n");
+		$this->recv_raw($sock);
+		return $sock;
+	}
+
+	private function recv_raw($sock){
+		$resp = array();
+		while(($line = fgets($sock)) !== false && $line !== "\n"){
+			$resp[] = substr(fread($sock, intval($line) + 1), 0, -1);
+		}
+		return $resp;
+	}
+
 	function test_hash(){
 		$ssdb = $this->ssdb;
 		$name = "TEST_" . mt_rand();
@@ -342,6 +422,14 @@ class SSDBTest extends UnitTest{
 		$this->assert(count($ret) == 1);
 		$this->assert($ret[0] == "TEST_b");
 
+		// cleared ones, not swept yet, are not counted in the limit
+		$all = $ssdb->hlist('', '', 1000000);
+		$ssdb->hclear("TEST_c");
+		$ssdb->hclear("TEST_b");
+		$all = array_values(array_diff($all, array("TEST_b", "TEST_c")));
+		$ret = $ssdb->hlist('', '', 2);
+		$this->assert($ret === array_slice($all, 0, 2));
+
 		$ret = $ssdb->hexists('TEST_a', 'a');
 		$this->assert($ret === true);
 		$ssdb->hdel('TEST_a', 'a');
@@ -436,6 +524,14 @@ class SSDBTest extends UnitTest{
 		$this->assert(count($ret) == 1);
 		$this->assert($ret[0] == "TEST_b");
 
+		// cleared ones, not swept yet, are not counted in the limit
+		$all = $ssdb->zlist('', '', 1000000);
+		$ssdb->zclear("TEST_c");
+		$ssdb->zclear("TEST_b");
+		$all = array_values(array_diff($all, array("TEST_b", "TEST_c")));
+		$ret = $ssdb->zlist('', '', 2);
+		$this->assert($ret === array_slice($all, 0, 2));
+
 		$ret = $ssdb->zexists('TEST_a', 'a');
 		$this->assert($ret === true);
 		$ssdb->zdel('TEST_a', 'a');
@@ -490,6 +586,299 @@ class SSDBTest extends UnitTest{
 		$this->assert($keys[0] === 9 && $vals[0] === 9);
 		$this->assert($keys[1] === 8 && $vals[1] === 8);
 	}
+
+	// offsets above 100 are looked up in the rank index
+	function test_zrank(){
+		$ssdb = $this->ssdb;
+		$name = "TEST_" . mt_rand();
+
+		$ssdb->zclear($name);
+		$items = array();
+		for($i=0; $i<300; $i++){
+			// 3 items of each score, from -50
+			$key = sprintf('m%03d', $i);
+			$items[$key] = intval($i / 3) - 50;
+			$ssdb->zset($name, $key, $items[$key]);
+		}
+		$this->check_zrank($name, $items);
+
+		$items['m150'] = -100;
+		$ssdb->zset($name, 'm150', -100);
+		$items['m001'] = 49;
+		$ssdb->zset($name, 'm001', 49);
+		unset($items['m000']);
+		$ssdb->zdel($name, 'm000');
+		unset($items['m200']);
+		$ssdb->zdel($name, 'm200');
+		$this->check_zrank($name, $items);
+
+		$ssdb->zfix($name);
+		$this->check_zrank($name, $items);
+	}
+
+	private function check_zrank($name, $items){
+		$ssdb = $this->ssdb;
+		$keys = array_keys($items);
+		usort($keys, function($a, $b) use($items){
+			if($items[$a] != $items[$b]){
+				return $items[$a] < $items[$b]? -1 : 1;
+			}
+			return strcmp($a, $b);
+		});
+		$sorted = array();
+		foreach($keys as $key){
+			$sorted[$key] = $items[$key];
+		}
+		$rsorted = array_reverse($sorted, true);
+		$size = count($sorted);
+
+		$ret = $ssdb->zsize($name);
+		$this->assert($ret === $size);
+		$ranks = true;
+		foreach($keys as $rank=>$key){
+			if($ssdb->zrank($name, $key) !== $rank
+				|| $ssdb->zrrank($name, $key) !== $size - 1 - $rank){
+				$ranks = false;
+			}
+		}
+		$this->assert($ranks);
+		$offsets = array(0, 1, 99, 100, 101, 102, 150, 151, 200, $size - 2, $size - 1, $size);
+		foreach($offsets as $offset){
+			$ret = $ssdb->zrange($name, $offset, 5);
+			$this->assert($ret === array_slice($sorted, $offset, 5, true), "zrange $offset");
+			$ret = $ssdb->zrrange($name, $offset, 5);
+			$this->assert($ret === array_slice($rsorted, $offset, 5, true), "zrrange $offset");
+		}
+	}
+
+	function test_zaggregate(){
+		$ssdb = $this->ssdb;
+		$name = "TEST_" . mt_rand();
+
+		$ssdb->zclear($name);
+		$items = array();
+		for($i=0; $i<300; $i++){
+			// 2 items of each score, from -200
+			$key = sprintf('m%03d', $i);
+			$items[$key] = intval($i / 2) * 3 - 200;
+			$ssdb->zset($name, $key, $items[$key]);
+		}
+		$items['big'] = 1 << 40;
+		$items['small'] = -70000;
+		$ssdb->multi_zset($name, array('big' => $items['big'], 'small' => $items['small']));
+		$this->check_zaggregate($name, $items);
+
+		$items['m001'] = 255;
+		$ssdb->zset($name, 'm001', 255);
+		$items['m002'] = $ssdb->zincr($name, 'm002', 65536);
+		$this->assert($items['m002'] === -197 + 65536);
+		unset($items['m100']);
+		$ssdb->zdel($name, 'm100');
+		unset($items['big']);
+		$ssdb->zdel($name, 'big');
+		$this->check_zaggregate($name, $items);
+	}
+
+	private function check_zaggregate($name, $items){
+		$ssdb = $this->ssdb;
+		$ranges = array(
+			array('', ''), array('', 0), array(0, ''), array(-200, -200),
+			array(-199, -198), array(-1, 1), array(-100, 100), array(100, -100),
+			array(255, 65536), array(-70000, -69999), array(1000000, ''),
+			array('', -1000000),
+		);
+		foreach($ranges as $range){
+			list($start, $end) = $range;
+			$count = 0;
+			$sum = 0;
+			foreach($items as $score){
+				if(($start === '' || $score >= $start) && ($end === '' || $score <= $end)){
+					$count ++;
+					$sum += $score;
+				}
+			}
+			$desc = "[$start, $end]";
+			$ret = $ssdb->zcount($name, $start, $end);
+			$this->assert($ret === $count, $desc);
+			$ret = $ssdb->zsum($name, $start, $end);
+			$this->assert($ret === $sum, $desc);
+			if($count > 0){
+				$avg = $sum / $count;
+				$ret = $ssdb->zavg($name, $start, $end);
+				$this->assert(abs($ret - $avg) <= 0.000001 * max(1, abs($avg)), $desc);
+			}
+		}
+	}
+
+	// ranges of more than 1000 items are deleted in several batches
+	function test_zremrange(){
+		$ssdb = $this->ssdb;
+		$name = "TEST_" . mt_rand();
+
+		$ssdb->zclear($name);
+		$items = array();
+		for($i=0; $i<4000; $i++){
+			// 3 items of each score, a batch ends within the ties
+			$key = sprintf('m%04d', $i);
+			$items[$key] = intval($i / 3);
+			$ssdb->zset($name, $key, $items[$key]);
+		}
+
+		$ret = $ssdb->zremrangebyscore($name, 10, 400);
+		$this->assert($ret === 1173);
+		foreach($items as $key=>$score){
+			if($score >= 10 && $score <= 400){
+				unset($items[$key]);
+			}
+		}
+		$this->check_zremrange($name, $items);
+
+		$ret = $ssdb->zremrangebyrank($name, 5, 5 + 1200 - 1);
+		$this->assert($ret === 1200);
+		$items = array_slice($items, 0, 5, true) + array_slice($items, 5 + 1200, null, true);
+		$this->check_zremrange($name, $items);
+
+		$ret = $ssdb->zremrangebyrank($name, 1, 100000);
+		$this->assert($ret === count($items) - 1);
+		$items = array_slice($items, 0, 1, true);
+		$this->check_zremrange($name, $items);
+	}
+
+	private function check_zremrange($name, $items){
+		$ssdb = $this->ssdb;
+		$ret = $ssdb->zsize($name);
+		$this->assert($ret === count($items));
+		$ret = $ssdb->zrange($name, 0, 10000);
+		$this->assert($ret === $items);
+		$ret = $ssdb->zcount($name, '', '');
+		$this->assert($ret === count($items));
+		$ret = $ssdb->zsum($name, '', '');
+		$this->assert($ret === array_sum($items));
+		$keys = array_keys($items);
+		$rank = count($keys) - 1;
+		$ret = $ssdb->zrank($name, $keys[$rank]);
+		$this->assert($ret === $rank);
+	}
+
+	// items written after a clear are visible, the older ones are not,
+	// before and after they are swept
+	function test_clear(){
+		$ssdb = $this->ssdb;
+		$name = "TEST_" . mt_rand();
+
+		$ssdb->hclear($name);
+		for($i=0; $i<1100; $i++){
+			$ssdb->hset($name, "f$i", $i);
+		}
+		$ret = $ssdb->hclear($name);
+		$this->assert($ret === 1100);
+		$ret = $ssdb->hsize($name);
+		$this->assert($ret === 0);
+		$ret = $ssdb->hget($name, 'f1');
+		$this->assert($ret === null);
+		$ssdb->hset($name, 'f1', 'new');
+		$ssdb->hset($name, 'new', 'new');
+		$ret = $ssdb->hsize($name);
+		$this->assert($ret === 2);
+		$ret = $ssdb->hget($name, 'f1');
+		$this->assert($ret === 'new');
+		$ret = $ssdb->hexists($name, 'f2');
+		$this->assert($ret === false);
+		$ret = $ssdb->hgetall($name);
+		$this->assert($ret === array('f1' => 'new', 'new' => 'new'));
+		$ret = $ssdb->hkeys($name, '', '', 10);
+		$this->assert($ret === array('f1', 'new'));
+		$ret = $ssdb->hrscan($name, '', '', 10);
+		$this->assert($ret === array('new' => 'new', 'f1' => 'new'));
+
+		$ssdb->zclear($name);
+		for($i=0; $i<1100; $i++){
+			$ssdb->zset($name, "m$i", $i);
+		}
+		$ret = $ssdb->zclear($name);
+		$this->assert($ret === 1100);
+		$ret = $ssdb->zsize($name);
+		$this->assert($ret === 0);
+		$ssdb->zset($name, 'm1', -1);
+		$ssdb->zset($name, 'new', 5);
+		$ret = $ssdb->zsize($name);
+		$this->assert($ret === 2);
+		$ret = $ssdb->zget($name, 'm2');
+		$this->assert($ret === null);
+		$ret = $ssdb->zrange($name, 0, 10);
+		$this->assert($ret === array('m1' => -1, 'new' => 5));
+		$ret = $ssdb->zrank($name, 'new');
+		$this->assert($ret === 1);
+		$ret = $ssdb->zcount($name, '', '');
+		$this->assert($ret === 2);
+		$ret = $ssdb->zsum($name, '', '');
+		$this->assert($ret === 4);
+
+		$ssdb->qclear($name);
+		for($i=0; $i<1100; $i++){
+			$ssdb->qpush_back($name, $i);
+		}
+		$ret = $ssdb->qclear($name);
+		$this->assert($ret === 1100);
+		$ret = $ssdb->qsize($name);
+		$this->assert($ret === 0);
+		$ret = $ssdb->qfront($name);
+		$this->assert($ret === null);
+		$ssdb->qpush_back($name, 'b');
+		$ssdb->qpush_front($name, 'a');
+		$ret = $ssdb->qsize($name);
+		$this->assert($ret === 2);
+		$ret = $ssdb->qslice($name, 0, -1);
+		$this->assert($ret === array('a', 'b'));
+		$ret = $ssdb->qget($name, 1);
+		$this->assert($ret === 'b');
+
+		// cleared again before the older generation is swept
+		$name2 = "TEST_" . mt_rand();
+		$ssdb->hclear($name2);
+		$ssdb->hset($name2, 'a', 1);
+		$ssdb->hclear($name2);
+		$ssdb->hset($name2, 'b', 1);
+		$ret = $ssdb->hclear($name2);
+		$this->assert($ret === 1);
+		$ssdb->hset($name2, 'c', 1);
+
+		usleep(1000 * 1000);
+
+		$ret = $ssdb->hsize($name);
+		$this->assert($ret === 2);
+		$ret = $ssdb->hgetall($name);
+		$this->assert($ret === array('f1' => 'new', 'new' => 'new'));
+		$ret = $ssdb->hsize($name2);
+		$this->assert($ret === 1);
+		$ret = $ssdb->hgetall($name2);
+		$this->assert($ret === array('c' => '1'));
+		$ret = $ssdb->zsize($name);
+		$this->assert($ret === 2);
+		$ret = $ssdb->zrange($name, 0, 10);
+		$this->assert($ret === array('m1' => -1, 'new' => 5));
+		$ret = $ssdb->zcount($name, '', '');
+		$this->assert($ret === 2);
+		$ret = $ssdb->qsize($name);
+		$this->assert($ret === 2);
+		$ret = $ssdb->qslice($name, 0, -1);
+		$this->assert($ret === array('a', 'b'));
+
+		// cleared and swept with nothing written since
+		$ssdb->hclear($name);
+		$ssdb->zclear($name);
+		$ssdb->qclear($name);
+		usleep(1000 * 1000);
+		$ssdb->hset($name, 'x', 'x');
+		$ret = $ssdb->hgetall($name);
+		$this->assert($ret === array('x' => 'x'));
+		$ssdb->zset($name, 'x', 1);
+		$ret = $ssdb->zrange($name, 0, 10);
+		$this->assert($ret === array('x' => 1));
+		$ssdb->qpush($name, 'x');
+		$ret = $ssdb->qslice($name, 0, -1);
+		$this->assert($ret === array('x'));
+	}
 }
 
 class UnitTest{